@@ -122,16 +122,177 @@ bool CBanDB::Read(banmap_t& banSet)
 CAddrDB::CAddrDB()
 {
     pathAddr = GetDataDir() / "peers.dat";
+    pathJournal = GetDataDir() / "peers.journal";
 }
 
-bool CAddrDB::Write(const CAddrMan& addr)
+bool CAddrDB::ReadSnapshotHash(uint256& hash)
 {
-    return SerializeFileDB("peers", pathAddr, addr);
+    // the checksum is the last thing in peers.dat
+    FILE *file = fsbridge::fopen(pathAddr, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull() || fseek(filein.Get(), -(long)sizeof(hash), SEEK_END) != 0)
+        return false;
+    try {
+        filein >> hash;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool CAddrDB::ReadJournalHash(uint256& hash)
+{
+    FILE *file = fsbridge::fopen(pathJournal, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+    try {
+        unsigned char pchMsgTmp[4];
+        filein >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return false;
+        filein >> hash;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool CAddrDB::WriteSnapshot(CAddrMan& addr)
+{
+    // serialize in memory, addrman is only locked for that and not during the file I/O
+    CDataStream ssAddr(SER_DISK, CLIENT_VERSION);
+    addr.SerializeAndResetChanges(ssAddr);
+    if (!SerializeFileDB("peers", pathAddr, ssAddr)) {
+        // the changes are lost for the journal, make sure the next write is a full one again
+        fs::remove(pathJournal);
+        return false;
+    }
+
+    // start an empty journal belonging to the new peers.dat
+    uint256 hashSnapshot;
+    if (!ReadSnapshotHash(hashSnapshot)) {
+        fs::remove(pathJournal);
+        return error("%s: Failed to read back %s", __func__, pathAddr.string());
+    }
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << FLATDATA(Params().MessageStart()) << hashSnapshot;
+    fs::path pathTmp = GetDataDir() / "peers.journal.new";
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        fs::remove(pathJournal);
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    }
+    try {
+        fileout << ssHeader;
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        fs::remove(pathJournal);
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, pathJournal)) {
+        fs::remove(pathJournal);
+        return error("%s: Rename-into-place failed", __func__);
+    }
+    return true;
+}
+
+bool CAddrDB::AppendJournal(const CDataStream& ssBatch)
+{
+    FILE *file = fsbridge::fopen(pathJournal, "ab");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathJournal.string());
+    try {
+        fileout << ssBatch;
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    return true;
+}
+
+bool CAddrDB::Write(CAddrMan& addr)
+{
+    std::vector<CAddrManChange> vChanges;
+    if (addr.TakeChanges(vChanges)) {
+        if (vChanges.empty())
+            return true;
+
+        uint256 hashSnapshot, hashJournal;
+        if (ReadSnapshotHash(hashSnapshot) && ReadJournalHash(hashJournal) && hashSnapshot == hashJournal) {
+            CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+            hasher << vChanges;
+            CDataStream ssBatch(SER_DISK, CLIENT_VERSION);
+            ssBatch << vChanges << hasher.GetHash();
+
+            try {
+                if (fs::file_size(pathJournal) + ssBatch.size() <= fs::file_size(pathAddr) / 2 && AppendJournal(ssBatch)) {
+                    LogPrint(BCLog::NET, "Appended %u changed addresses to peers.journal\n", vChanges.size());
+                    return true;
+                }
+            } catch (const fs::filesystem_error& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+        }
+    }
+
+    // the journal is too large, doesn't belong to peers.dat or too many addresses changed
+    return WriteSnapshot(addr);
+}
+
+void CAddrDB::ReadJournal(CAddrMan& addr)
+{
+    uint256 hashSnapshot, hashJournal;
+    if (!ReadSnapshotHash(hashSnapshot) || !ReadJournalHash(hashJournal) || hashSnapshot != hashJournal)
+        return;
+
+    FILE *file = fsbridge::fopen(pathJournal, "rb+");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    long nSize = 0;
+    long nPos = 4 + sizeof(uint256);
+    if (fseek(filein.Get(), 0, SEEK_END) != 0 || (nSize = ftell(filein.Get())) < nPos || fseek(filein.Get(), nPos, SEEK_SET) != 0)
+        return;
+
+    size_t nChanges = 0;
+    while (nPos < nSize) {
+        std::vector<CAddrManChange> vChanges;
+        try {
+            CHashVerifier<CAutoFile> verifier(&filein);
+            verifier >> vChanges;
+            uint256 hashBatch;
+            filein >> hashBatch;
+            if (hashBatch != verifier.GetHash())
+                break;
+        } catch (const std::exception&) {
+            break;
+        }
+        addr.ApplyChanges(vChanges);
+        nChanges += vChanges.size();
+        nPos = ftell(filein.Get());
+    }
+
+    if (nPos < nSize) {
+        // the last batch wasn't written completely, later batches have to follow the good ones
+        LogPrintf("%s: Cutting off incomplete batch of changes at position %d of %s\n", __func__, nPos, pathJournal.string());
+        TruncateFile(filein.Get(), nPos);
+    }
+    LogPrint(BCLog::NET, "Applied %u changed addresses from peers.journal  %dms\n", nChanges, GetTimeMillis() - nStart);
 }
 
 bool CAddrDB::Read(CAddrMan& addr)
 {
-    return DeserializeFileDB(pathAddr, addr);
+    if (!DeserializeFileDB(pathAddr, addr))
+        return false;
+    ReadJournal(addr);
+    return true;
 }
 
 bool CAddrDB::Read(CAddrMan& addr, CDataStream& ssPeers)
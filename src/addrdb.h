@@ -15,6 +15,7 @@
 class CSubNet;
 class CAddrMan;
 class CDataStream;
+class uint256;
 
 typedef enum BanReason
 {
@@ -76,14 +77,31 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
-/** Access to the (IP) address database (peers.dat) */
+/**
+ * Access to the (IP) address database (peers.dat) and its journal (peers.journal).
+ *
+ * The journal starts with the checksum of the peers.dat it belongs to, followed by
+ * batches of changed addresses, each with its own checksum. A journal which doesn't
+ * belong to peers.dat is ignored, a batch which wasn't written completely is cut off.
+ */
 class CAddrDB
 {
 private:
     fs::path pathAddr;
+    fs::path pathJournal;
+
+    bool ReadSnapshotHash(uint256& hash);
+    bool ReadJournalHash(uint256& hash);
+    bool WriteSnapshot(CAddrMan& addr);
+    bool AppendJournal(const CDataStream& ssBatch);
+    void ReadJournal(CAddrMan& addr);
 public:
     CAddrDB();
-    bool Write(const CAddrMan& addr);
+    /**
+     * Append the changes since the last write to the journal, or rewrite peers.dat
+     * if they can't be appended or the journal would grow larger than half of it.
+     */
+    bool Write(CAddrMan& addr);
     bool Read(CAddrMan& addr);
     static bool Read(CAddrMan& addr, CDataStream& ssPeers);
 };
@@ -6,9 +6,20 @@
 #include <addrman.h>
 
 #include <hash.h>
+#include <memusage.h>
 #include <serialize.h>
 #include <streams.h>
 
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const
+{
+    // the raw 16 bytes of the address, which is also what CNetAddr's operator== compares
+    struct in6_addr ip6;
+    addr.GetIn6Addr(&ip6);
+    return CSipHasher(k0, k1).Write((const unsigned char*)&ip6, sizeof(ip6)).Finalize();
+}
+
 int CAddrInfo::GetTriedBucket(const uint256& nKey) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetHash().GetCheapHash();
@@ -67,12 +78,12 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    auto it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return nullptr;
@@ -85,6 +96,7 @@ CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, in
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    MarkChanged(addr);
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -110,6 +122,70 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     vRandom[nRndPos2] = nId1;
 }
 
+void CAddrMan::SetNewPosition(int nUBucket, int nUBucketPos, int nId)
+{
+    int& nPosId = vvNew[nUBucket][nUBucketPos];
+    if (nPosId == -1 && nId != -1) {
+        vNewBucketSize[nUBucket]++;
+        nNewPositions++;
+    } else if (nPosId != -1 && nId == -1) {
+        vNewBucketSize[nUBucket]--;
+        nNewPositions--;
+    }
+    nPosId = nId;
+}
+
+void CAddrMan::SetTriedPosition(int nKBucket, int nKBucketPos, int nId)
+{
+    int& nPosId = vvTried[nKBucket][nKBucketPos];
+    if (nPosId == -1 && nId != -1) {
+        vTriedBucketSize[nKBucket]++;
+        nTriedPositions++;
+    } else if (nPosId != -1 && nId == -1) {
+        vTriedBucketSize[nKBucket]--;
+        nTriedPositions--;
+    }
+    nPosId = nId;
+}
+
+int CAddrMan::SelectPosition(const int (*vvTable)[ADDRMAN_BUCKET_SIZE], const int* vBucketSize, int nPositions)
+{
+    assert(nPositions > 0);
+
+    // skip whole buckets until the one holding the n-th used position, then find it in there
+    int n = RandomInt(nPositions);
+    int nBucket = 0;
+    while (n >= vBucketSize[nBucket]) {
+        n -= vBucketSize[nBucket];
+        nBucket++;
+    }
+    for (int nPos = 0; nPos < ADDRMAN_BUCKET_SIZE; nPos++) {
+        if (vvTable[nBucket][nPos] != -1 && n-- == 0) {
+            return vvTable[nBucket][nPos];
+        }
+    }
+    assert(false); // the bucket sizes are wrong
+    return -1;
+}
+
+void CAddrMan::MarkChanged(const CNetAddr& addr)
+{
+    if (fChangesOverflow)
+        return;
+
+    setChanged.insert(addr);
+    if (setChanged.size() > ADDRMAN_CHANGES_MAX) {
+        fChangesOverflow = true;
+        setChanged.clear();
+    }
+}
+
+void CAddrMan::ResetChanges_()
+{
+    setChanged.clear();
+    fChangesOverflow = false;
+}
+
 void CAddrMan::Delete(int nId)
 {
     assert(mapInfo.count(nId) != 0);
@@ -117,6 +193,7 @@ void CAddrMan::Delete(int nId)
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
+    MarkChanged(info);
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
     mapAddr.erase(info);
@@ -132,7 +209,8 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNewPosition(nUBucket, nUBucketPos, -1);
+        MarkChanged(infoDelete);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -145,11 +223,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNewPosition(bucket, pos, -1);
             info.nRefCount--;
         }
     }
     nNew--;
+    MarkChanged(info);
 
     assert(info.nRefCount == 0);
 
@@ -166,8 +245,9 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTriedPosition(nKBucket, nKBucketPos, -1);
         nTried--;
+        MarkChanged(infoOld);
 
         // find which new bucket it belongs to
         int nUBucket = infoOld.GetNewBucket(nKey);
@@ -177,12 +257,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNewPosition(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTriedPosition(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -209,6 +289,7 @@ void CAddrMan::Good_(const CService& addr, int64_t nTime)
     info.nLastSuccess = nTime;
     info.nLastTry = nTime;
     info.nAttempts = 0;
+    MarkChanged(info);
     // nTime is not updated here, to avoid leaking information about
     // currently-connected peers.
 
@@ -249,6 +330,9 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     CAddrInfo* pinfo = Find(addr, &nId);
 
     if (pinfo) {
+        const uint32_t nTimeOld = pinfo->nTime;
+        const ServiceFlags nServicesOld = pinfo->nServices;
+
         // periodically update nTime
         bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
         int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
@@ -258,6 +342,9 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         // add services
         pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
 
+        if (pinfo->nTime != nTimeOld || pinfo->nServices != nServicesOld)
+            MarkChanged(*pinfo);
+
         // do not update if no new information is present
         if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime))
             return false;
@@ -297,7 +384,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNewPosition(nUBucket, nUBucketPos, nId);
+            MarkChanged(*pinfo);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -326,6 +414,7 @@ void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
     if (fCountFailure && info.nLastCountAttempt < nLastGood) {
         info.nLastCountAttempt = nTime;
         info.nAttempts++;
+        MarkChanged(info);
     }
 }
 
@@ -343,13 +432,7 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
+            int nId = SelectPosition(vvTried, vTriedBucketSize, nTriedPositions);
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -360,13 +443,7 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
+            int nId = SelectPosition(vvNew, vNewBucketSize, nNewPositions);
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -416,9 +493,12 @@ int CAddrMan::Check_()
     if (mapNew.size() != (size_t)nNew)
         return -10;
 
+    int nTriedPositionsCheck = 0;
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
+        int nBucketSize = 0;
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
              if (vvTried[n][i] != -1) {
+                 nBucketSize++;
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
                  if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
@@ -428,11 +508,19 @@ int CAddrMan::Check_()
                  setTried.erase(vvTried[n][i]);
              }
         }
+        if (vTriedBucketSize[n] != nBucketSize)
+            return -20;
+        nTriedPositionsCheck += nBucketSize;
     }
+    if (nTriedPositionsCheck != nTriedPositions)
+        return -21;
 
+    int nNewPositionsCheck = 0;
     for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
+        int nBucketSize = 0;
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
             if (vvNew[n][i] != -1) {
+                nBucketSize++;
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
                 if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
@@ -441,7 +529,12 @@ int CAddrMan::Check_()
                     mapNew.erase(vvNew[n][i]);
             }
         }
+        if (vNewBucketSize[n] != nBucketSize)
+            return -22;
+        nNewPositionsCheck += nBucketSize;
     }
+    if (nNewPositionsCheck != nNewPositions)
+        return -23;
 
     if (setTried.size())
         return -13;
@@ -491,8 +584,10 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 
     // update info
     int64_t nUpdateInterval = 20 * 60;
-    if (nTime - info.nTime > nUpdateInterval)
+    if (nTime - info.nTime > nUpdateInterval) {
         info.nTime = nTime;
+        MarkChanged(info);
+    }
 }
 
 void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
@@ -510,7 +605,144 @@ void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
         return;
 
     // update info
-    info.nServices = nServices;
+    if (info.nServices != nServices) {
+        info.nServices = nServices;
+        MarkChanged(info);
+    }
+}
+
+size_t CAddrMan::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) +
+           memusage::DynamicUsage(vRandom) + memusage::DynamicUsage(setChanged);
+}
+
+bool CAddrMan::TakeChanges(std::vector<CAddrManChange>& vChanges)
+{
+    LOCK(cs);
+    vChanges.clear();
+    if (fChangesOverflow)
+        return false;
+
+    // nId -> index in vChanges of the changed entries in the "new" table
+    std::unordered_map<int, size_t> mapNewChanges;
+    vChanges.reserve(setChanged.size());
+    for (const CNetAddr& addr : setChanged) {
+        CAddrManChange change;
+        change.addr = addr;
+        int nId;
+        const CAddrInfo* pinfo = Find(addr, &nId);
+        if (pinfo) {
+            change.fPresent = true;
+            change.info = *pinfo;
+            change.fInTried = pinfo->fInTried;
+            if (!pinfo->fInTried)
+                mapNewChanges[nId] = vChanges.size();
+        }
+        vChanges.push_back(std::move(change));
+    }
+
+    // one pass over the "new" table instead of computing every bucket position of every entry
+    if (!mapNewChanges.empty()) {
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+            if (vNewBucketSize[bucket] == 0)
+                continue;
+            for (int pos = 0; pos < ADDRMAN_BUCKET_SIZE; pos++) {
+                auto it = mapNewChanges.find(vvNew[bucket][pos]);
+                if (it != mapNewChanges.end())
+                    vChanges[it->second].vNewBuckets.push_back(bucket);
+            }
+        }
+    }
+
+    ResetChanges_();
+    return true;
+}
+
+void CAddrMan::ApplyChanges(const std::vector<CAddrManChange>& vChanges)
+{
+    LOCK(cs);
+
+    // Take all changed addresses out first, so the positions they held are free for their new state.
+    std::unordered_set<int> setRemove;
+    for (const CAddrManChange& change : vChanges) {
+        int nId;
+        if (Find(change.addr, &nId))
+            setRemove.insert(nId);
+    }
+    if (!setRemove.empty()) {
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+            for (int pos = 0; pos < ADDRMAN_BUCKET_SIZE; pos++) {
+                int nId = vvNew[bucket][pos];
+                if (nId != -1 && setRemove.count(nId)) {
+                    SetNewPosition(bucket, pos, -1);
+                    mapInfo[nId].nRefCount--;
+                }
+            }
+        }
+        for (int bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
+            for (int pos = 0; pos < ADDRMAN_BUCKET_SIZE; pos++) {
+                int nId = vvTried[bucket][pos];
+                if (nId != -1 && setRemove.count(nId)) {
+                    SetTriedPosition(bucket, pos, -1);
+                    mapInfo[nId].fInTried = false;
+                    nTried--;
+                    nNew++; // Delete() accounts for it as a "new" entry
+                }
+            }
+        }
+        for (int nId : setRemove) {
+            Delete(nId);
+        }
+    }
+
+    int nDropped = 0;
+    for (const CAddrManChange& change : vChanges) {
+        if (!change.fPresent || !change.info.IsValid() || Find(change.info))
+            continue;
+
+        int nId;
+        CAddrInfo* pinfo = Create(change.info, change.info.source, &nId);
+        pinfo->nLastSuccess = change.info.nLastSuccess;
+        pinfo->nAttempts = change.info.nAttempts;
+        if (change.fInTried) {
+            int nKBucket = pinfo->GetTriedBucket(nKey);
+            int nKBucketPos = pinfo->GetBucketPosition(nKey, false, nKBucket);
+            if (vvTried[nKBucket][nKBucketPos] == -1) {
+                SetTriedPosition(nKBucket, nKBucketPos, nId);
+                pinfo->fInTried = true;
+                nTried++;
+                continue;
+            }
+        } else {
+            for (int bucket : change.vNewBuckets) {
+                if (bucket < 0 || bucket >= ADDRMAN_NEW_BUCKET_COUNT || pinfo->nRefCount == ADDRMAN_NEW_BUCKETS_PER_ADDRESS)
+                    continue;
+                int nUBucketPos = pinfo->GetBucketPosition(nKey, true, bucket);
+                if (vvNew[bucket][nUBucketPos] == -1) {
+                    SetNewPosition(bucket, nUBucketPos, nId);
+                    pinfo->nRefCount++;
+                }
+            }
+        }
+        nNew++;
+        if (pinfo->nRefCount == 0) {
+            // its position is taken by an entry which didn't change, the journal doesn't match the tables
+            Delete(nId);
+            nDropped++;
+        }
+    }
+    if (nDropped > 0) {
+        LogPrint(BCLog::ADDRMAN, "addrman dropped %i addresses from the journal due to collisions\n", nDropped);
+    }
+
+    // what was applied is on disk already
+    for (const CAddrManChange& change : vChanges) {
+        setChanged.erase(change.addr);
+    }
+
+    Check();
 }
 
 int CAddrMan::RandomInt(int nMax){
@@ -16,6 +16,8 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 /**
@@ -112,7 +114,8 @@ public:
 /** Stochastic address manager
  *
  * Design goals:
- *  * Keep the address tables in-memory, and asynchronously dump the entire table to peers.dat.
+ *  * Keep the address tables in-memory, and asynchronously dump the entire table to peers.dat. The changes
+ *    made since then are appended to a journal, the table is only rewritten once the journal grew too large.
  *  * Make sure no (localized) attacker can fill the entire table with his nodes/addresses.
  *
  * To that end:
@@ -133,6 +136,8 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *    * The number of used positions of every bucket is counted, which lets Select pick one of them at a cost that
+ *      doesn't depend on how sparsely the tables are filled.
  */
 
 //! total number of buckets for tried addresses
@@ -171,11 +176,52 @@ public:
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+//! the maximum number of changed addresses tracked for the journal, more changes require rewriting peers.dat
+#define ADDRMAN_CHANGES_MAX 16384
+
 //! Convenience
 #define ADDRMAN_TRIED_BUCKET_COUNT (1 << ADDRMAN_TRIED_BUCKET_COUNT_LOG2)
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/** Salted hasher of the IP of an address, the salt keeps the hash tables safe from crafted collisions */
+class SaltedNetAddrHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const;
+};
+
+/** Current state of an address which changed, as written to the peers.dat journal */
+struct CAddrManChange
+{
+    CNetAddr addr;
+    //! false if the address was deleted
+    bool fPresent = false;
+    CAddrInfo info;
+    bool fInTried = false;
+    //! the "new" buckets it is in, its position in each is derived from the key
+    std::vector<int> vNewBuckets;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(addr);
+        READWRITE(fPresent);
+        if (fPresent) {
+            READWRITE(info);
+            READWRITE(fInTried);
+            READWRITE(vNewBuckets);
+        }
+    }
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -189,10 +235,10 @@ private:
     int nIdCount;
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    std::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, SaltedNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -203,15 +249,29 @@ private:
     //! list of "tried" buckets
     int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! number of used positions in each "tried" bucket and in total
+    int vTriedBucketSize[ADDRMAN_TRIED_BUCKET_COUNT];
+    int nTriedPositions;
+
     //! number of (unique) "new" entries
     int nNew;
 
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! number of used positions in each "new" bucket and in total
+    int vNewBucketSize[ADDRMAN_NEW_BUCKET_COUNT];
+    int nNewPositions;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
+    //! addresses changed since peers.dat or the journal was last written
+    std::unordered_set<CNetAddr, SaltedNetAddrHasher> setChanged;
+
+    //! set when more than ADDRMAN_CHANGES_MAX addresses changed, peers.dat has to be rewritten then
+    bool fChangesOverflow;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -229,6 +289,18 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    //! Set a position in the "new" table to nId (or -1), keeping the bucket sizes up to date.
+    void SetNewPosition(int nUBucket, int nUBucketPos, int nId);
+
+    //! Set a position in the "tried" table to nId (or -1), keeping the bucket sizes up to date.
+    void SetTriedPosition(int nKBucket, int nKBucketPos, int nId);
+
+    //! Pick one of the nPositions used positions of a table uniformly at random and return its nId.
+    int SelectPosition(const int (*vvTable)[ADDRMAN_BUCKET_SIZE], const int* vBucketSize, int nPositions);
+
+    //! Remember that an address changed, for the journal.
+    void MarkChanged(const CNetAddr& addr);
+
     //! Move an entry from the "new" table(s) to the "tried" table
     void MakeTried(CAddrInfo& info, int nId);
 
@@ -267,6 +339,9 @@ protected:
     //! Update an entry's service bits.
     void SetServices_(const CService &addr, ServiceFlags nServices);
 
+    //! Forget the tracked changes, after all of them were written.
+    void ResetChanges_();
+
 public:
     /**
      * serialized format:
@@ -311,7 +386,7 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
         int nIds = 0;
         for (const auto& entry : mapInfo) {
             mapUnkIds[entry.first] = nIds;
@@ -389,7 +464,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNewPosition(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -409,7 +484,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTriedPosition(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -429,7 +504,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNewPosition(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -437,9 +512,10 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                // Delete() only erases this element, which leaves the other iterators valid
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -450,6 +526,9 @@ public:
             LogPrint(BCLog::ADDRMAN, "addrman lost %i new and %i tried addresses due to collisions\n", nLostUnk, nLost);
         }
 
+        // the state read is what is on disk
+        ResetChanges_();
+
         Check();
     }
 
@@ -462,16 +541,24 @@ public:
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvNew[bucket][entry] = -1;
             }
+            vNewBucketSize[bucket] = 0;
         }
         for (size_t bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvTried[bucket][entry] = -1;
             }
+            vTriedBucketSize[bucket] = 0;
         }
 
         nIdCount = 0;
         nTried = 0;
         nNew = 0;
+        nTriedPositions = 0;
+        nNewPositions = 0;
+        mapInfo.clear();
+        mapAddr.clear();
+        setChanged.clear();
+        fChangesOverflow = false;
     }
 
     CAddrMan()
@@ -491,6 +578,27 @@ public:
         return vRandom.size();
     }
 
+    //! Return the memory used by the indexes, the tables themselves have a fixed size.
+    size_t DynamicMemoryUsage() const;
+
+    //! Serialize like Serialize and start a new set of changes, without letting anything change in between.
+    template<typename Stream>
+    void SerializeAndResetChanges(Stream& s)
+    {
+        LOCK(cs);
+        Serialize(s);
+        ResetChanges_();
+    }
+
+    /**
+     * Move the current state of all addresses which changed since the last serialization or call into
+     * vChanges. Returns false if too many changed to be tracked, the whole table needs to be written then.
+     */
+    bool TakeChanges(std::vector<CAddrManChange>& vChanges);
+
+    //! Apply changes read from the journal on top of the tables read from peers.dat.
+    void ApplyChanges(const std::vector<CAddrManChange>& vChanges);
+
     //! Consistency check
     void Check()
     {
@@ -507,6 +615,7 @@ public:
     //! Add a single address.
     bool Add(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        LOCK(cs);
         bool fRet = false;
         Check();
         fRet |= Add_(addr, source, nTimePenalty);
@@ -520,6 +629,7 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
+        LOCK(cs);
         int nAdd = 0;
         Check();
         for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
@@ -0,0 +1,207 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfileparser.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <protocol.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+CBlockFileParser::CBlockFileParser(const CChainParams& chainparamsIn, FILE* fileIn, int nThreads) :
+    chainparams(chainparamsIn),
+    blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION),
+    nRewind(blkdat.GetPos()),
+    fEof(false),
+    nQueuedBytes(0),
+    fRunning(true)
+{
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "blkparse", std::function<void()>(std::bind(&CBlockFileParser::ThreadParse, this)));
+    }
+}
+
+CBlockFileParser::~CBlockFileParser()
+{
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        fRunning = false;
+        condWork.notify_all();
+    }
+    for (auto& thread : vThreads) {
+        if (thread.joinable()) thread.join();
+    }
+}
+
+bool CBlockFileParser::Scan()
+{
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        uint64_t nHeaderPos;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nHeaderPos = blkdat.GetPos();
+            nRewind = nHeaderPos+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            return false;
+        }
+        try {
+            // read the block data, it's deserialized by the workers
+            std::shared_ptr<CSlot> slot = std::make_shared<CSlot>(SER_DISK, CLIENT_VERSION);
+            slot->nHeaderPos = nHeaderPos;
+            slot->nPos = blkdat.GetPos();
+            slot->nSize = nSize;
+            blkdat.SetLimit(slot->nPos + nSize);
+            slot->ssBlock.resize(nSize);
+            blkdat.read((char*)slot->ssBlock.data(), nSize);
+            nRewind = blkdat.GetPos();
+
+            std::unique_lock<std::mutex> lock(cs);
+            queueSlots.push_back(slot);
+            queueUnparsed.push_back(slot);
+            nQueuedBytes += nSize;
+            condWork.notify_one();
+            return true;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    return false;
+}
+
+void CBlockFileParser::Restart(uint64_t nPos)
+{
+    {
+        // workers busy with dropped blocks finish them, nobody waits for them anymore
+        std::unique_lock<std::mutex> lock(cs);
+        queueSlots.clear();
+        queueUnparsed.clear();
+        nQueuedBytes = 0;
+    }
+    if (!blkdat.Seek(nPos)) {
+        fEof = true;
+        return;
+    }
+    nRewind = nPos;
+    fEof = false;
+}
+
+void CBlockFileParser::Parse(CSlot& slot)
+{
+    try {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        slot.ssBlock >> *pblock;
+        slot.nParsed = slot.nSize - slot.ssBlock.size();
+        slot.hash = pblock->GetHash();
+        // An invalid block is checked again by AcceptBlock, which reports it then
+        CValidationState state;
+        CheckBlock(*pblock, state, chainparams.GetConsensus());
+        slot.pblock = std::move(pblock);
+    } catch (const std::exception& e) {
+        slot.strError = e.what();
+    }
+    slot.ssBlock.clear();
+}
+
+void CBlockFileParser::ThreadParse()
+{
+    while (true) {
+        std::shared_ptr<CSlot> slot;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (fRunning && queueUnparsed.empty()) {
+                condWork.wait(lock);
+            }
+            if (!fRunning) return;
+
+            slot = std::move(queueUnparsed.front());
+            queueUnparsed.pop_front();
+            if (slot->fStarted) continue;
+            slot->fStarted = true;
+        }
+
+        Parse(*slot);
+
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            slot->fDone = true;
+            condDone.notify_all();
+        }
+    }
+}
+
+bool CBlockFileParser::Next(CParsedBlock& blockRet)
+{
+    while (true) {
+        // keep the workers busy with the blocks that follow
+        while (!fEof) {
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                if (!queueSlots.empty() && nQueuedBytes >= MAX_BLOCK_PARSE_AHEAD)
+                    break;
+            }
+            if (!Scan())
+                fEof = true;
+        }
+
+        std::shared_ptr<CSlot> slot;
+        bool fParseHere = false;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            if (queueSlots.empty())
+                return false;
+            slot = std::move(queueSlots.front());
+            queueSlots.pop_front();
+            nQueuedBytes -= slot->nSize;
+            if (!slot->fStarted) {
+                // no worker got to it yet
+                slot->fStarted = true;
+                fParseHere = true;
+            }
+        }
+        if (fParseHere) {
+            Parse(*slot);
+        } else {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!slot->fDone) {
+                condDone.wait(lock);
+            }
+        }
+
+        if (!slot->pblock) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, slot->strError);
+            Restart(slot->nHeaderPos + 1);
+            continue;
+        }
+        if (slot->nParsed != slot->nSize) {
+            // the data after the block wasn't part of it
+            Restart(slot->nPos + slot->nParsed);
+        }
+
+        blockRet.pblock = std::move(slot->pblock);
+        blockRet.hash = slot->hash;
+        blockRet.nPos = slot->nPos;
+        return true;
+    }
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEPARSER_H
+#define BITCOIN_BLOCKFILEPARSER_H
+
+#include <primitives/block.h>
+#include <streams.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CChainParams;
+
+/** Maximum number of threads deserializing and checking blocks read from block files */
+static const int MAX_BLOCK_PARSE_THREADS = 16;
+/** Maximum size of the blocks read ahead of the one being imported */
+static const uint64_t MAX_BLOCK_PARSE_AHEAD = 32 * 1000 * 1000;
+
+/**
+ * Reads the blocks of a block file (blk?????.dat, bootstrap.dat or -loadblock) in file order.
+ *
+ * The file is scanned for blocks on the calling thread, while worker threads deserialize
+ * the blocks ahead, compute their hash and run the context free CheckBlock, which marks
+ * them as checked for AcceptBlock. Blocks are returned strictly in the order they appear
+ * in the file.
+ *
+ * Like LoadExternalBlockFile always did, scanning continues one byte after the header of
+ * a block which can't be deserialized, and right after the data of a block which is
+ * shorter than its header said.
+ */
+class CBlockFileParser
+{
+public:
+    struct CParsedBlock
+    {
+        std::shared_ptr<CBlock> pblock;
+        uint256 hash;
+        // position of the block data in the file
+        uint64_t nPos;
+    };
+
+private:
+    struct CSlot
+    {
+        uint64_t nHeaderPos;
+        uint64_t nPos;
+        unsigned int nSize;
+        CDataStream ssBlock;
+        std::shared_ptr<CBlock> pblock;
+        uint256 hash;
+        uint64_t nParsed = 0;
+        std::string strError;
+        bool fStarted = false;
+        bool fDone = false;
+
+        CSlot(int nType, int nVersion) : ssBlock(nType, nVersion) {}
+    };
+
+    const CChainParams& chainparams;
+    CBufferedFile blkdat;
+    uint64_t nRewind;
+    bool fEof;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    // blocks read ahead, in file order
+    std::deque<std::shared_ptr<CSlot>> queueSlots;
+    // blocks read ahead no worker picked up yet
+    std::deque<std::shared_ptr<CSlot>> queueUnparsed;
+    uint64_t nQueuedBytes;
+    bool fRunning;
+    std::vector<std::thread> vThreads;
+
+    bool Scan();
+    void Restart(uint64_t nPos);
+    void Parse(CSlot& slot);
+    void ThreadParse();
+
+public:
+    /** Read the blocks of fileIn, which is taken over and closed, with up to nThreads workers */
+    CBlockFileParser(const CChainParams& chainparamsIn, FILE* fileIn, int nThreads);
+    ~CBlockFileParser();
+
+    CBlockFileParser(const CBlockFileParser&) = delete;
+    CBlockFileParser& operator=(const CBlockFileParser&) = delete;
+
+    /** Return the next block of the file, false at the end of it */
+    bool Next(CParsedBlock& blockRet);
+};
+
+#endif // BITCOIN_BLOCKFILEPARSER_H
@@ -0,0 +1,287 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilewriter.h>
+
+#include <util.h>
+#include <validation.h>
+
+CBlockFileWriter::CBlockFileWriter() :
+    nQueuedBytes(0),
+    nMaxQueuedBytes(0),
+    nBatch(0),
+    fRunning(false),
+    fFailed(false)
+{
+}
+
+CBlockFileWriter::~CBlockFileWriter()
+{
+    Stop();
+
+    std::lock_guard<std::mutex> lock(csFiles);
+    for (const auto& file : mapFiles) {
+        fclose(file.second);
+    }
+    mapFiles.clear();
+}
+
+void CBlockFileWriter::Start(size_t nMaxQueuedBytesIn, std::function<void(const std::string&)> fnAbortIn)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    assert(!threadWriter.joinable());
+
+    fnAbort = fnAbortIn;
+    if (nMaxQueuedBytesIn == 0) {
+        LogPrintf("CBlockFileWriter::%s -- writing on the calling thread\n", __func__);
+        return;
+    }
+
+    nMaxQueuedBytes = nMaxQueuedBytesIn;
+    fRunning = true;
+    threadWriter = std::thread(&TraceThread<std::function<void()> >, "blockwriter", std::function<void()>(std::bind(&CBlockFileWriter::ThreadWrite, this)));
+    LogPrintf("CBlockFileWriter::%s -- started, queueing up to %u bytes\n", __func__, nMaxQueuedBytes);
+}
+
+void CBlockFileWriter::Stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        fRunning = false;
+        condWork.notify_all();
+        condDone.notify_all();
+    }
+    // The writer thread carries out what's left in the queue before exiting
+    if (threadWriter.joinable()) {
+        threadWriter.join();
+        Flush();
+    }
+}
+
+bool CBlockFileWriter::IsRunning()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    return fRunning;
+}
+
+void CBlockFileWriter::ThreadWrite()
+{
+    while (true) {
+        std::deque<CWriteJob> batch;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWork.wait(lock, [this] { return !queueJobs.empty() || !fRunning; });
+            if (queueJobs.empty())
+                return;
+            batch.swap(queueJobs);
+            nBatch = batch.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(csFiles);
+            for (const CWriteJob& job : batch) {
+                Execute(job);
+            }
+            FlushBuffers();
+        }
+
+        // The records can be read from the files now
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            for (const CWriteJob& job : batch) {
+                if (job.action == CWriteJob::WRITE) {
+                    mapPending.erase(PendingKey(job.type, job.nFile, job.nPos + job.nLength));
+                    nQueuedBytes -= job.pvchRecord->size();
+                }
+            }
+            nBatch = 0;
+        }
+        condDone.notify_all();
+    }
+}
+
+bool CBlockFileWriter::Enqueue(CWriteJob&& job)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    if (!fRunning) {
+        lock.unlock();
+        std::lock_guard<std::mutex> lockFiles(csFiles);
+        bool fOk = Execute(job);
+        if (!FlushBuffers())
+            fOk = false;
+        return fOk;
+    }
+    // Nothing is written anymore once a job failed, the node is shutting down
+    if (fFailed)
+        return false;
+
+    if (job.action == CWriteJob::WRITE) {
+        // Bound the memory used by the queue, waiting for the disk when it can't keep up
+        size_t nSize = job.pvchRecord->size();
+        condDone.wait(lock, [this, nSize] { return nQueuedBytes == 0 || nQueuedBytes + nSize <= nMaxQueuedBytes || !fRunning; });
+        nQueuedBytes += nSize;
+        mapPending.emplace(PendingKey(job.type, job.nFile, job.nPos + job.nLength), job);
+    }
+    queueJobs.push_back(std::move(job));
+    condWork.notify_one();
+    return !fFailed;
+}
+
+bool CBlockFileWriter::Write(FileType type, const CDiskBlockPos& pos, unsigned int nDataOffset, std::vector<unsigned char>&& vchRecord)
+{
+    CWriteJob job;
+    job.action = CWriteJob::WRITE;
+    job.type = type;
+    job.nFile = pos.nFile;
+    job.nPos = pos.nPos;
+    job.nLength = nDataOffset;
+    job.pvchRecord = std::make_shared<const std::vector<unsigned char>>(std::move(vchRecord));
+    return Enqueue(std::move(job));
+}
+
+void CBlockFileWriter::Allocate(FileType type, const CDiskBlockPos& pos, unsigned int nLength)
+{
+    CWriteJob job;
+    job.action = CWriteJob::ALLOCATE;
+    job.type = type;
+    job.nFile = pos.nFile;
+    job.nPos = pos.nPos;
+    job.nLength = nLength;
+    Enqueue(std::move(job));
+}
+
+void CBlockFileWriter::Finalize(FileType type, int nFile, unsigned int nSize)
+{
+    CWriteJob job;
+    job.action = CWriteJob::FINALIZE;
+    job.type = type;
+    job.nFile = nFile;
+    job.nPos = nSize;
+    job.nLength = 0;
+    Enqueue(std::move(job));
+}
+
+bool CBlockFileWriter::GetPending(FileType type, const CDiskBlockPos& pos, std::vector<unsigned char>& vchData)
+{
+    std::shared_ptr<const std::vector<unsigned char>> pvchRecord;
+    unsigned int nDataOffset;
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        auto it = mapPending.find(PendingKey(type, pos.nFile, pos.nPos));
+        if (it == mapPending.end())
+            return false;
+        pvchRecord = it->second.pvchRecord;
+        nDataOffset = it->second.nLength;
+    }
+    vchData.assign(pvchRecord->begin() + nDataOffset, pvchRecord->end());
+    return true;
+}
+
+bool CBlockFileWriter::Flush()
+{
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        condDone.wait(lock, [this] { return queueJobs.empty() && nBatch == 0; });
+    }
+
+    {
+        // One commit per file written since the last flush, however many records it got
+        std::lock_guard<std::mutex> lock(csFiles);
+        for (const auto& file : setDirty) {
+            FILE* fileDirty = GetFile(file.first, file.second);
+            if (fileDirty)
+                FileCommit(fileDirty);
+        }
+        setDirty.clear();
+        // Don't keep files open between flushes, so that they can be pruned
+        for (const auto& file : mapFiles) {
+            fclose(file.second);
+        }
+        mapFiles.clear();
+    }
+
+    std::unique_lock<std::mutex> lock(cs);
+    return !fFailed;
+}
+
+bool CBlockFileWriter::Execute(const CWriteJob& job)
+{
+    FILE* file = GetFile(job.type, job.nFile);
+    if (!file) {
+        Fail(strprintf("Unable to open %s file %d", job.type == BLOCK_FILE ? "block" : "undo", job.nFile));
+        return false;
+    }
+
+    switch (job.action) {
+    case CWriteJob::WRITE:
+        if (fseek(file, job.nPos, SEEK_SET) != 0 ||
+            fwrite(job.pvchRecord->data(), 1, job.pvchRecord->size(), file) != job.pvchRecord->size()) {
+            Fail(strprintf("Failed to write %u bytes at position %u of %s file %d", job.pvchRecord->size(), job.nPos, job.type == BLOCK_FILE ? "block" : "undo", job.nFile));
+            return false;
+        }
+        setDirty.emplace(job.type, job.nFile);
+        break;
+    case CWriteJob::ALLOCATE:
+        AllocateFileRange(file, job.nPos, job.nLength);
+        setDirty.emplace(job.type, job.nFile);
+        break;
+    case CWriteJob::FINALIZE:
+        TruncateFile(file, job.nPos);
+        FileCommit(file);
+        CloseFile(job.type, job.nFile);
+        setDirty.erase(std::make_pair(job.type, job.nFile));
+        break;
+    }
+    return true;
+}
+
+bool CBlockFileWriter::FlushBuffers()
+{
+    bool fOk = true;
+    for (const auto& file : mapFiles) {
+        if (fflush(file.second) != 0) {
+            Fail(strprintf("Failed to write to %s file %d", file.first.first == BLOCK_FILE ? "block" : "undo", file.first.second));
+            fOk = false;
+        }
+    }
+    return fOk;
+}
+
+FILE* CBlockFileWriter::GetFile(FileType type, int nFile)
+{
+    auto it = mapFiles.find(std::make_pair(type, nFile));
+    if (it != mapFiles.end())
+        return it->second;
+
+    CDiskBlockPos pos(nFile, 0);
+    FILE* file = type == BLOCK_FILE ? OpenBlockFile(pos) : OpenUndoFile(pos);
+    if (file) {
+        mapFiles.emplace(std::make_pair(type, nFile), file);
+    }
+    return file;
+}
+
+void CBlockFileWriter::CloseFile(FileType type, int nFile)
+{
+    auto it = mapFiles.find(std::make_pair(type, nFile));
+    if (it != mapFiles.end()) {
+        fclose(it->second);
+        mapFiles.erase(it);
+    }
+}
+
+void CBlockFileWriter::Fail(const std::string& strMessage)
+{
+    LogPrintf("CBlockFileWriter::%s -- %s\n", __func__, strMessage);
+    std::function<void(const std::string&)> fnAbortCopy;
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        if (fFailed)
+            return;
+        fFailed = true;
+        fnAbortCopy = fnAbort;
+    }
+    if (fnAbortCopy)
+        fnAbortCopy(strMessage);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEWRITER_H
+#define BITCOIN_BLOCKFILEWRITER_H
+
+#include <chain.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/** -blockwritequeue default (MiB of block and undo data queued for the writer thread, 0 = write on the calling thread) */
+static const int DEFAULT_BLOCK_WRITE_QUEUE = 64;
+/** Maximum -blockwritequeue */
+static const int MAX_BLOCK_WRITE_QUEUE = 1024;
+
+/**
+ * Writes block and undo records to the blk?????.dat and rev?????.dat files on a
+ * dedicated thread, so that block validation doesn't wait for the disk.
+ *
+ * Callers serialize the records and reserve their position in the file beforehand,
+ * the writer carries out the writes, file preallocations and truncations in the order
+ * they were queued and batches the writes queued in the meantime. Until a record is
+ * written it can be read back with GetPending. Files are only fsynced by Flush, which
+ * must succeed before block index entries referring to the records are written, so the
+ * index on disk never marks data as present before it is durable.
+ *
+ * Without a running thread every request is carried out before returning, and Write
+ * reports whether it succeeded.
+ */
+class CBlockFileWriter
+{
+public:
+    enum FileType {
+        BLOCK_FILE,
+        UNDO_FILE,
+    };
+
+private:
+    struct CWriteJob
+    {
+        enum { WRITE, ALLOCATE, FINALIZE } action;
+        FileType type;
+        int nFile;
+        //! WRITE: start of the record, ALLOCATE: start of the range, FINALIZE: size of the file
+        unsigned int nPos;
+        //! ALLOCATE: length of the range; WRITE: offset of the data in the record
+        unsigned int nLength;
+        std::shared_ptr<const std::vector<unsigned char>> pvchRecord;
+    };
+    typedef std::tuple<FileType, int, unsigned int> PendingKey;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    std::deque<CWriteJob> queueJobs;
+    //! records not written yet, by the position of their data
+    std::map<PendingKey, CWriteJob> mapPending;
+    size_t nQueuedBytes;
+    size_t nMaxQueuedBytes;
+    //! jobs taken by the writer thread but not carried out yet
+    size_t nBatch;
+    bool fRunning;
+    bool fFailed;
+    std::function<void(const std::string&)> fnAbort;
+    std::thread threadWriter;
+
+    //! protects the files below, held while jobs are carried out
+    std::mutex csFiles;
+    std::map<std::pair<FileType, int>, FILE*> mapFiles;
+    //! files written since the last Flush
+    std::set<std::pair<FileType, int>> setDirty;
+
+    void ThreadWrite();
+    //! Queue a job, or carry it out right away without the thread. False if it failed or the writer failed before
+    bool Enqueue(CWriteJob&& job);
+    //! Carry out a job, requires csFiles
+    bool Execute(const CWriteJob& job);
+    //! Hand the data written to the open files over to the OS, requires csFiles
+    bool FlushBuffers();
+    FILE* GetFile(FileType type, int nFile);
+    void CloseFile(FileType type, int nFile);
+    void Fail(const std::string& strMessage);
+
+public:
+    CBlockFileWriter();
+    ~CBlockFileWriter();
+
+    /**
+     * Start the writer thread, queueing up to nMaxQueuedBytesIn bytes, or keep writing on the
+     * calling thread if it's 0. fnAbortIn is called when a write fails, either way.
+     */
+    void Start(size_t nMaxQueuedBytesIn, std::function<void(const std::string&)> fnAbortIn);
+    /** Write out the queued jobs and join the writer thread */
+    void Stop();
+    bool IsRunning();
+
+    /**
+     * Queue vchRecord to be written at pos. The record's data starts nDataOffset bytes
+     * into the record, after its header, and is readable with GetPending until written.
+     * Waits for the writer when too much data is queued already.
+     * @return false if the record couldn't be written (without the thread) or the writer failed before
+     */
+    bool Write(FileType type, const CDiskBlockPos& pos, unsigned int nDataOffset, std::vector<unsigned char>&& vchRecord);
+    /** Queue the preallocation of nLength bytes at pos */
+    void Allocate(FileType type, const CDiskBlockPos& pos, unsigned int nLength);
+    /** Queue truncating a file to nSize and committing it, once no more records are appended to it */
+    void Finalize(FileType type, int nFile, unsigned int nSize);
+
+    /**
+     * Get the data (and what follows it in the record) of a record which isn't written yet.
+     * @param[in] pos  the position of the data, after the record's header
+     */
+    bool GetPending(FileType type, const CDiskBlockPos& pos, std::vector<unsigned char>& vchData);
+
+    /**
+     * Wait for all queued jobs and commit the files written to disk.
+     * @return false if a job failed since the writer was started
+     */
+    bool Flush();
+};
+
+#endif // BITCOIN_BLOCKFILEWRITER_H
@@ -0,0 +1,98 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockpayloadcache.h>
+
+#include <memusage.h>
+
+CBlockPayloadCache blockPayloadCache(DEFAULT_BLOCK_PAYLOAD_CACHE_SIZE << 20);
+
+CBlockPayloadCache::CBlockPayloadCache(size_t nMaxSizeIn) :
+    nMaxSize(nMaxSizeIn),
+    nUsage(0),
+    nHits(0),
+    nMisses(0)
+{
+}
+
+size_t CBlockPayloadCache::EntryUsage(const CSharedNetMsgPayload& payload)
+{
+    // list node, map node, the payload with its shared_ptr control block and the serialized block
+    return memusage::MallocUsage(sizeof(lru_t::value_type) + 2 * sizeof(void*)) +
+           memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const key_t, lru_t::iterator>>)) +
+           memusage::MallocUsage(sizeof(CSharedNetMsgPayload) + 2 * sizeof(void*)) +
+           memusage::DynamicUsage(payload.data);
+}
+
+void CBlockPayloadCache::EvictToSize(size_t nTargetSize)
+{
+    AssertLockHeld(cs);
+    while (nUsage > nTargetSize && !listEntries.empty()) {
+        const auto& entry = listEntries.back();
+        nUsage -= EntryUsage(*entry.second);
+        mapEntries.erase(entry.first);
+        listEntries.pop_back();
+    }
+}
+
+void CBlockPayloadCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = nMaxSizeIn;
+    EvictToSize(nMaxSize);
+}
+
+std::shared_ptr<const CSharedNetMsgPayload> CBlockPayloadCache::Get(const uint256& hash, int nFlags)
+{
+    LOCK(cs);
+    if (nMaxSize == 0) {
+        return nullptr;
+    }
+    auto it = mapEntries.find(std::make_pair(hash, nFlags));
+    if (it == mapEntries.end()) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    return it->second->second;
+}
+
+void CBlockPayloadCache::Insert(const uint256& hash, int nFlags, std::shared_ptr<const CSharedNetMsgPayload> payload)
+{
+    LOCK(cs);
+    size_t nEntryUsage = EntryUsage(*payload);
+    if (nEntryUsage > nMaxSize) {
+        return;
+    }
+    key_t key = std::make_pair(hash, nFlags);
+    if (mapEntries.count(key)) {
+        // another thread was faster
+        return;
+    }
+    EvictToSize(nMaxSize - nEntryUsage);
+    listEntries.emplace_front(key, std::move(payload));
+    mapEntries.emplace(key, listEntries.begin());
+    nUsage += nEntryUsage;
+}
+
+void CBlockPayloadCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+CBlockPayloadCacheStats CBlockPayloadCache::GetStats() const
+{
+    LOCK(cs);
+    CBlockPayloadCacheStats stats;
+    stats.nEntries = mapEntries.size();
+    stats.nUsage = nUsage;
+    stats.nMaxSize = nMaxSize;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
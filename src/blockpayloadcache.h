@@ -0,0 +1,70 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPAYLOADCACHE_H
+#define BITCOIN_BLOCKPAYLOADCACHE_H
+
+#include <net.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <memory>
+
+/** Default size of the cache of serialized blocks served to peers, in megabytes */
+static const int64_t DEFAULT_BLOCK_PAYLOAD_CACHE_SIZE = 32;
+
+struct CBlockPayloadCacheStats
+{
+    size_t nEntries = 0;
+    size_t nUsage = 0;
+    size_t nMaxSize = 0;
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+};
+
+/**
+ * Size-bounded LRU cache of serialized blocks, keyed by block hash and serialization flags.
+ *
+ * Peers doing their initial sync ask for the same ranges of blocks, a hit is sent as it is
+ * without reading, deserializing and serializing the block again. The payloads are shared,
+ * an entry evicted while it still waits in a send queue is freed once it was sent.
+ */
+class CBlockPayloadCache
+{
+private:
+    typedef std::pair<uint256, int> key_t;
+    typedef std::list<std::pair<key_t, std::shared_ptr<const CSharedNetMsgPayload>>> lru_t;
+
+    mutable CCriticalSection cs;
+    // most recently used first
+    lru_t listEntries;
+    std::map<key_t, lru_t::iterator> mapEntries;
+    size_t nMaxSize;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    static size_t EntryUsage(const CSharedNetMsgPayload& payload);
+    void EvictToSize(size_t nTargetSize);
+
+public:
+    explicit CBlockPayloadCache(size_t nMaxSizeIn);
+
+    /** Change the maximum size in bytes, 0 disables the cache */
+    void SetMaxSize(size_t nMaxSizeIn);
+
+    /** Return the cached payload of a block serialized with nFlags, nullptr if it's not cached */
+    std::shared_ptr<const CSharedNetMsgPayload> Get(const uint256& hash, int nFlags);
+    /** Add a payload, blocks larger than the whole cache are not added */
+    void Insert(const uint256& hash, int nFlags, std::shared_ptr<const CSharedNetMsgPayload> payload);
+    void Clear();
+
+    CBlockPayloadCacheStats GetStats() const;
+};
+
+extern CBlockPayloadCache blockPayloadCache;
+
+#endif // BITCOIN_BLOCKPAYLOADCACHE_H
@@ -0,0 +1,225 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+
+#include <coins.h>
+#include <consensus/validation.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <set>
+
+CBlockPrefetcher::CBlockPrefetcher() :
+    nInFlight(0),
+    nRunning(0),
+    nDepth(0),
+    fRunning(false),
+    pparams(nullptr),
+    pcoinsBase(nullptr)
+{
+}
+
+CBlockPrefetcher::~CBlockPrefetcher()
+{
+    Interrupt();
+    Stop();
+}
+
+void CBlockPrefetcher::Start(int nThreads, int nDepthIn, const Consensus::Params& params)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    assert(vThreads.empty());
+
+    nDepth = nDepthIn;
+    pparams = &params;
+    fRunning = true;
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "prefetch", std::function<void()>(std::bind(&CBlockPrefetcher::ThreadPrefetch, this)));
+    }
+    LogPrintf("CBlockPrefetcher::%s -- started %d threads, reading up to %d blocks ahead\n", __func__, nThreads, nDepth);
+}
+
+void CBlockPrefetcher::Interrupt()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    fRunning = false;
+    condWork.notify_all();
+    condDone.notify_all();
+}
+
+void CBlockPrefetcher::Stop()
+{
+    for (auto& thread : vThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    vThreads.clear();
+
+    std::unique_lock<std::mutex> lock(cs);
+    queuePending.clear();
+    mapJobs.clear();
+    nInFlight = 0;
+    pcoinsBase = nullptr;
+}
+
+bool CBlockPrefetcher::IsRunning()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    return fRunning;
+}
+
+void CBlockPrefetcher::Prefetch(const std::vector<const CBlockIndex*>& vpindex, const CCoinsView* pcoinsBaseIn)
+{
+    AssertLockHeld(cs_main);
+
+    std::unique_lock<std::mutex> lock(cs);
+    if (!fRunning) return;
+
+    pcoinsBase = pcoinsBaseIn;
+
+    // Forget blocks which aren't going to be connected anymore, e.g. after a reorg
+    std::set<const CBlockIndex*> setWanted(vpindex.begin(), vpindex.end());
+    for (auto it = mapJobs.begin(); it != mapJobs.end(); ) {
+        if (setWanted.count(it->first)) {
+            ++it;
+            continue;
+        }
+        // blocks being read are accounted for by the worker when it's done
+        if (it->second.fDone) nInFlight--;
+        it = mapJobs.erase(it);
+    }
+    queuePending.clear();
+
+    for (const CBlockIndex* pindex : vpindex) {
+        auto it = mapJobs.find(pindex);
+        if (it != mapJobs.end()) {
+            if (!it->second.fStarted) queuePending.push_back(pindex);
+            continue;
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+        CPrefetchJob& job = mapJobs[pindex];
+        job.hash = pindex->GetBlockHash();
+        job.pos = pindex->GetBlockPos();
+        queuePending.push_back(pindex);
+    }
+    condWork.notify_all();
+}
+
+std::shared_ptr<const CBlock> CBlockPrefetcher::Get(const CBlockIndex* pindex)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    auto it = mapJobs.find(pindex);
+    if (it == mapJobs.end()) return nullptr;
+
+    if (!it->second.fStarted) {
+        // no worker got to it yet, reading it right away is faster than waiting
+        queuePending.erase(std::find(queuePending.begin(), queuePending.end(), pindex));
+        mapJobs.erase(it);
+        return nullptr;
+    }
+
+    while (fRunning && !it->second.fDone) {
+        condDone.wait(lock);
+    }
+    if (!it->second.fDone) return nullptr;
+
+    std::shared_ptr<const CBlock> pblock = std::move(it->second.pblock);
+    mapJobs.erase(it);
+    nInFlight--;
+    condWork.notify_one();
+    return pblock;
+}
+
+void CBlockPrefetcher::Cancel()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    queuePending.clear();
+    mapJobs.clear();
+    while (nRunning > 0) {
+        condDone.wait(lock);
+    }
+    nInFlight = 0;
+    pcoinsBase = nullptr;
+}
+
+void CBlockPrefetcher::ThreadPrefetch()
+{
+    while (true) {
+        const CBlockIndex* pindex;
+        uint256 hash;
+        CDiskBlockPos pos;
+        const CCoinsView* pcoins;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (fRunning && (queuePending.empty() || nInFlight >= nDepth)) {
+                condWork.wait(lock);
+            }
+            if (!fRunning) return;
+
+            pindex = queuePending.front();
+            queuePending.pop_front();
+            CPrefetchJob& job = mapJobs.at(pindex);
+            job.fStarted = true;
+            hash = job.hash;
+            pos = job.pos;
+            pcoins = pcoinsBase;
+            nInFlight++;
+            nRunning++;
+        }
+
+        std::shared_ptr<CBlock> pblock;
+        PrefetchBlock(hash, pos, pblock, pcoins);
+
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            nRunning--;
+            auto it = mapJobs.find(pindex);
+            if (it != mapJobs.end() && it->second.fStarted && !it->second.fDone) {
+                it->second.pblock = std::move(pblock);
+                it->second.fDone = true;
+            } else {
+                // dropped meanwhile
+                nInFlight--;
+                condWork.notify_one();
+            }
+            condDone.notify_all();
+        }
+    }
+}
+
+void CBlockPrefetcher::PrefetchBlock(const uint256& hash, const CDiskBlockPos& pos, std::shared_ptr<CBlock>& pblockRet, const CCoinsView* pcoins)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, pos, *pparams) || pblock->GetHash() != hash) {
+        // leave it to ConnectTip to read it again and report the failure
+        return;
+    }
+
+    // An invalid block is checked again by ConnectBlock, which reports it then
+    CValidationState state;
+    CheckBlock(*pblock, state, *pparams);
+
+    if (pcoins) {
+        // Outputs created earlier in the same block can't be in the database
+        std::set<uint256> setTxids;
+        try {
+            for (const auto& tx : pblock->vtx) {
+                if (!tx->IsCoinBase()) {
+                    for (const CTxIn& txin : tx->vin) {
+                        if (!setTxids.count(txin.prevout.hash)) {
+                            pcoins->HaveCoin(txin.prevout);
+                        }
+                    }
+                }
+                setTxids.insert(tx->GetHash());
+            }
+        } catch (const std::exception& e) {
+            // a database error is hit again and handled when the block is connected
+            LogPrint(BCLog::BENCH, "CBlockPrefetcher::%s -- %s\n", __func__, e.what());
+        }
+    }
+
+    pblockRet = std::move(pblock);
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPREFETCH_H
+#define BITCOIN_BLOCKPREFETCH_H
+
+#include <chain.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CCoinsView;
+
+namespace Consensus { struct Params; }
+
+/** -blockprefetch default (number of blocks read ahead while connecting several blocks, 0 = disabled) */
+static const int DEFAULT_BLOCK_PREFETCH = 8;
+/** Maximum number of blocks read ahead */
+static const int MAX_BLOCK_PREFETCH = 32;
+/** Number of threads reading and checking blocks ahead */
+static const int BLOCK_PREFETCH_THREADS = 3;
+
+/**
+ * Reads the blocks which are about to be connected ahead of time.
+ *
+ * While a block is being connected under cs_main, worker threads read the next
+ * blocks from disk, verify their hash, run the context free CheckBlock (merkle
+ * root included, which marks them as checked for ConnectBlock) and look up the
+ * coins they spend in the coins database, so that those are served from the
+ * database and OS caches when the block is connected.
+ *
+ * The workers never take cs_main and don't touch pcoinsTip, everything they
+ * need is captured when the blocks are queued.
+ */
+class CBlockPrefetcher
+{
+protected:
+    struct CPrefetchJob
+    {
+        uint256 hash;
+        CDiskBlockPos pos;
+        std::shared_ptr<CBlock> pblock;
+        bool fStarted = false;
+        bool fDone = false;
+    };
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    // blocks waiting for a worker, in the order they will be connected
+    std::deque<const CBlockIndex*> queuePending;
+    std::map<const CBlockIndex*, CPrefetchJob> mapJobs;
+    // blocks being read or read but not taken yet
+    int nInFlight;
+    int nRunning;
+    int nDepth;
+    bool fRunning;
+    const Consensus::Params* pparams;
+    const CCoinsView* pcoinsBase;
+    std::vector<std::thread> vThreads;
+
+    void ThreadPrefetch();
+    void PrefetchBlock(const uint256& hash, const CDiskBlockPos& pos, std::shared_ptr<CBlock>& pblockRet, const CCoinsView* pcoins);
+
+public:
+    CBlockPrefetcher();
+    ~CBlockPrefetcher();
+
+    /** Start nThreads workers keeping up to nDepthIn blocks read ahead */
+    void Start(int nThreads, int nDepthIn, const Consensus::Params& params);
+    /** Wake up workers and make them exit */
+    void Interrupt();
+    /** Join workers and drop all blocks */
+    void Stop();
+
+    bool IsRunning();
+
+    /**
+     * Queue the blocks in vpindex (in the order they will be connected) to be read ahead,
+     * coins they spend are looked up in pcoinsBaseIn. Blocks queued before which are not
+     * in vpindex anymore are dropped. Requires cs_main.
+     */
+    void Prefetch(const std::vector<const CBlockIndex*>& vpindex, const CCoinsView* pcoinsBaseIn);
+    /**
+     * Take the block of pindex, waiting for it to be read if needed. Returns nullptr if it
+     * wasn't queued or couldn't be read, the caller reads it itself then.
+     */
+    std::shared_ptr<const CBlock> Get(const CBlockIndex* pindex);
+    /** Drop all queued blocks and wait for the workers to finish the ones in flight, e.g. before pcoinsBase goes away */
+    void Cancel();
+};
+
+#endif // BITCOIN_BLOCKPREFETCH_H
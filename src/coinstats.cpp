@@ -0,0 +1,397 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstats.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <txoutsnapshot.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+#include <version.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/thread.hpp>
+
+CCoinsStatsTracker g_coinstats_tracker;
+
+namespace {
+
+uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+/** The MuHash element of a coin: its outpoint, height and coinbase flag, and output */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin, bool fRemove)
+{
+    std::vector<unsigned char> vch;
+    CVectorWriter ss(SER_DISK, PROTOCOL_VERSION, vch, 0);
+    ss << outpoint << (uint32_t)(coin.nHeight * 2 + coin.fCoinBase) << coin.out;
+    if (fRemove) {
+        muhash.Remove(vch.data(), vch.size());
+    } else {
+        muhash.Insert(vch.data(), vch.size());
+    }
+}
+
+/** A txid range of the UTXO set, read by one thread */
+struct CStatsPartition
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    //! first txid past the range, null for the last range
+    uint256 hashEnd;
+
+    CCoinsStats stats;
+    //! the range's part of the hash_serialized_2 preimage
+    std::vector<unsigned char> vchHashData;
+    MuHash3072 muhash;
+    bool fDone = false;
+    bool fError = false;
+};
+
+/** State shared by GetUTXOStats and the threads reading the partitions */
+struct CStatsWalk
+{
+    std::vector<CStatsPartition> partitions;
+    bool fHashSerialized;
+    bool fMuHash;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    //! the next partition to read, and the next one to hash
+    size_t nNextRead = 0;
+    size_t nNextHash = 0;
+    //! how far reading may get ahead of hashing, which bounds the data buffered
+    size_t nMaxAhead = 1;
+    std::atomic<bool> fInterrupt{false};
+};
+
+void ApplyTxOutputs(const CStatsWalk& walk, CStatsPartition& part, CVectorWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    if (walk.fHashSerialized) {
+        HashTxOutputs(ss, hash, outputs);
+    }
+    part.stats.nTransactions++;
+    for (const auto& output : outputs) {
+        part.stats.nTransactionOutputs++;
+        part.stats.nTotalAmount += output.second.out.nValue;
+        part.stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
+        if (walk.fMuHash) {
+            ApplyCoinHash(part.muhash, COutPoint(hash, output.first), output.second, false);
+        }
+    }
+}
+
+void ReadPartition(const CStatsWalk& walk, CStatsPartition& part)
+{
+    CCoinsViewCursor* pcursor = part.pcursor.get();
+    CVectorWriter ss(SER_GETHASH, PROTOCOL_VERSION, part.vchHashData, 0);
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (pcursor->Valid()) {
+        if (walk.fInterrupt) return;
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+            part.fError = true;
+            return;
+        }
+        if (!part.hashEnd.IsNull() && !(key.hash < part.hashEnd)) break;
+        if (!outputs.empty() && key.hash != prevkey) {
+            ApplyTxOutputs(walk, part, ss, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = std::move(coin);
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyTxOutputs(walk, part, ss, prevkey, outputs);
+    }
+}
+
+void ThreadReadPartitions(CStatsWalk* walk)
+{
+    RenameThread("chaincoin-utxostats");
+    while (true) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> lock(walk->mutex);
+            walk->cond.wait(lock, [walk] {
+                return walk->fInterrupt || walk->nNextRead == walk->partitions.size() || walk->nNextRead < walk->nNextHash + walk->nMaxAhead;
+            });
+            if (walk->fInterrupt || walk->nNextRead == walk->partitions.size()) return;
+            i = walk->nNextRead++;
+        }
+        CStatsPartition& part = walk->partitions[i];
+        try {
+            ReadPartition(*walk, part);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            part.fError = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(walk->mutex);
+            part.fDone = true;
+        }
+        walk->cond.notify_all();
+    }
+}
+
+void StopReaders(CStatsWalk& walk, std::vector<std::thread>& threads)
+{
+    {
+        std::lock_guard<std::mutex> lock(walk.mutex);
+        walk.fInterrupt = true;
+    }
+    walk.cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+//! Read the partitions on worker threads, and combine them in order on this one
+bool WalkPartitions(CStatsWalk& walk, CCoinsStats& stats, MuHash3072& muhash)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_UTXO_STATS_THREADS));
+    walk.nMaxAhead = 2 * nThreads;
+    std::vector<std::thread> threads;
+    bool fSuccess = true;
+    try {
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back(ThreadReadPartitions, &walk);
+        }
+        for (size_t i = 0; i < walk.partitions.size(); i++) {
+            CStatsPartition& part = walk.partitions[i];
+            {
+                std::unique_lock<std::mutex> lock(walk.mutex);
+                while (!part.fDone) {
+                    walk.cond.wait_for(lock, std::chrono::milliseconds(100));
+                    boost::this_thread::interruption_point();
+                }
+            }
+            if (part.fError) {
+                fSuccess = false;
+                break;
+            }
+            ss.write((const char*)part.vchHashData.data(), part.vchHashData.size());
+            stats.nTransactions += part.stats.nTransactions;
+            stats.nTransactionOutputs += part.stats.nTransactionOutputs;
+            stats.nBogoSize += part.stats.nBogoSize;
+            stats.nTotalAmount += part.stats.nTotalAmount;
+            muhash *= part.muhash;
+            part.pcursor.reset();
+            std::vector<unsigned char>().swap(part.vchHashData);
+            {
+                std::lock_guard<std::mutex> lock(walk.mutex);
+                walk.nNextHash = i + 1;
+            }
+            walk.cond.notify_all();
+        }
+    } catch (...) {
+        StopReaders(walk, threads);
+        throw;
+    }
+    StopReaders(walk, threads);
+    if (!fSuccess) {
+        return error("%s: unable to read value", __func__);
+    }
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
+
+} // namespace
+
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats, CoinStatsHashType hash_type)
+{
+    CStatsWalk walk;
+    bool fSeed;
+    {
+        LOCK(cs_main);
+        CTrackedCoinsStats tracked;
+        if (hash_type != CoinStatsHashType::HASH_SERIALIZED && g_coinstats_tracker.Get(tracked)) {
+            stats.hashBlock = tracked.hashBlock;
+            stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+            stats.nTransactionOutputs = tracked.nTransactionOutputs;
+            stats.nBogoSize = tracked.nBogoSize;
+            stats.nTotalAmount = tracked.nTotalAmount;
+            if (hash_type == CoinStatsHashType::MUHASH) {
+                stats.hashMuHash = tracked.muhash.Finalize();
+            }
+            stats.nDiskSize = view->EstimateSize();
+            stats.fTracked = true;
+            return true;
+        }
+        // The tracked stats can be seeded from the walk, if the tip doesn't move in the meantime
+        fSeed = hash_type != CoinStatsHashType::HASH_SERIALIZED && g_coinstats_tracker.IsEnabled();
+
+        // Coins are only written under cs_main, so the cursors all see the same set
+        walk.partitions.resize(UTXO_STATS_PARTITIONS);
+        for (int i = 0; i < UTXO_STATS_PARTITIONS; i++) {
+            uint256 hashStart;
+            *hashStart.begin() = i * 256 / UTXO_STATS_PARTITIONS;
+            walk.partitions[i].pcursor.reset(view->Cursor(hashStart));
+            if (i > 0) {
+                walk.partitions[i - 1].hashEnd = hashStart;
+            }
+        }
+        stats.hashBlock = walk.partitions[0].pcursor->GetBestBlock();
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+    walk.fHashSerialized = hash_type == CoinStatsHashType::HASH_SERIALIZED;
+    walk.fMuHash = hash_type == CoinStatsHashType::MUHASH || fSeed;
+
+    MuHash3072 muhash;
+    if (!WalkPartitions(walk, stats, muhash)) {
+        return false;
+    }
+    if (hash_type == CoinStatsHashType::MUHASH) {
+        stats.hashMuHash = muhash.Finalize();
+    }
+    stats.nDiskSize = view->EstimateSize();
+
+    if (fSeed) {
+        LOCK(cs_main);
+        if (chainActive.Tip() && chainActive.Tip()->GetBlockHash() == stats.hashBlock) {
+            CTrackedCoinsStats tracked;
+            tracked.hashBlock = stats.hashBlock;
+            tracked.nTransactionOutputs = stats.nTransactionOutputs;
+            tracked.nBogoSize = stats.nBogoSize;
+            tracked.nTotalAmount = stats.nTotalAmount;
+            tracked.muhash = muhash;
+            g_coinstats_tracker.Reset(tracked);
+        }
+    }
+    return true;
+}
+
+void CTrackedCoinsStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount += coin.out.nValue;
+    ApplyCoinHash(muhash, outpoint, coin, false);
+}
+
+void CTrackedCoinsStats::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+    nTotalAmount -= coin.out.nValue;
+    ApplyCoinHash(muhash, outpoint, coin, true);
+}
+
+void CCoinsStatsTracker::Load(const CCoinsViewDB& db, bool fEnable)
+{
+    fEnabled = fEnable;
+    fValid = false;
+    stats = CTrackedCoinsStats();
+    if (!fEnabled)
+        return;
+
+    uint256 hashBest = db.GetBestBlock();
+    if (hashBest.IsNull() && db.GetHeadBlocks().empty()) {
+        // An empty coins database, the stats follow it from the genesis block
+        fValid = true;
+    } else if (db.ReadTrackedStats(stats) && stats.hashBlock == hashBest) {
+        fValid = true;
+    } else {
+        stats = CTrackedCoinsStats();
+    }
+    LogPrintf("Coin statistics %s\n", fValid ? "loaded" : "need a walk of the UTXO set");
+}
+
+void CCoinsStatsTracker::Reset(const CTrackedCoinsStats& statsIn)
+{
+    if (!fEnabled)
+        return;
+    stats = statsIn;
+    fValid = true;
+}
+
+bool CCoinsStatsTracker::Get(CTrackedCoinsStats& statsOut) const
+{
+    if (!fValid)
+        return false;
+    statsOut = stats;
+    return true;
+}
+
+void CCoinsStatsTracker::BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo)
+{
+    if (!fValid)
+        return;
+
+    if (pindex->pprev == nullptr) {
+        // The genesis block's transactions aren't added to the UTXO set
+        fValid = stats.hashBlock.IsNull();
+        stats.hashBlock = pindex->GetBlockHash();
+        return;
+    }
+    if (stats.hashBlock != pindex->pprev->GetBlockHash() || blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        fValid = false;
+        return;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                stats.RemoveCoin(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+        }
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            stats.AddCoin(COutPoint(tx.GetHash(), j), Coin(tx.vout[j], pindex->nHeight, tx.IsCoinBase()));
+        }
+    }
+    stats.hashBlock = pindex->GetBlockHash();
+}
+
+void CCoinsStatsTracker::BlockDisconnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo)
+{
+    if (!fValid)
+        return;
+
+    if (stats.hashBlock != pindex->GetBlockHash() || pindex->pprev == nullptr || blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        fValid = false;
+        return;
+    }
+
+    for (size_t i = block.vtx.size(); i-- > 0;) {
+        const CTransaction& tx = *block.vtx[i];
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            stats.RemoveCoin(COutPoint(tx.GetHash(), j), Coin(tx.vout[j], pindex->nHeight, tx.IsCoinBase()));
+        }
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                stats.AddCoin(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+        }
+    }
+    stats.hashBlock = pindex->pprev->GetBlockHash();
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include <amount.h>
+#include <crypto/muhash.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CCoinsViewDB;
+class COutPoint;
+class Coin;
+
+/** Default for -trackcoinstats */
+static const bool DEFAULT_TRACK_COINSTATS = true;
+/** Number of txid ranges the UTXO set is split into by GetUTXOStats */
+static const int UTXO_STATS_PARTITIONS = 256;
+/** Maximum number of threads reading the UTXO set in GetUTXOStats */
+static const int MAX_UTXO_STATS_THREADS = 8;
+
+enum class CoinStatsHashType {
+    HASH_SERIALIZED, //!< hash_serialized_2, an ordered hash of the whole set
+    MUHASH,          //!< MuHash3072 of the coins, which can be updated block by block
+    NONE,
+};
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint256 hashMuHash;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+    //! whether the stats were taken from the tracked statistics instead of reading the UTXO set (no nTransactions)
+    bool fTracked;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0), fTracked(false) {}
+};
+
+/**
+ * Calculate statistics about the unspent transaction output set of view.
+ *
+ * The set is split into txid ranges read by several threads. hash_serialized_2 is
+ * a hash of the whole set in database order, so the ranges are hashed in order on
+ * the calling thread as the readers complete them. The MuHash and NONE hash types
+ * are answered from g_coinstats_tracker without reading the set when it is valid.
+ */
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats, CoinStatsHashType hash_type);
+
+/** UTXO set statistics which can be updated block by block, stored in the coins database */
+struct CTrackedCoinsStats
+{
+    //! the block the UTXO set these statistics describe is at
+    uint256 hashBlock;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CTrackedCoinsStats() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * Keeps CTrackedCoinsStats in step with the coins tip as blocks are connected and
+ * disconnected. The stats become invalid when a change can't be applied (e.g. a
+ * UTXO snapshot was loaded), until a full walk of the UTXO set seeds them again.
+ * Protected by cs_main.
+ */
+class CCoinsStatsTracker
+{
+private:
+    bool fEnabled;
+    bool fValid;
+    CTrackedCoinsStats stats;
+
+public:
+    CCoinsStatsTracker() : fEnabled(false), fValid(false) {}
+
+    //! Read the stats stored in db, which are valid if they are at its best block
+    void Load(const CCoinsViewDB& db, bool fEnable);
+    void Reset(const CTrackedCoinsStats& statsIn);
+    void Invalidate() { fValid = false; }
+
+    bool IsEnabled() const { return fEnabled; }
+    //! Get the current stats, if valid
+    bool Get(CTrackedCoinsStats& statsOut) const;
+
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo);
+    void BlockDisconnected(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo);
+};
+
+extern CCoinsStatsTracker g_coinstats_tracker;
+
+#endif // BITCOIN_COINSTATS_H
@@ -86,6 +86,15 @@ typedef int32_t ssize_t;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// poll() and epoll are only used where they are known to work, WSAPoll is broken
+// and poll() on macOS misbehaves with some descriptors
+#if defined(__linux__)
+#define USE_POLL
+#define USE_EPOLL
+#endif
+
+// Whether s can be waited for with select(), which only takes descriptors below FD_SETSIZE.
+// Sockets waited for with poll() or epoll don't have this limit.
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #ifdef WIN32
     return true;
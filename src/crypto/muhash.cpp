@@ -0,0 +1,199 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - p */
+static const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+
+static const Num3072::limb_t LIMB_MAX = ~(Num3072::limb_t)0;
+
+static inline Num3072::limb_t ReadLimb(const unsigned char* ptr)
+{
+    return Num3072::LIMB_SIZE == 64 ? ReadLE64(ptr) : ReadLE32(ptr);
+}
+
+static inline void WriteLimb(unsigned char* ptr, Num3072::limb_t x)
+{
+    if (Num3072::LIMB_SIZE == 64) {
+        WriteLE64(ptr, x);
+    } else {
+        WriteLE32(ptr, x);
+    }
+}
+
+/** Add n to the number in limbs, return the carry out of the top limb */
+static inline Num3072::limb_t AddLimb(Num3072::limb_t* limbs, Num3072::double_limb_t n)
+{
+    for (int i = 0; i < Num3072::LIMBS && n != 0; i++) {
+        n += limbs[i];
+        limbs[i] = (Num3072::limb_t)n;
+        n >>= Num3072::LIMB_SIZE;
+    }
+    return (Num3072::limb_t)n;
+}
+
+} // namespace
+
+Num3072::Num3072()
+{
+    SetToOne();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = ReadLimb(data + i * (LIMB_SIZE / 8));
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; i++) {
+        WriteLimb(out + i * (LIMB_SIZE / 8), limbs[i]);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++) {
+        limbs[i] = 0;
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != LIMB_MAX) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // this - p = this + MAX_PRIME_DIFF - 2^3072
+    Num3072::limb_t carry = AddLimb(limbs, MAX_PRIME_DIFF);
+    assert(carry == 1);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into a 6144-bit product
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + product[i + j] + carry;
+            product[i + j] = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        product[i + LIMBS] = carry;
+    }
+
+    // high * 2^3072 + low = high * MAX_PRIME_DIFF + low (mod p)
+    limb_t carry = 0;
+    for (int j = 0; j < LIMBS; j++) {
+        double_limb_t t = (double_limb_t)product[LIMBS + j] * MAX_PRIME_DIFF + product[j] + carry;
+        limbs[j] = (limb_t)t;
+        carry = t >> LIMB_SIZE;
+    }
+    // Fold what overflowed in twice more: the second time, the number just wrapped around so it's small
+    carry = AddLimb(limbs, (double_limb_t)carry * MAX_PRIME_DIFF);
+    if (carry) {
+        carry = AddLimb(limbs, MAX_PRIME_DIFF);
+        assert(carry == 0);
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToInverse(const Num3072& a)
+{
+    // Fermat's little theorem: a^(p-2) = a^-1 (mod p). Exponentiation with 4 bit windows.
+    Num3072 powers[16];
+    for (int i = 1; i < 16; i++) {
+        powers[i] = powers[i - 1];
+        powers[i].Multiply(a);
+    }
+
+    limb_t exponent[LIMBS];
+    exponent[0] = LIMB_MAX - MAX_PRIME_DIFF - 1; // (2^LIMB_SIZE - MAX_PRIME_DIFF) - 2
+    for (int i = 1; i < LIMBS; i++) {
+        exponent[i] = LIMB_MAX;
+    }
+
+    SetToOne();
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        for (int bit = LIMB_SIZE - 4; bit >= 0; bit -= 4) {
+            for (int k = 0; k < 4; k++) {
+                Multiply(*this);
+            }
+            Multiply(powers[(exponent[i] >> bit) & 15]);
+        }
+    }
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Num3072 inverse;
+    inverse.SetToInverse(a);
+    Multiply(inverse);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(expanded, sizeof(expanded));
+    return Num3072(expanded);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+uint256 MuHash3072::Finalize() const
+{
+    Num3072 result = numerator;
+    result.Divide(denominator);
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    uint256 hash;
+    CSHA256().Write(data, sizeof(data)).Finalize(hash.begin());
+    return hash;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A 3072-bit number modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    //! The number 1
+    Num3072();
+    //! Read a little endian number of BYTE_SIZE bytes, reduced modulo the prime
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    void SetToOne();
+    //! this = this * a (mod p)
+    void Multiply(const Num3072& a);
+    //! this = this / a (mod p), a must not be a multiple of p
+    void Divide(const Num3072& a);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        for (int i = 0; i < LIMBS; i++) {
+            READWRITE(limbs[i]);
+        }
+    }
+
+private:
+    bool IsOverflow() const;
+    //! Subtract the prime, once IsOverflow()
+    void FullReduce();
+    //! this = a^(p-2) (mod p), the inverse of a
+    void SetToInverse(const Num3072& a);
+};
+
+/**
+ * A hash of a multiset of byte strings which can be updated in any order.
+ *
+ * Each element is hashed with SHA256, expanded to a 3072-bit number with ChaCha20,
+ * and multiplied into the state modulo 2^3072 - 1103717 (MuHash, Bellare and
+ * Micciancio). Removed elements are multiplied into a separate denominator, so
+ * that both adding and removing cost one multiplication, and states of disjoint
+ * sets can be combined with operator*=.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Combine with the hash of another set (union of multisets)
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Remove the elements of another set
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! The SHA256 of the 384 byte little endian numerator / denominator
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
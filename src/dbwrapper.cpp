@@ -12,6 +12,7 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -71,14 +72,96 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** LRU block cache counting its hits and misses */
+class CCountingCache : public leveldb::Cache {
+private:
+    leveldb::Cache* cache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    explicit CCountingCache(size_t nCapacity) : cache(leveldb::NewLRUCache(nCapacity)), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete cache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return cache->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = cache->Lookup(key);
+        if (handle) {
+            nHits++;
+        } else {
+            nMisses++;
+        }
+        return handle;
+    }
+    void Release(Handle* handle) override { cache->Release(handle); }
+    void* Value(Handle* handle) override { return cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { cache->Erase(key); }
+    uint64_t NewId() override { return cache->NewId(); }
+    void Prune() override { cache->Prune(); }
+    size_t TotalCharge() const override { return cache->TotalCharge(); }
+};
+
+CDBOptions::CDBOptions(size_t nCacheSize) :
+    nBlockCacheSize(nCacheSize / 2),
+    nWriteBufferSize(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+    nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES),
+    nBloomBits(10),
+    fCompression(false)
+{
+}
+
+void CDBOptions::ApplyArgs(const std::string& strName)
+{
+    for (const std::string& strArg : gArgs.GetArgs("-dboption")) {
+        size_t nColon = strArg.find(':');
+        size_t nEquals = strArg.find('=', nColon);
+        if (nColon == std::string::npos || nEquals == std::string::npos) {
+            LogPrintf("Ignoring invalid -dboption=%s\n", strArg);
+            continue;
+        }
+        if (strArg.substr(0, nColon) != strName)
+            continue;
+        const std::string strOption = strArg.substr(nColon + 1, nEquals - nColon - 1);
+        int64_t nValue;
+        if (!ParseInt64(strArg.substr(nEquals + 1), &nValue) || nValue < 0) {
+            LogPrintf("Ignoring invalid -dboption=%s\n", strArg);
+            continue;
+        }
+        if (strOption == "blockcache") {
+            nBlockCacheSize = nValue << 20;
+        } else if (strOption == "writebuffer") {
+            nWriteBufferSize = nValue << 20;
+        } else if (strOption == "maxopenfiles") {
+            nMaxOpenFiles = nValue;
+        } else if (strOption == "bloombits") {
+            nBloomBits = nValue;
+        } else if (strOption == "compression") {
+            fCompression = nValue != 0;
+        } else {
+            LogPrintf("Ignoring unknown -dboption=%s\n", strArg);
+        }
+    }
+}
+
+std::string CDBOptions::ToString() const
+{
+    return strprintf("blockcache=%.1fMiB writebuffer=%.1fMiB maxopenfiles=%d bloombits=%d compression=%d",
+        nBlockCacheSize * (1.0 / 1024 / 1024), nWriteBufferSize * (1.0 / 1024 / 1024), nMaxOpenFiles, nBloomBits, fCompression);
+}
+
+static leveldb::Options GetOptions(const CDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = new CCountingCache(dboptions.nBlockCacheSize);
+    options.write_buffer_size = dboptions.nWriteBufferSize;
+    options.filter_policy = dboptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dboptions.nBloomBits) : nullptr;
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -88,14 +171,20 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate) :
+    CDBWrapper(path, CDBOptions(nCacheSize), fMemory, fWipe, obfuscate)
+{
+}
+
+CDBWrapper::CDBWrapper(const fs::path& path, const CDBOptions& dboptionsIn, bool fMemory, bool fWipe, bool obfuscate) :
+    dboptions(dboptionsIn)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -107,7 +196,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectories(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (%s)\n", path.string(), dboptions.ToString());
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -153,6 +242,26 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+bool CDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CDBWrapper::GetBlockCacheHits() const
+{
+    return static_cast<const CCountingCache*>(options.block_cache)->nHits;
+}
+
+uint64_t CDBWrapper::GetBlockCacheMisses() const
+{
+    return static_cast<const CCountingCache*>(options.block_cache)->nMisses;
+}
+
+size_t CDBWrapper::GetBlockCacheUsage() const
+{
+    return options.block_cache->TotalCharge();
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -173,6 +173,32 @@ public:
 
 };
 
+//! LevelDB max_open_files of a database unless tuned otherwise
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+
+/** LevelDB options which can be tuned per database */
+struct CDBOptions
+{
+    //! size of the LRU cache of uncompressed table blocks
+    size_t nBlockCacheSize;
+    //! size of the memtable, up to two of them may be held in memory simultaneously
+    size_t nWriteBufferSize;
+    //! number of table files kept open, with their index and bloom filter in memory
+    int nMaxOpenFiles;
+    //! bits per key of the bloom filter, 0 for none
+    int nBloomBits;
+    //! compress table blocks with snappy
+    bool fCompression;
+
+    //! Split nCacheSize between the block cache (half) and the write buffer (a quarter)
+    explicit CDBOptions(size_t nCacheSize);
+
+    //! Apply the -dboption=<strName>:<option>=<value> arguments
+    void ApplyArgs(const std::string& strName);
+
+    std::string ToString() const;
+};
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
@@ -183,6 +209,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! the settings options was built from
+    CDBOptions dboptions;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -219,8 +248,23 @@ public:
      *                        with a zero'd byte array.
      */
     CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    /**
+     * @param[in] dboptionsIn Block cache, write buffer, open files, bloom filter and compression settings.
+     */
+    CDBWrapper(const fs::path& path, const CDBOptions& dboptionsIn, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     ~CDBWrapper();
 
+    const CDBOptions& GetDBOptions() const { return dboptions; }
+
+    //! Read a LevelDB property like "leveldb.stats", false if it isn't known
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    //! Block cache lookups which found and didn't find the block
+    uint64_t GetBlockCacheHits() const;
+    uint64_t GetBlockCacheMisses() const;
+    //! Memory used by the block cache
+    size_t GetBlockCacheUsage() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
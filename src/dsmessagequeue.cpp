@@ -0,0 +1,167 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dsmessagequeue.h>
+
+#include <net.h>
+#include <util.h>
+#include <utiltime.h>
+
+CDSMessageQueue::CDSMessageQueue() :
+    nDepth(0),
+    fRunning(false)
+{
+}
+
+CDSMessageQueue::~CDSMessageQueue()
+{
+    Interrupt();
+    Stop();
+}
+
+void CDSMessageQueue::Start(int nThreads, handler_t handlerIn)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    assert(vThreads.empty());
+
+    handler = handlerIn;
+    fRunning = true;
+    stats.nThreads = nThreads;
+    for (int i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "dsmsg", std::function<void()>(std::bind(&CDSMessageQueue::ThreadProcessMessages, this)));
+    }
+    LogPrintf("CDSMessageQueue::%s -- started %d threads\n", __func__, nThreads);
+}
+
+void CDSMessageQueue::Interrupt()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    fRunning = false;
+    cond.notify_all();
+}
+
+void CDSMessageQueue::Stop()
+{
+    for (auto& thread : vThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    vThreads.clear();
+
+    // release the references we hold on nodes of messages which were never processed
+    std::unique_lock<std::mutex> lock(cs);
+    for (auto& peerpair : mapPeerQueues) {
+        for (auto& msg : peerpair.second.queue) {
+            msg.pfrom->Release();
+        }
+    }
+    mapPeerQueues.clear();
+    listReadyPeers.clear();
+    nDepth = 0;
+    stats.nThreads = 0;
+}
+
+bool CDSMessageQueue::IsRunning()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    return fRunning;
+}
+
+bool CDSMessageQueue::IsFull(NodeId nodeid)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    if (!fRunning) return false;
+
+    auto it = mapPeerQueues.find(nodeid);
+    size_t nPeerDepth = it != mapPeerQueues.end() ? it->second.queue.size() : 0;
+    if (nPeerDepth < MAX_DSMSG_QUEUE_PER_PEER && (nPeerDepth == 0 || nDepth < MAX_DSMSG_QUEUE_TOTAL)) {
+        return false;
+    }
+    stats.nThrottled++;
+    LogPrint(BCLog::NET, "CDSMessageQueue::%s -- queue is full, throttling peer=%d, peer queue=%d, total=%d\n",
+             __func__, nodeid, nPeerDepth, nDepth);
+    return true;
+}
+
+bool CDSMessageQueue::Enqueue(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    if (!fRunning) return false;
+
+    NodeId nodeid = pfrom->GetId();
+    CPeerQueue& peerQueue = mapPeerQueues[nodeid];
+    if (peerQueue.queue.empty() && !peerQueue.fBusy) {
+        listReadyPeers.push_back(nodeid);
+    }
+    peerQueue.queue.push_back(CQueuedMessage{pfrom->AddRef(), strCommand, std::move(vRecv), nTimeReceived, GetTimeMicros()});
+    nDepth++;
+    cond.notify_one();
+    return true;
+}
+
+void CDSMessageQueue::ThreadProcessMessages()
+{
+    while (true) {
+        NodeId nodeid;
+        CNode* pfrom;
+        std::string strCommand;
+        CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+        int64_t nTimeReceived;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (fRunning && listReadyPeers.empty()) {
+                cond.wait(lock);
+            }
+            if (!fRunning) return;
+
+            // take the first message of the next peer in line, nobody else processes this peer meanwhile
+            nodeid = listReadyPeers.front();
+            listReadyPeers.pop_front();
+            CPeerQueue& peerQueue = mapPeerQueues[nodeid];
+            CQueuedMessage& msg = peerQueue.queue.front();
+            pfrom = msg.pfrom;
+            strCommand = std::move(msg.strCommand);
+            vRecv = std::move(msg.vRecv);
+            nTimeReceived = msg.nTimeReceived;
+            int64_t nWait = GetTimeMicros() - msg.nTimeQueued;
+            peerQueue.queue.pop_front();
+            peerQueue.fBusy = true;
+            nDepth--;
+            stats.nTotalWaitMicros += nWait;
+            stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nWait);
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        if (!pfrom->fDisconnect) {
+            handler(pfrom, strCommand, vRecv, nTimeReceived);
+        }
+        int64_t nTimeProcess = GetTimeMicros() - nTimeStart;
+        pfrom->Release();
+
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            stats.nProcessed++;
+            stats.nTotalProcessMicros += nTimeProcess;
+            stats.nMaxProcessMicros = std::max(stats.nMaxProcessMicros, nTimeProcess);
+
+            auto it = mapPeerQueues.find(nodeid);
+            it->second.fBusy = false;
+            if (it->second.queue.empty()) {
+                mapPeerQueues.erase(it);
+            } else {
+                // go to the back of the line, other peers are served first
+                listReadyPeers.push_back(nodeid);
+                cond.notify_one();
+            }
+        }
+    }
+}
+
+CDSMessageQueueStats CDSMessageQueue::GetStats()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    CDSMessageQueueStats statsRet = stats;
+    statsRet.nDepth = nDepth;
+    statsRet.nPeers = mapPeerQueues.size();
+    return statsRet;
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_DSMESSAGEQUEUE_H
+#define BITCOIN_DSMESSAGEQUEUE_H
+
+#include <streams.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CNode;
+typedef int64_t NodeId;
+
+/** Default number of threads handling masternode, governance and PrivateSend messages (0 = on the message handler thread) */
+static const int DEFAULT_DSMSG_THREADS = 2;
+/** Maximum number of threads handling masternode, governance and PrivateSend messages */
+static const int MAX_DSMSG_THREADS = 8;
+/** Maximum number of queued masternode-layer messages per peer */
+static const size_t MAX_DSMSG_QUEUE_PER_PEER = 1000;
+/** Maximum number of queued masternode-layer messages in total */
+static const size_t MAX_DSMSG_QUEUE_TOTAL = 20000;
+
+struct CDSMessageQueueStats
+{
+    size_t nDepth = 0;
+    size_t nPeers = 0;
+    int nThreads = 0;
+    uint64_t nProcessed = 0;
+    uint64_t nThrottled = 0;
+    int64_t nTotalWaitMicros = 0;
+    int64_t nMaxWaitMicros = 0;
+    int64_t nTotalProcessMicros = 0;
+    int64_t nMaxProcessMicros = 0;
+};
+
+/**
+ * Queue for masternode, payment, governance, PrivateSend and sync messages.
+ *
+ * Messages are handled by a small pool of worker threads so that a burst of
+ * masternode-layer traffic doesn't delay block and transaction relay on the
+ * message handler thread. Messages from the same peer are processed strictly
+ * in the order they were received, peers are served round-robin. A peer whose
+ * queue is full is throttled: its messages stay in its receive queue until the
+ * workers caught up, which eventually pauses reading from its socket.
+ */
+class CDSMessageQueue
+{
+public:
+    typedef std::function<void(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)> handler_t;
+
+private:
+    struct CQueuedMessage
+    {
+        CNode* pfrom;
+        std::string strCommand;
+        CDataStream vRecv;
+        int64_t nTimeReceived;
+        int64_t nTimeQueued;
+    };
+
+    struct CPeerQueue
+    {
+        std::deque<CQueuedMessage> queue;
+        // set while a worker is processing a message of this peer
+        bool fBusy = false;
+    };
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::map<NodeId, CPeerQueue> mapPeerQueues;
+    // peers with pending messages that no worker is processing, served round-robin
+    std::list<NodeId> listReadyPeers;
+    size_t nDepth;
+    bool fRunning;
+    handler_t handler;
+    std::vector<std::thread> vThreads;
+
+    CDSMessageQueueStats stats;
+
+    void ThreadProcessMessages();
+
+public:
+    CDSMessageQueue();
+    ~CDSMessageQueue();
+
+    /** Start nThreads workers calling handlerIn for every queued message */
+    void Start(int nThreads, handler_t handlerIn);
+    /** Wake up workers and make them exit */
+    void Interrupt();
+    /** Join workers and drop all messages which are still queued */
+    void Stop();
+
+    bool IsRunning();
+
+    /**
+     * Should processing of nodeid's messages wait for the workers? True if its own queue is full, or
+     * the total is reached while it still has messages queued. The total can be exceeded by one message
+     * per peer that has none queued, so that a few flooding peers can't hold back everyone else.
+     */
+    bool IsFull(NodeId nodeid);
+
+    /**
+     * Queue a message of pfrom received at nTimeReceived, takes ownership of vRecv's content.
+     * Returns false if the queue is not running, the message has to be processed by the caller then.
+     * Callers check IsFull() first, the limits aren't enforced here.
+     */
+    bool Enqueue(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived);
+
+    CDSMessageQueueStats GetStats();
+};
+
+#endif // BITCOIN_DSMESSAGEQUEUE_H
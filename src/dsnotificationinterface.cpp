@@ -57,3 +57,13 @@ void CDSNotificationInterface::TransactionAddedToMempool(const CTransactionRef &
 {
     CPrivateSend::TransactionAddedToMempool(tx);
 }
+
+void CDSNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted)
+{
+    CPrivateSend::BlockConnected(pblock, pindex, vtxConflicted);
+}
+
+void CDSNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock)
+{
+    CPrivateSend::BlockDisconnected(pblock);
+}
@@ -134,7 +134,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strComm
 
         uint256 nHash = govobj.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(pfrom->GetSendVersion() < MIN_GOVERNANCE_PEER_PROTO_VERSION) {
             LogPrint(BCLog::GOV, "MNGOVERNANCEOBJECT -- peer=%d using obsolete version %i\n", pfrom->GetId(), pfrom->GetSendVersion());
@@ -225,7 +225,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, const std::string& strComm
 
         uint256 nHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(pfrom->GetSendVersion() < MIN_GOVERNANCE_PEER_PROTO_VERSION) {
             LogPrint(BCLog::GOV, "MNGOVERNANCEOBJECTVOTE -- peer=%d using obsolete version %i\n", pfrom->GetId(), pfrom->GetSendVersion());
@@ -1011,6 +1011,21 @@ void CGovernanceManager::CheckPostponedObjects(CConnman* connman)
     }
 }
 
+void CGovernanceManager::MasternodeCollateralsChanged(const std::vector<COutPoint>& vecOutpoints)
+{
+    std::set<COutPoint> setChanged(vecOutpoints.begin(), vecOutpoints.end());
+
+    LOCK(cs);
+
+    // Block notifications can be undone by a reorg, so only have the objects checked again. Triggers
+    // of masternodes which really went away are deleted once the masternode is removed from the list.
+    for (auto& objpair : mapObjects) {
+        CGovernanceObject& govobj = objpair.second;
+        if (!setChanged.count(govobj.GetMasternodeOutpoint())) continue;
+        govobj.fDirtyCache = true;
+    }
+}
+
 void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nHash, CConnman* connman, bool fUseFilter)
 {
     if(!pfrom) {
@@ -1132,7 +1147,11 @@ int CGovernanceManager::RequestGovernanceObjectVotes(const std::vector<CNode*>&
             // only use up to date peers
             if(pnode->nVersion < MIN_GOVERNANCE_PEER_PROTO_VERSION) continue;
             // stop early to prevent setAskFor overflow
-            size_t nProjectedSize = pnode->setAskFor.size() + nProjectedVotes;
+            size_t nProjectedSize;
+            {
+                LOCK(pnode->cs_askFor);
+                nProjectedSize = pnode->setAskFor.size() + nProjectedVotes;
+            }
             if(nProjectedSize > SETASKFOR_MAX_SZ/2) continue;
             // to early to ask the same node
             if(mapAskedRecently[nHashGovobj].count(pnode->addr)) continue;
@@ -400,6 +400,9 @@ public:
 
     void CheckPostponedObjects(CConnman* connman);
 
+    /// Mark objects signed by masternodes whose collateral was spent or restored as dirty
+    void MasternodeCollateralsChanged(const std::vector<COutPoint>& vecOutpoints);
+
     bool AreRateChecksEnabled() const {
         LOCK(cs);
         return fRateChecksEnabled;
@@ -0,0 +1,158 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <governance.h>
+#include <masternode-collateral.h>
+#include <masternodeman.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+/** Masternode collateral watcher */
+CMasternodeCollateralWatcher collateralWatcher;
+
+CMasternodeCollateralWatcher::collateral_state_t CMasternodeCollateralWatcher::GetState(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs);
+
+    auto it = mapWatchedOutpoints.find(outpoint);
+    if (it != mapWatchedOutpoints.end()) {
+        return it->second;
+    }
+
+    // never seen this one, ask the coins view once and rely on block notifications from now on
+    AssertLockHeld(cs_main);
+    collateral_state_t state{-1, true};
+    Coin coin;
+    if (GetUTXOCoin(outpoint, coin)) {
+        state.nHeight = coin.nHeight;
+        state.fSpent = false;
+    }
+    mapWatchedOutpoints.emplace(outpoint, state);
+    LogPrint(BCLog::MNODE, "CMasternodeCollateralWatcher::%s -- watching %s, height=%d, spent=%d\n", __func__, outpoint.ToStringShort(), state.nHeight, state.fSpent);
+    return state;
+}
+
+bool CMasternodeCollateralWatcher::HaveUnspentCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    return !GetState(outpoint).fSpent;
+}
+
+int CMasternodeCollateralWatcher::GetCollateralConfirmations(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_main);
+
+    LOCK(cs);
+    collateral_state_t state = GetState(outpoint);
+    if (state.fSpent || state.nHeight < 0 || !chainActive.Tip()) return -1;
+    return chainActive.Height() - state.nHeight + 1;
+}
+
+void CMasternodeCollateralWatcher::UnwatchOutpoint(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    mapWatchedOutpoints.erase(outpoint);
+}
+
+void CMasternodeCollateralWatcher::Clear()
+{
+    LOCK(cs);
+    mapWatchedOutpoints.clear();
+}
+
+size_t CMasternodeCollateralWatcher::size() const
+{
+    LOCK(cs);
+    return mapWatchedOutpoints.size();
+}
+
+void CMasternodeCollateralWatcher::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (fLiteMode) return;
+
+    std::vector<COutPoint> vecSpent;
+    std::vector<COutPoint> vecChanged;
+
+    {
+        LOCK(cs);
+
+        if (mapWatchedOutpoints.empty()) return;
+
+        for (const auto& tx : block->vtx) {
+            // collateral could have been reorged out earlier and is mined again now
+            const uint256& txid = tx->GetHash();
+            for (unsigned int i = 0; i < tx->vout.size(); i++) {
+                auto it = mapWatchedOutpoints.find(COutPoint(txid, i));
+                if (it == mapWatchedOutpoints.end()) continue;
+                it->second.nHeight = pindex->nHeight;
+                if (it->second.fSpent) {
+                    it->second.fSpent = false;
+                    vecChanged.push_back(it->first);
+                }
+            }
+            if (tx->IsCoinBase()) continue;
+            for (const auto& txin : tx->vin) {
+                auto it = mapWatchedOutpoints.find(txin.prevout);
+                if (it == mapWatchedOutpoints.end() || it->second.fSpent) continue;
+                it->second.fSpent = true;
+                vecSpent.push_back(it->first);
+                vecChanged.push_back(it->first);
+            }
+        }
+    }
+
+    if (vecChanged.empty()) return;
+
+    LogPrint(BCLog::MNODE, "CMasternodeCollateralWatcher::%s -- block %s (height %d) spent %d watched collateral(s)\n",
+                __func__, pindex->GetBlockHash().ToString(), pindex->nHeight, vecSpent.size());
+
+    mnodeman.CheckCollaterals(vecChanged);
+    governance.MasternodeCollateralsChanged(vecChanged);
+}
+
+void CMasternodeCollateralWatcher::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (fLiteMode) return;
+
+    std::vector<COutPoint> vecChanged;
+
+    {
+        LOCK(cs);
+
+        if (mapWatchedOutpoints.empty()) return;
+
+        // undo in reverse order so that outputs spent within the same block end up as non-existent
+        for (auto itTx = block->vtx.rbegin(); itTx != block->vtx.rend(); ++itTx) {
+            const CTransactionRef& tx = *itTx;
+            if (!tx->IsCoinBase()) {
+                for (const auto& txin : tx->vin) {
+                    auto it = mapWatchedOutpoints.find(txin.prevout);
+                    if (it == mapWatchedOutpoints.end() || !it->second.fSpent) continue;
+                    it->second.fSpent = false;
+                    vecChanged.push_back(it->first);
+                }
+            }
+            // outputs created by this block don't exist anymore
+            const uint256& txid = tx->GetHash();
+            for (unsigned int i = 0; i < tx->vout.size(); i++) {
+                auto it = mapWatchedOutpoints.find(COutPoint(txid, i));
+                if (it == mapWatchedOutpoints.end()) continue;
+                it->second.nHeight = -1;
+                if (!it->second.fSpent) {
+                    it->second.fSpent = true;
+                    vecChanged.push_back(it->first);
+                }
+            }
+        }
+    }
+
+    if (vecChanged.empty()) return;
+
+    LogPrint(BCLog::MNODE, "CMasternodeCollateralWatcher::%s -- block %s disconnected, %d watched collateral(s) changed\n",
+                __func__, block->GetHash().ToString(), vecChanged.size());
+
+    mnodeman.CheckCollaterals(vecChanged);
+    governance.MasternodeCollateralsChanged(vecChanged);
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_COLLATERAL_H
+#define MASTERNODE_COLLATERAL_H
+
+#include <coins.h>
+#include <sync.h>
+#include <validationinterface.h>
+
+#include <unordered_map>
+
+class CMasternodeCollateralWatcher;
+
+extern CMasternodeCollateralWatcher collateralWatcher;
+
+//
+// CMasternodeCollateralWatcher : Track masternode collateral outpoints via connected/disconnected blocks
+//
+// The first lookup of an outpoint reads the coins view, after that its state is only updated
+// from block notifications, so masternode checks don't have to poll the UTXO set.
+//
+
+class CMasternodeCollateralWatcher : public CValidationInterface
+{
+private:
+    struct collateral_state_t
+    {
+        int nHeight;
+        bool fSpent;
+    };
+
+    // critical section to protect the inner data structures
+    mutable CCriticalSection cs;
+
+    // all collateral outpoints we are watching
+    std::unordered_map<COutPoint, collateral_state_t, SaltedOutpointHasher> mapWatchedOutpoints;
+
+    /// Find an entry, fall back to the coins view and start watching the outpoint if it's not known yet
+    collateral_state_t GetState(const COutPoint& outpoint);
+
+protected:
+    // CValidationInterface
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+public:
+    CMasternodeCollateralWatcher() = default;
+
+    /// Is the collateral still unspent? Requires cs_main for outpoints we don't watch yet.
+    bool HaveUnspentCollateral(const COutPoint& outpoint);
+    /// Number of confirmations of an unspent collateral, -1 if it's unknown or spent. Requires cs_main.
+    int GetCollateralConfirmations(const COutPoint& outpoint);
+
+    void UnwatchOutpoint(const COutPoint& outpoint);
+    void Clear();
+
+    size_t size() const;
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <init.h>
 #include <netbase.h>
 #include <masternode.h>
+#include <masternode-collateral.h>
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
@@ -65,6 +66,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb, CConnman* co
     sigTime = mnb.sigTime;
     vchSig = mnb.vchSig;
     nProtocolVersion = mnb.nProtocolVersion;
+    mnodeman.UpdateMasternodeAddr(outpoint, addr, mnb.addr);
     addr = mnb.addr;
     collDest = mnb.collDest;
     nPoSeBanScore = 0;
@@ -148,8 +150,7 @@ void CMasternode::Check(bool fForce)
 
     int nHeight = 0;
     if(!fUnitTest) {
-        Coin coin;
-        if(!GetUTXOCoin(outpoint, coin)) {
+        if(!collateralWatcher.HaveUnspentCollateral(outpoint)) {
             nActiveState = MASTERNODE_OUTPOINT_SPENT;
             LogPrint(BCLog::MNODE, "CMasternode::Check -- Failed to find Masternode UTXO, masternode=%s\n", outpoint.ToStringShort());
             return;
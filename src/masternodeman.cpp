@@ -5,6 +5,7 @@
 #include <activemasternode.h>
 #include <addrman.h>
 #include <governance.h>
+#include <masternode-collateral.h>
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
@@ -21,6 +22,8 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#include <unordered_set>
+
 /** Masternode manager */
 CMasternodeMan mnodeman;
 
@@ -45,16 +48,6 @@ struct CompareScoreMN
     }
 };
 
-struct CompareByAddr
-
-{
-    bool operator()(const CMasternode* t1,
-                    const CMasternode* t2) const
-    {
-        return t1->addr < t2->addr;
-    }
-};
-
 CMasternodeMan::CMasternodeMan():
     cs(),
     mapMasternodes(),
@@ -64,7 +57,7 @@ CMasternodeMan::CMasternodeMan():
     mWeAskedForVerification(),
     mMnbRecoveryRequests(),
     mMnbRecoveryGoodReplies(),
-    listScheduledMnbRequestConnections(),
+    mapScheduledMnbRequestConnections(),
     fMasternodesAdded(false),
     fMasternodesRemoved(false),
     vecDirtyGovernanceObjectHashes(),
@@ -82,10 +75,71 @@ bool CMasternodeMan::Add(CMasternode &mn)
 
     LogPrint(BCLog::MNODE, "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapMasternodes[mn.outpoint] = mn;
+    AddToAddrIndex(mn);
+    AddToRandomAccessIndex(mapMasternodes[mn.outpoint]);
     fMasternodesAdded = true;
     return true;
 }
 
+void CMasternodeMan::AddToAddrIndex(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    mapMasternodesByAddr.emplace(mn.addr, mn.outpoint);
+}
+
+void CMasternodeMan::RemoveFromAddrIndex(const COutPoint& outpoint, const CService& addr)
+{
+    AssertLockHeld(cs);
+    auto range = mapMasternodesByAddr.equal_range(addr);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == outpoint) {
+            mapMasternodesByAddr.erase(it);
+            return;
+        }
+    }
+}
+
+void CMasternodeMan::AddToRandomAccessIndex(CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    mapRandomAccessPos[mn.outpoint] = vecMasternodesRandomAccess.size();
+    vecMasternodesRandomAccess.push_back(&mn);
+}
+
+void CMasternodeMan::RemoveFromRandomAccessIndex(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs);
+    auto it = mapRandomAccessPos.find(outpoint);
+    if (it == mapRandomAccessPos.end()) return;
+    // move the last one into the gap
+    size_t nPos = it->second;
+    CMasternode* pmnLast = vecMasternodesRandomAccess.back();
+    vecMasternodesRandomAccess[nPos] = pmnLast;
+    mapRandomAccessPos[pmnLast->outpoint] = nPos;
+    vecMasternodesRandomAccess.pop_back();
+    mapRandomAccessPos.erase(outpoint);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    AssertLockHeld(cs);
+    mapMasternodesByAddr.clear();
+    vecMasternodesRandomAccess.clear();
+    mapRandomAccessPos.clear();
+    for (auto& mnpair : mapMasternodes) {
+        AddToAddrIndex(mnpair.second);
+        AddToRandomAccessIndex(mnpair.second);
+    }
+}
+
+void CMasternodeMan::UpdateMasternodeAddr(const COutPoint& outpoint, const CService& addrOld, const CService& addrNew)
+{
+    LOCK(cs);
+    if (addrOld == addrNew || !mapMasternodes.count(outpoint)) return;
+    RemoveFromAddrIndex(outpoint, addrOld);
+    mapMasternodesByAddr.emplace(addrNew, outpoint);
+}
+
 void CMasternodeMan::AskForMN(CNode* pnode, const COutPoint& outpoint, CConnman* connman)
 {
     if(!pnode) return;
@@ -168,12 +222,37 @@ void CMasternodeMan::Check()
     }
 }
 
+void CMasternodeMan::CheckCollaterals(const std::vector<COutPoint>& vecOutpoints)
+{
+    LOCK2(cs_main, cs);
+
+    for (const auto& outpoint : vecOutpoints) {
+        CMasternode* pmn = Find(outpoint);
+        if (!pmn) continue;
+        if (pmn->IsOutpointSpent() && collateralWatcher.HaveUnspentCollateral(outpoint)) {
+            // spending block was disconnected and the masternode wasn't removed yet, let Check() figure out its real state
+            LogPrintf("CMasternodeMan::CheckCollaterals -- Masternode %s collateral is unspent again\n", outpoint.ToStringShort());
+            pmn->nActiveState = CMasternode::MASTERNODE_PRE_ENABLED;
+        }
+        pmn->Check(true);
+        if (pmn->IsOutpointSpent()) {
+            LogPrint(BCLog::MNODE, "CMasternodeMan::CheckCollaterals -- Masternode %s collateral was spent\n", outpoint.ToStringShort());
+        }
+    }
+}
+
 void CMasternodeMan::CheckAndRemove(CConnman* connman)
 {
     if(!masternodeSync.IsMasternodeListSynced()) return;
 
     LogPrintf("CMasternodeMan::CheckAndRemove\n");
 
+    // peers we are connected to already, recovery requests are sent to them first to avoid extra connections
+    std::set<CService> setConnected;
+    connman->ForEachNode([&setConnected](CNode* pnode) {
+        if(!pnode->fDisconnect) setConnected.insert(pnode->addr);
+    });
+
     {
         // Need LOCK2 here to ensure consistent locking order because code below locks cs_main
         // in CheckMnbAndUpdateMasternodeList()
@@ -182,7 +261,9 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
         Check();
 
         // Remove spent masternodes, prepare structures and make requests to reasure the state of inactive ones
-        rank_pair_vec_t vecMasternodeRanks;
+        std::vector<CService> vecRankedAddrs;
+        // peers asked for recovery this round, shared by all masternodes so that requests can be coalesced
+        std::vector<CService> vecRecoveryPeers;
         // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES masternode entries at a time
         int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
         std::map<COutPoint, CMasternode>::iterator it = mapMasternodes.begin();
@@ -199,6 +280,9 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
 
                 // and finally remove it from the list
                 it->second.FlagGovernanceItemsAsDirty();
+                collateralWatcher.UnwatchOutpoint(it->first);
+                RemoveFromAddrIndex(it->first, it->second.addr);
+                RemoveFromRandomAccessIndex(it->first);
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
             } else {
@@ -211,19 +295,40 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
                     // this mn is in a non-recoverable state and we haven't asked other nodes yet
                     std::set<CService> setRequested;
                     // calulate only once and only when it's needed
-                    if(vecMasternodeRanks.empty()) {
+                    if(vecRankedAddrs.empty()) {
+                        rank_pair_vec_t vecMasternodeRanks;
                         int nRandomBlockHeight = GetRandInt(nCachedBlockHeight);
                         GetMasternodeRanks(vecMasternodeRanks, nRandomBlockHeight);
+                        for(const auto& rankPair : vecMasternodeRanks) {
+                            vecRankedAddrs.push_back(rankPair.second.addr);
+                        }
+                        // prefer masternodes we are connected to already, keep rank order otherwise
+                        std::stable_partition(vecRankedAddrs.begin(), vecRankedAddrs.end(), [&setConnected](const CService& addr) {
+                            return setConnected.count(addr) > 0;
+                        });
                     }
+                    // avoid banning, don't ask peers we asked for this entry recently
+                    auto itAskedEntry = mWeAskedForMasternodeListEntry.find(it->first);
+                    auto fnCanAsk = [&](const CService& addr) {
+                        return itAskedEntry == mWeAskedForMasternodeListEntry.end() || !itAskedEntry->second.count(addr);
+                    };
                     bool fAskedForMnbRecovery = false;
-                    // ask first MNB_RECOVERY_QUORUM_TOTAL masternodes we can connect to and we haven't asked recently
-                    for(int i = 0; setRequested.size() < MNB_RECOVERY_QUORUM_TOTAL && i < (int)vecMasternodeRanks.size(); i++) {
-                        // avoid banning
-                        if(mWeAskedForMasternodeListEntry.count(it->first) && mWeAskedForMasternodeListEntry[it->first].count(vecMasternodeRanks[i].second.addr)) continue;
-                        // didn't ask recently, ok to ask now
-                        CService addr = vecMasternodeRanks[i].second.addr;
+                    // reuse the peers picked for other masternodes first ...
+                    for(const auto& addr : vecRecoveryPeers) {
+                        if(setRequested.size() >= MNB_RECOVERY_QUORUM_TOTAL) break;
+                        if(fnCanAsk(addr)) setRequested.insert(addr);
+                    }
+                    // ... and pick new ones only if we don't have enough of them
+                    for(int i = 0; setRequested.size() < MNB_RECOVERY_QUORUM_TOTAL && i < (int)vecRankedAddrs.size(); i++) {
+                        const CService& addr = vecRankedAddrs[i];
+                        if(!fnCanAsk(addr) || setRequested.count(addr)) continue;
+                        if(std::find(vecRecoveryPeers.begin(), vecRecoveryPeers.end(), addr) == vecRecoveryPeers.end()) {
+                            vecRecoveryPeers.push_back(addr);
+                        }
                         setRequested.insert(addr);
-                        listScheduledMnbRequestConnections.push_back(std::make_pair(addr, hash));
+                    }
+                    for(const auto& addr : setRequested) {
+                        mapScheduledMnbRequestConnections[addr].insert(hash);
                         fAskedForMnbRecovery = true;
                     }
                     if(fAskedForMnbRecovery) {
@@ -244,12 +349,25 @@ void CMasternodeMan::CheckAndRemove(CConnman* connman)
             if(mMnbRecoveryRequests[itMnbReplies->first].first < GetTime()) {
                 // all nodes we asked should have replied now
                 if(itMnbReplies->second.size() >= MNB_RECOVERY_QUORUM_REQUIRED) {
-                    // majority of nodes we asked agrees that this mn doesn't require new mnb, reprocess one of new mnbs
-                    LogPrint(BCLog::MNODE, "CMasternodeMan::CheckAndRemove -- reprocessing mnb, masternode=%s\n", itMnbReplies->second[0].outpoint.ToStringShort());
-                    // mapSeenMasternodeBroadcast.erase(itMnbReplies->first);
-                    int nDos;
-                    itMnbReplies->second[0].fRecovery = true;
-                    CheckMnbAndUpdateMasternodeList(nullptr, itMnbReplies->second[0], nDos, connman);
+                    // majority of nodes we asked agrees that this mn doesn't require new mnb, reprocess one of new mnbs.
+                    // Most replies carry the same ping, verify each distinct one once only, newest first, until one is accepted.
+                    std::map<uint256, CMasternodeBroadcast*> mapDistinctPings;
+                    for(auto& mnbReply : itMnbReplies->second) {
+                        mapDistinctPings.emplace(mnbReply.lastPing.GetHash(), &mnbReply);
+                    }
+                    std::vector<CMasternodeBroadcast*> vecCandidates;
+                    for(const auto& pingPair : mapDistinctPings) {
+                        vecCandidates.push_back(pingPair.second);
+                    }
+                    std::sort(vecCandidates.begin(), vecCandidates.end(), [](const CMasternodeBroadcast* a, const CMasternodeBroadcast* b) {
+                        return a->lastPing.sigTime > b->lastPing.sigTime;
+                    });
+                    for(auto pmnbCandidate : vecCandidates) {
+                        LogPrint(BCLog::MNODE, "CMasternodeMan::CheckAndRemove -- reprocessing mnb, masternode=%s\n", pmnbCandidate->outpoint.ToStringShort());
+                        int nDos;
+                        pmnbCandidate->fRecovery = true;
+                        if(CheckMnbAndUpdateMasternodeList(nullptr, *pmnbCandidate, nDos, connman)) break;
+                    }
                 }
                 LogPrint(BCLog::MNODE, "CMasternodeMan::CheckAndRemove -- removing mnb recovery reply, masternode=%s, size=%d\n", itMnbReplies->second[0].outpoint.ToStringShort(), (int)itMnbReplies->second.size());
                 mMnbRecoveryGoodReplies.erase(itMnbReplies++);
@@ -356,6 +474,10 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    mapMasternodesByAddr.clear();
+    vecMasternodesRandomAccess.clear();
+    mapRandomAccessPos.clear();
+    collateralWatcher.Clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -548,7 +670,7 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool f
         if(fFilterSigTime && mnpair.second.sigTime + (nMnCount*2.6*60) > GetAdjustedTime()) continue;
 
         //make sure it has at least as many confirmations as there are masternodes
-        if(GetUTXOConfirmations(mnpair.first) < nMnCount) continue;
+        if(collateralWatcher.GetCollateralConfirmations(mnpair.first) < nMnCount) continue;
 
         vecMasternodeLastPaid.push_back(std::make_pair(mnpair.second.GetLastPaidBlock(), &mnpair.second));
     }
@@ -596,40 +718,38 @@ masternode_info_t CMasternodeMan::FindRandomNotInVec(const std::vector<COutPoint
 
     nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinMasternodePaymentsProto() : nProtocolVersion;
 
-    int nCountEnabled = CountEnabled(nProtocolVersion);
-    int nCountNotExcluded = nCountEnabled - vecToExclude.size();
-
-    LogPrintf("CMasternodeMan::FindRandomNotInVec -- %d enabled masternodes, %d masternodes to choose from\n", nCountEnabled, nCountNotExcluded);
-    if(nCountNotExcluded < 1) return masternode_info_t();
+    if(vecMasternodesRandomAccess.empty()) return masternode_info_t();
 
-    // fill a vector of pointers
-    std::vector<const CMasternode*> vpMasternodesShuffled;
-    for (const auto& mnpair : mapMasternodes) {
-        vpMasternodesShuffled.push_back(&mnpair.second);
-    }
+    std::unordered_set<COutPoint, SaltedOutpointHasher> setToExclude(vecToExclude.begin(), vecToExclude.end());
 
-    // shuffle pointers
-    std::random_shuffle(vpMasternodesShuffled.begin(), vpMasternodesShuffled.end(), GetRandInt);
-    bool fExclude;
+    auto fnIsCandidate = [&](const CMasternode* pmn) {
+        return pmn->nProtocolVersion >= nProtocolVersion && pmn->IsEnabled() && !setToExclude.count(pmn->outpoint);
+    };
 
-    // loop through
-    for (const auto& pmn : vpMasternodesShuffled) {
-        if(pmn->nProtocolVersion < nProtocolVersion || !pmn->IsEnabled()) continue;
-        fExclude = false;
-        for (const auto& outpointToExclude : vecToExclude) {
-            if(pmn->outpoint == outpointToExclude) {
-                fExclude = true;
-                break;
-            }
-        }
-        if(fExclude) continue;
-        // found the one not in vecToExclude
+    // Usually most masternodes are candidates, so a few random picks find one quickly.
+    // Every pick is uniform over the whole list, so the result is uniform over all candidates too.
+    for (int i = 0; i < FIND_RANDOM_MAX_PICKS; i++) {
+        const CMasternode* pmn = vecMasternodesRandomAccess[GetRandInt(vecMasternodesRandomAccess.size())];
+        if(!fnIsCandidate(pmn)) continue;
         LogPrint(BCLog::MNODE, "CMasternodeMan::FindRandomNotInVec -- found, masternode=%s\n", pmn->outpoint.ToStringShort());
         return pmn->GetInfo();
     }
 
-    LogPrint(BCLog::MNODE, "CMasternodeMan::FindRandomNotInVec -- failed\n");
-    return masternode_info_t();
+    // most of them are excluded or not enabled, pick from the ones left
+    std::vector<const CMasternode*> vpCandidates;
+    for (const auto& pmn : vecMasternodesRandomAccess) {
+        if(fnIsCandidate(pmn)) vpCandidates.push_back(pmn);
+    }
+
+    LogPrintf("CMasternodeMan::FindRandomNotInVec -- %d masternodes, %d masternodes to choose from\n", vecMasternodesRandomAccess.size(), vpCandidates.size());
+    if(vpCandidates.empty()) {
+        LogPrint(BCLog::MNODE, "CMasternodeMan::FindRandomNotInVec -- failed\n");
+        return masternode_info_t();
+    }
+
+    const CMasternode* pmn = vpCandidates[GetRandInt(vpCandidates.size())];
+    LogPrint(BCLog::MNODE, "CMasternodeMan::FindRandomNotInVec -- found, masternode=%s\n", pmn->outpoint.ToStringShort());
+    return pmn->GetInfo();
 }
 
 bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol)
@@ -733,61 +853,50 @@ void CMasternodeMan::ProcessMasternodeConnections(CConnman* connman)
     });
 }
 
-std::pair<CService, std::set<uint256> > CMasternodeMan::PopScheduledMnbRequestConnection()
+void CMasternodeMan::ProcessPendingMnbRequests(CConnman* connman)
 {
-    LOCK(cs);
-    if(listScheduledMnbRequestConnections.empty()) {
-        return std::make_pair(CService(), std::set<uint256>());
+    std::map<CService, std::set<uint256> > mapScheduled;
+    {
+        LOCK(cs);
+        mapScheduled.swap(mapScheduledMnbRequestConnections);
     }
 
-    std::set<uint256> setResult;
+    auto fnSendRequest = [&](CNode* pnode, const std::set<uint256>& setHashes) {
+        // compile request vector, one message for all entries we want from this peer
+        std::vector<CInv> vToFetch;
+        for(const auto& hash : setHashes) {
+            if(hash != uint256()) {
+                vToFetch.push_back(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+                LogPrint(BCLog::MNODE, "-- asking for mnb %s from addr=%s\n", hash.ToString(), pnode->addr.ToString());
+            }
+        }
 
-    listScheduledMnbRequestConnections.sort();
-    std::pair<CService, uint256> pairFront = listScheduledMnbRequestConnections.front();
+        // ask for data
+        CNetMsgMaker msgMaker(pnode->GetSendVersion());
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
+        return true;
+    };
 
-    // squash hashes from requests with the same CService as the first one into setResult
-    std::list< std::pair<CService, uint256> >::iterator it = listScheduledMnbRequestConnections.begin();
-    while(it != listScheduledMnbRequestConnections.end()) {
-        if(pairFront.first == it->first) {
-            setResult.insert(it->second);
-            it = listScheduledMnbRequestConnections.erase(it);
+    for(auto& p : mapScheduled) {
+        // reuse an existing connection if we have one
+        bool fSent = connman->ForNode(p.first, [](const CNode* pnode) { return !pnode->fDisconnect; }, [&](CNode* pnode) {
+            return fnSendRequest(pnode, p.second);
+        });
+        if(fSent) continue;
+        // no connection yet, open one and merge with requests which are waiting for it already
+        auto itPending = mapPendingMNB.find(p.first);
+        if(itPending == mapPendingMNB.end()) {
+            mapPendingMNB.emplace(p.first, std::make_pair(GetTime(), std::move(p.second)));
+            connman->AddPendingMasternode(p.first);
         } else {
-            // since list is sorted now, we can be sure that there is no more hashes left
-            // to ask for from this addr
-            break;
+            itPending->second.second.insert(p.second.begin(), p.second.end());
         }
     }
-    return std::make_pair(pairFront.first, setResult);
-}
-
-void CMasternodeMan::ProcessPendingMnbRequests(CConnman* connman)
-{
-    std::pair<CService, std::set<uint256> > p = PopScheduledMnbRequestConnection();
-    if (!(p.first == CService() || p.second.empty())) {
-        if (connman->IsMasternodeOrDisconnectRequested(p.first)) return;
-        mapPendingMNB.insert(std::make_pair(p.first, std::make_pair(GetTime(), p.second)));
-        connman->AddPendingMasternode(p.first);
-    }
 
     std::map<CService, std::pair<int64_t, std::set<uint256> > >::iterator itPendingMNB = mapPendingMNB.begin();
     while (itPendingMNB != mapPendingMNB.end()) {
         bool fDone = connman->ForNode(itPendingMNB->first, [&](CNode* pnode) {
-            // compile request vector
-            std::vector<CInv> vToFetch;
-            std::set<uint256>& setHashes = itPendingMNB->second.second;
-            std::set<uint256>::iterator it = setHashes.begin();
-            while(it != setHashes.end()) {
-                if(*it != uint256()) {
-                    vToFetch.push_back(CInv(MSG_MASTERNODE_ANNOUNCE, *it));
-                    LogPrint(BCLog::MNODE, "-- asking for mnb %s from addr=%s\n", it->ToString(), pnode->addr.ToString());
-                }
-                ++it;
-            }
-
-            // ask for data
-            CNetMsgMaker msgMaker(pnode->GetSendVersion());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
-            return true;
+            return fnSendRequest(pnode, itPendingMNB->second.second);
         });
 
         int64_t nTimeAdded = itPendingMNB->second.first;
@@ -812,7 +921,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        pfrom->setAskFor.erase(mnb.GetHash());
+        pfrom->RemoveAskFor(mnb.GetHash());
 
         if(!masternodeSync.IsBlockchainSynced()) return;
 
@@ -840,7 +949,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
 
         uint256 nHash = mnp.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(!masternodeSync.IsBlockchainSynced()) return;
 
@@ -904,7 +1013,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
         CMasternodeVerification mnv;
         vRecv >> mnv;
 
-        pfrom->setAskFor.erase(mnv.GetHash());
+        pfrom->RemoveAskFor(mnv.GetHash());
 
         if(!masternodeSync.IsMasternodeListSynced()) return;
 
@@ -1033,13 +1142,6 @@ void CMasternodeMan::DoFullVerificationStep(CConnman* connman)
     int nOffset = MAX_POSE_RANK + nMyRank - 1;
     if(nOffset >= (int)vecMasternodeRanks.size()) return;
 
-    std::vector<const CMasternode*> vSortedByAddr;
-    for (const auto& mnpair : mapMasternodes) {
-        vSortedByAddr.push_back(&mnpair.second);
-    }
-
-    std::sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
     it = vecMasternodeRanks.begin() + nOffset;
     while(it != vecMasternodeRanks.end()) {
         if(it->second.IsPoSeVerified() || it->second.IsPoSeBanned()) {
@@ -1055,7 +1157,7 @@ void CMasternodeMan::DoFullVerificationStep(CConnman* connman)
         }
         LogPrint(BCLog::MNODE, "CMasternodeMan::DoFullVerificationStep -- Verifying masternode %s rank %d/%d address %s\n",
                     it->second.outpoint.ToStringShort(), it->first, nRanksTotal, it->second.addr.ToString());
-        if(SendVerifyRequest(CAddress(it->second.addr, NODE_NETWORK), vSortedByAddr, connman)) {
+        if(SendVerifyRequest(CAddress(it->second.addr, NODE_NETWORK), connman)) {
             nCount++;
             if(nCount >= MAX_POSE_CONNECTIONS) break;
         }
@@ -1077,7 +1179,6 @@ void CMasternodeMan::CheckSameAddr()
     if(!masternodeSync.IsSynced() || mapMasternodes.empty()) return;
 
     std::vector<CMasternode*> vBan;
-    std::vector<CMasternode*> vSortedByAddr;
 
     {
         LOCK(cs);
@@ -1085,13 +1186,9 @@ void CMasternodeMan::CheckSameAddr()
         CMasternode* pprevMasternode = nullptr;
         CMasternode* pverifiedMasternode = nullptr;
 
-        for (auto& mnpair : mapMasternodes) {
-            vSortedByAddr.push_back(&mnpair.second);
-        }
-
-        std::sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
-        for (const auto& pmn : vSortedByAddr) {
+        for (const auto& addrpair : mapMasternodesByAddr) {
+            CMasternode* pmn = Find(addrpair.second);
+            if(!pmn) continue;
             // check only (pre)enabled masternodes
             if(!pmn->IsEnabled() && !pmn->IsPreEnabled()) continue;
             // initial step
@@ -1125,7 +1222,7 @@ void CMasternodeMan::CheckSameAddr()
     }
 }
 
-bool CMasternodeMan::SendVerifyRequest(const CAddress& addr, const std::vector<const CMasternode*>& vSortedByAddr, CConnman* connman)
+bool CMasternodeMan::SendVerifyRequest(const CAddress& addr, CConnman* connman)
 {
     if(netfulfilledman.HasFulfilledRequest(addr, strprintf("%s", NetMsgType::MNVERIFY)+"-request")) {
         // we already asked for verification, not a good idea to do this too often, skip it
@@ -1269,46 +1366,48 @@ void CMasternodeMan::ProcessVerifyReply(CNode* pnode, CMasternodeVerification& m
         uint256 hash1 = mnv.GetSignatureHash1(blockHash);
         std::string strMessage1 = strprintf("%s%d%s", pnode->addr.ToString(), mnv.nonce, blockHash.ToString());
 
-        for (auto& mnpair : mapMasternodes) {
-            if(CAddress(mnpair.second.addr, NODE_NETWORK) == pnode->addr) {
-                bool fFound = false;
-                fFound = CHashSigner::VerifyHash(hash1, mnpair.second.pubKeyMasternode, mnv.vchSig1, strError);
-                if (fFound) {
-                    // found it!
-                    prealMasternode = &mnpair.second;
-                    if(!mnpair.second.IsPoSeVerified()) {
-                        mnpair.second.DecreasePoSeBanScore();
-                    }
-                    netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-done");
-
-                    // we can only broadcast it if we are an activated masternode
-                    if(activeMasternode.outpoint.IsNull()) continue;
-                    // update ...
-                    mnv.addr = mnpair.second.addr;
-                    mnv.masternodeOutpoint1 = mnpair.second.outpoint;
-                    mnv.masternodeOutpoint2 = activeMasternode.outpoint;
-                    // ... and sign it
-                    std::string strError;
-
-                    uint256 hash2 = mnv.GetSignatureHash2(blockHash);
-
-                    if(!CHashSigner::SignHash(hash2, activeMasternode.keyMasternode, mnv.vchSig2)) {
-                        LogPrintf("MasternodeMan::ProcessVerifyReply -- SignHash() failed\n");
-                        return;
-                    }
+        auto range = mapMasternodesByAddr.equal_range(pnode->addr);
+        for (auto itAddr = range.first; itAddr != range.second; ++itAddr) {
+            auto itMn = mapMasternodes.find(itAddr->second);
+            if(itMn == mapMasternodes.end()) continue;
+            auto& mnpair = *itMn;
+            bool fFound = false;
+            fFound = CHashSigner::VerifyHash(hash1, mnpair.second.pubKeyMasternode, mnv.vchSig1, strError);
+            if (fFound) {
+                // found it!
+                prealMasternode = &mnpair.second;
+                if(!mnpair.second.IsPoSeVerified()) {
+                    mnpair.second.DecreasePoSeBanScore();
+                }
+                netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-done");
+
+                // we can only broadcast it if we are an activated masternode
+                if(activeMasternode.outpoint.IsNull()) continue;
+                // update ...
+                mnv.addr = mnpair.second.addr;
+                mnv.masternodeOutpoint1 = mnpair.second.outpoint;
+                mnv.masternodeOutpoint2 = activeMasternode.outpoint;
+                // ... and sign it
+                std::string strError;
+
+                uint256 hash2 = mnv.GetSignatureHash2(blockHash);
+
+                if(!CHashSigner::SignHash(hash2, activeMasternode.keyMasternode, mnv.vchSig2)) {
+                    LogPrintf("MasternodeMan::ProcessVerifyReply -- SignHash() failed\n");
+                    return;
+                }
 
-                    if(!CHashSigner::VerifyHash(hash2, activeMasternode.pubKeyMasternode, mnv.vchSig2, strError)) {
-                        LogPrintf("MasternodeMan::ProcessVerifyReply -- VerifyHash() failed, error: %s\n", strError);
-                        return;
-                    }
+                if(!CHashSigner::VerifyHash(hash2, activeMasternode.pubKeyMasternode, mnv.vchSig2, strError)) {
+                    LogPrintf("MasternodeMan::ProcessVerifyReply -- VerifyHash() failed, error: %s\n", strError);
+                    return;
+                }
 
-                    mWeAskedForVerification[pnode->addr] = mnv;
-                    mapSeenMasternodeVerification.insert(std::make_pair(mnv.GetHash(), mnv));
-                    mnv.Relay();
+                mWeAskedForVerification[pnode->addr] = mnv;
+                mapSeenMasternodeVerification.insert(std::make_pair(mnv.GetHash(), mnv));
+                mnv.Relay();
 
-                } else {
-                    vpMasternodesToBan.push_back(&mnpair.second);
-                }
+            } else {
+                vpMasternodesToBan.push_back(&mnpair.second);
             }
         }
         // no real masternode found?...
@@ -1425,8 +1524,12 @@ void CMasternodeMan::ProcessVerifyBroadcast(CNode* pnode, const CMasternodeVerif
 
         // increase ban score for everyone else with the same addr
         int nCount = 0;
-        for (auto& mnpair : mapMasternodes) {
-            if(mnpair.second.addr != mnv.addr || mnpair.first == mnv.masternodeOutpoint1) continue;
+        auto range = mapMasternodesByAddr.equal_range(mnv.addr);
+        for (auto itAddr = range.first; itAddr != range.second; ++itAddr) {
+            if(itAddr->second == mnv.masternodeOutpoint1) continue;
+            auto itMn = mapMasternodes.find(itAddr->second);
+            if(itMn == mapMasternodes.end()) continue;
+            auto& mnpair = *itMn;
             mnpair.second.IncreasePoSeBanScore();
             nCount++;
             LogPrint(BCLog::MNODE, "CMasternodeMan::ProcessVerifyBroadcast -- increased PoSe ban score for %s addr %s, new score %d\n",
@@ -1479,6 +1582,17 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
                     mMnbRecoveryRequests[hash].second.erase(pfrom->addr);
                     // does it have newer lastPing?
                     if(mnb.lastPing.sigTime > mapSeenMasternodeBroadcast[hash].second.lastPing.sigTime) {
+                        // another peer sent us the very same ping already and we judged it good, no need to check it again
+                        auto itGoodReplies = mMnbRecoveryGoodReplies.find(hash);
+                        if(itGoodReplies != mMnbRecoveryGoodReplies.end()) {
+                            uint256 nPingHash = mnb.lastPing.GetHash();
+                            for(const auto& mnbGood : itGoodReplies->second) {
+                                if(mnbGood.lastPing.GetHash() != nPingHash) continue;
+                                LogPrint(BCLog::MNODE, "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- masternode=%s seen good, same ping\n", mnb.outpoint.ToStringShort());
+                                itGoodReplies->second.push_back(mnb);
+                                return true;
+                            }
+                        }
                         // simulate Check
                         CMasternode mnTemp = CMasternode(mnb);
                         mnTemp.Check();
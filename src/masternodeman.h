@@ -6,9 +6,12 @@
 #ifndef MASTERNODEMAN_H
 #define MASTERNODEMAN_H
 
+#include <coins.h>
 #include <masternode.h>
 #include <sync.h>
 
+#include <unordered_map>
+
 class CMasternodeMan;
 class CConnman;
 
@@ -34,9 +37,13 @@ private:
     static const int MAX_POSE_RANK              = 10;
     static const int MAX_POSE_BLOCKS            = 10;
 
+    // random picks in FindRandomNotInVec before falling back to collecting all candidates
+    static const int FIND_RANDOM_MAX_PICKS          = 32;
+
     static const int MNB_RECOVERY_QUORUM_TOTAL      = 10;
     static const int MNB_RECOVERY_QUORUM_REQUIRED   = 6;
-    static const int MNB_RECOVERY_MAX_ASK_ENTRIES   = 10;
+    // requests are coalesced per peer, so asking for more entries doesn't cost more connections
+    static const int MNB_RECOVERY_MAX_ASK_ENTRIES   = 200;
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
@@ -49,6 +56,11 @@ private:
 
     // map to hold all MNs
     std::map<COutPoint, CMasternode> mapMasternodes;
+    // all MNs ordered by address, kept in sync with mapMasternodes
+    std::multimap<CService, COutPoint> mapMasternodesByAddr;
+    // all MNs in no particular order for uniform random sampling, and each one's position in it
+    std::vector<CMasternode*> vecMasternodesRandomAccess;
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapRandomAccessPos;
     // who's asked for the Masternode list and the last time
     std::map<CService, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -62,7 +74,8 @@ private:
     // these maps are used for masternode recovery from MASTERNODE_NEW_START_REQUIRED state
     std::map<uint256, std::pair< int64_t, std::set<CService> > > mMnbRecoveryRequests;
     std::map<uint256, std::vector<CMasternodeBroadcast> > mMnbRecoveryGoodReplies;
-    std::list< std::pair<CService, uint256> > listScheduledMnbRequestConnections;
+    // mnb hashes to ask for, coalesced per peer so that each peer gets one request only
+    std::map<CService, std::set<uint256> > mapScheduledMnbRequestConnections;
     std::map<CService, std::pair<int64_t, std::set<uint256> > > mapPendingMNB;
     std::map<CService, std::pair<int64_t, CMasternodeVerification> > mapPendingMNV;
     CCriticalSection cs_mapPendingMNV;
@@ -81,6 +94,12 @@ private:
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
+    void AddToAddrIndex(const CMasternode& mn);
+    void RemoveFromAddrIndex(const COutPoint& outpoint, const CService& addr);
+    void AddToRandomAccessIndex(CMasternode& mn);
+    void RemoveFromRandomAccessIndex(const COutPoint& outpoint);
+    void RebuildIndexes();
+
     bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
 
     void SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman* connman);
@@ -114,6 +133,9 @@ public:
         }
 
         READWRITE(mapMasternodes);
+        if(ser_action.ForRead()) {
+            RebuildIndexes();
+        }
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -144,6 +166,8 @@ public:
 
     /// Check all Masternodes
     void Check();
+    /// Re-check Masternodes whose collateral was spent or restored by a block
+    void CheckCollaterals(const std::vector<COutPoint>& vecOutpoints);
 
     /// Check all Masternodes and remove inactive
     void CheckAndRemove(CConnman* connman);
@@ -153,6 +177,9 @@ public:
     /// Clear Masternode vector
     void Clear();
 
+    /// Keep the address index up to date when a masternode announces a new address
+    void UpdateMasternodeAddr(const COutPoint& outpoint, const CService& addrOld, const CService& addrNew);
+
     /// Count Masternodes filtered by nProtocolVersion.
     /// Masternode nProtocolVersion should match or be above the one specified in param here.
     int CountMasternodes(int nProtocolVersion = -1);
@@ -188,14 +215,13 @@ public:
     bool GetMasternodeRank(const COutPoint &outpoint, int& nRankRet, int nBlockHeight = -1, int nMinProtocol = 0);
 
     void ProcessMasternodeConnections(CConnman* connman);
-    std::pair<CService, std::set<uint256> > PopScheduledMnbRequestConnection();
     void ProcessPendingMnbRequests(CConnman* connman);
 
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman* connman);
 
     void DoFullVerificationStep(CConnman* connman);
     void CheckSameAddr();
-    bool SendVerifyRequest(const CAddress& addr, const std::vector<const CMasternode*>& vSortedByAddr, CConnman* connman);
+    bool SendVerifyRequest(const CAddress& addr, CConnman* connman);
     void ProcessPendingMnvRequests(CConnman* connman);
     void SendVerifyReply(CNode* pnode, CMasternodeVerification& mnv, CConnman* connman);
     void ProcessVerifyReply(CNode* pnode, CMasternodeVerification& mnv);
@@ -33,6 +33,15 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_POLL
+#include <poll.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -48,6 +57,12 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for socket events, also the frequency of inactivity checks
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+
+// Maximum number of buffers handed to a single sendmsg() call, well below IOV_MAX everywhere
+static const size_t MAX_SEND_IOVECS = 64;
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -91,6 +106,7 @@ std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfLimited[NET_MAX] = {};
 std::string strSubVersion;
 
+CCriticalSection cs_mapAlreadyAskedFor;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 void CConnman::AddOneShot(const std::string& strDest)
@@ -454,6 +470,11 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         CloseSocket(hSocket);
         return nullptr;
     }
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
+        LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
+        CloseSocket(hSocket);
+        return nullptr;
+    }
 
     // Add node
     NodeId id = GetNewNodeId();
@@ -716,6 +737,10 @@ void CNode::copyStats(CNodeStats &stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_vProcessMsg);
+        X(mapProcessMicrosPerMsgCmd);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -792,6 +817,16 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::RecordProcessTime(const std::string& strCommand, int64_t nMicros)
+{
+    LOCK(cs_vProcessMsg);
+    mapMsgCmdSize::iterator i = mapProcessMicrosPerMsgCmd.find(strCommand);
+    if (i == mapProcessMicrosPerMsgCmd.end())
+        i = mapProcessMicrosPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapProcessMicrosPerMsgCmd.end());
+    i->second += std::max<int64_t>(nMicros, 0);
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -884,26 +919,60 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
         int nBytes = 0;
+#ifndef WIN32
+        // Hand as many queued buffers as possible to the kernel in one call, the payloads
+        // are sent right from where they are, shared ones included.
+        struct iovec iov[MAX_SEND_IOVECS];
+        size_t nIov = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itIov) {
+            const auto &data = **itIov;
+            assert(data.size() > nOffset);
+            iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+            iov[nIov].iov_len = data.size() - nOffset;
+            nIov++;
+            nOffset = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                break;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+#else
+        const auto &data = **it;
+        assert(data.size() > pnode->nSendOffset);
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
             nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         }
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // advance over the buffers which were sent completely
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                size_t nLeftInBuffer = (*it)->size() - pnode->nSendOffset;
+                if (nRemaining < nLeftInBuffer) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeftInBuffer;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if (pnode->nSendOffset != 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1103,7 +1172,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1155,6 +1224,387 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+#ifdef USE_EPOLL
+    if (wakeupEventFd >= 0) {
+        recv_set.insert(wakeupEventFd);
+    }
+#endif
+
+    return !recv_set.empty() || !send_set.empty() || !error_set.empty();
+}
+
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // From now on a node which gets new data to send has to wake us up, see WakeSelect()
+    wakeupSelectNeeded = true;
+    switch (socketEventsMode) {
+#ifdef USE_EPOLL
+        case SOCKETEVENTS_EPOLL:
+            SocketEventsEpoll(recv_set, send_set, error_set);
+            break;
+#endif
+#ifdef USE_POLL
+        case SOCKETEVENTS_POLL:
+            SocketEventsPoll(recv_set, send_set, error_set);
+            break;
+#endif
+        default:
+            SocketEventsSelect(recv_set, send_set, error_set);
+            break;
+    }
+    wakeupSelectNeeded = false;
+
+#ifdef USE_EPOLL
+    if (wakeupEventFd >= 0 && recv_set.count(wakeupEventFd)) {
+        // drain the eventfd, it's non-blocking so this never hangs
+        uint64_t nWakeups;
+        if (read(wakeupEventFd, &nWakeups, sizeof(nWakeups)) != sizeof(nWakeups)) {
+            LogPrint(BCLog::NET, "CConnman::%s -- reading wakeup eventfd failed\n", __func__);
+        }
+        recv_set.erase(wakeupEventFd);
+    }
+#endif
+}
+
+void CConnman::SocketEventsSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+        // try to receive on every socket, failing ones get disconnected
+        recv_set.insert(recv_select_set.begin(), recv_select_set.end());
+        recv_set.insert(send_select_set.begin(), send_select_set.end());
+        recv_set.insert(error_select_set.begin(), error_select_set.end());
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv)) recv_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend)) send_set.insert(hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        if (FD_ISSET(hSocket, &fdsetError)) error_set.insert(hSocket);
+    }
+}
+
+#ifdef USE_POLL
+void CConnman::SocketEventsPoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    // every socket we care about is in at least one set, error_select_set holds all node sockets
+    std::map<SOCKET, short> mapEvents;
+    for (SOCKET hSocket : recv_select_set) mapEvents[hSocket] |= POLLIN;
+    for (SOCKET hSocket : send_select_set) mapEvents[hSocket] |= POLLOUT;
+    for (SOCKET hSocket : error_select_set) mapEvents[hSocket] |= 0;
+
+    std::vector<struct pollfd> vpollfd;
+    vpollfd.reserve(mapEvents.size());
+    for (const auto& pair : mapEvents) {
+        struct pollfd pfd;
+        pfd.fd = pair.first;
+        pfd.events = pair.second;
+        pfd.revents = 0;
+        vpollfd.push_back(pfd);
+    }
+
+    if (poll(vpollfd.data(), vpollfd.size(), SELECT_TIMEOUT_MILLISECONDS) < 0) {
+        if (interruptNet)
+            return;
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket poll error %s\n", NetworkErrorString(nErr));
+        }
+        return;
+    }
+    if (interruptNet)
+        return;
+
+    for (const struct pollfd& pfd : vpollfd) {
+        if (pfd.revents & POLLIN) recv_set.insert(pfd.fd);
+        if (pfd.revents & POLLOUT) send_set.insert(pfd.fd);
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) error_set.insert(pfd.fd);
+    }
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // Listen sockets and the wakeup eventfd are registered once in InitSocketEvents(). Node sockets stay
+    // registered between iterations and are only touched when the events we are interested in change,
+    // so in the common case no syscall besides epoll_wait() is needed. The registration is level-triggered
+    // as we read at most one buffer per node per iteration and may pause receiving.
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // same logic as in GenerateSelectSet()
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+            uint32_t nEvents = select_send ? EPOLLOUT : (select_recv ? EPOLLIN : 0);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            // A closed socket is removed from the epoll set by the kernel, a socket with a reused
+            // descriptor number never matches hSocketEpoll of its new node.
+            bool fRegistered = pnode->hSocketEpoll == pnode->hSocket;
+            if (fRegistered && nEvents == pnode->nEpollEvents)
+                continue;
+
+            if (nEvents == 0) {
+                // Don't keep a socket without any interest registered, hangups would be reported forever
+                if (epoll_ctl(epollfd, EPOLL_CTL_DEL, pnode->hSocket, nullptr) != 0 && errno != ENOENT) {
+                    LogPrint(BCLog::NET, "CConnman::%s -- epoll_ctl(DEL) failed for peer=%d: %s\n", __func__, pnode->GetId(), NetworkErrorString(errno));
+                }
+                pnode->hSocketEpoll = INVALID_SOCKET;
+                pnode->nEpollEvents = 0;
+                continue;
+            }
+
+            struct epoll_event event;
+            event.events = nEvents;
+            event.data.fd = pnode->hSocket;
+            int op = fRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            int r = epoll_ctl(epollfd, op, pnode->hSocket, &event);
+            if (r != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+                r = epoll_ctl(epollfd, EPOLL_CTL_MOD, pnode->hSocket, &event);
+            }
+            if (r != 0) {
+                LogPrint(BCLog::NET, "CConnman::%s -- epoll_ctl failed for peer=%d: %s\n", __func__, pnode->GetId(), NetworkErrorString(errno));
+                pnode->hSocketEpoll = INVALID_SOCKET;
+                pnode->nEpollEvents = 0;
+                continue;
+            }
+            pnode->hSocketEpoll = pnode->hSocket;
+            pnode->nEpollEvents = nEvents;
+        }
+    }
+
+    const size_t MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    int nEvents = epoll_wait(epollfd, events, MAX_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET hSocket = events[i].data.fd;
+        if (events[i].events & EPOLLIN) recv_set.insert(hSocket);
+        if (events[i].events & EPOLLOUT) send_set.insert(hSocket);
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) error_set.insert(hSocket);
+    }
+}
+#endif
+
+bool CConnman::InitSocketEvents()
+{
+#ifdef USE_EPOLL
+    wakeupEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupEventFd < 0) {
+        LogPrintf("CConnman::%s -- eventfd() failed: %s\n", __func__, NetworkErrorString(errno));
+    }
+
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd < 0) {
+            LogPrintf("CConnman::%s -- epoll_create1() failed: %s, falling back to poll\n", __func__, NetworkErrorString(errno));
+            socketEventsMode = SOCKETEVENTS_POLL;
+        } else {
+            std::vector<SOCKET> vSockets;
+            for (const ListenSocket& hListenSocket : vhListenSocket) {
+                vSockets.push_back(hListenSocket.socket);
+            }
+            if (wakeupEventFd >= 0) {
+                vSockets.push_back(wakeupEventFd);
+            }
+            for (SOCKET hSocket : vSockets) {
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.fd = hSocket;
+                if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hSocket, &event) != 0) {
+                    LogPrintf("CConnman::%s -- epoll_ctl() failed: %s\n", __func__, NetworkErrorString(errno));
+                    CloseSocketEvents();
+                    return false;
+                }
+            }
+        }
+    }
+#endif
+    LogPrintf("CConnman::%s -- using %s for socket events\n", __func__, GetSocketEventsModeString(socketEventsMode));
+    return true;
+}
+
+void CConnman::CloseSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (epollfd >= 0) {
+        close(epollfd);
+        epollfd = -1;
+    }
+    if (wakeupEventFd >= 0) {
+        close(wakeupEventFd);
+        wakeupEventFd = -1;
+    }
+#endif
+}
+
+void CConnman::WakeSelect()
+{
+#ifdef USE_EPOLL
+    if (wakeupEventFd < 0 || !wakeupSelectNeeded) {
+        return;
+    }
+    uint64_t nOne = 1;
+    if (write(wakeupEventFd, &nOne, sizeof(nOne)) != sizeof(nOne)) {
+        LogPrint(BCLog::NET, "CConnman::%s -- writing to wakeup eventfd failed\n", __func__);
+    }
+#endif
+}
+
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet)
+{
+    if (strMode == "select") {
+        modeRet = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_POLL
+    if (strMode == "poll") {
+        modeRet = SOCKETEVENTS_POLL;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        modeRet = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeString(SocketEventsMode mode)
+{
+    switch (mode) {
+        case SOCKETEVENTS_SELECT: return "select";
+        case SOCKETEVENTS_POLL: return "poll";
+        case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#ifdef USE_POLL
+    strModes += ", poll";
+#endif
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+    return strModes;
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1224,91 +1674,18 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(recv_set, send_set, error_set);
 
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0)
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1339,9 +1716,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet)
             {
@@ -1451,6 +1828,36 @@ void CConnman::ThreadSocketHandler()
     }
 }
 
+bool CConnman::EnqueueDSMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    return dsMessageQueue.Enqueue(pfrom, strCommand, vRecv, nTimeReceived);
+}
+
+bool CConnman::IsDSMessageQueueFull(NodeId id)
+{
+    return dsMessageQueue.IsFull(id);
+}
+
+CDSMessageQueueStats CConnman::GetDSMessageQueueStats()
+{
+    return dsMessageQueue.GetStats();
+}
+
+void CConnman::RecordMessageStats(const std::string& strCommand, uint64_t nBytes, int64_t nQueueMicros, int64_t nHandlerMicros, int64_t nLockWaitMicros)
+{
+    netMsgStats.Record(strCommand, nBytes, nQueueMicros, nHandlerMicros, nLockWaitMicros);
+}
+
+std::map<std::string, CNetMsgCmdStats> CConnman::GetMessageStats() const
+{
+    return netMsgStats.GetStats();
+}
+
+void CConnman::ResetMessageStats()
+{
+    netMsgStats.Reset();
+}
+
 void CConnman::WakeMessageHandler()
 {
     {
@@ -1663,8 +2070,8 @@ void CConnman::DumpAddresses()
     CAddrDB adb;
     adb.Write(addrman);
 
-    LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms\n",
-           addrman.size(), GetTimeMillis() - nStart);
+    LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms, addrman uses %d kB\n",
+           addrman.size(), GetTimeMillis() - nStart, addrman.DynamicMemoryUsage() / 1024);
 }
 
 void CConnman::DumpData()
@@ -2041,6 +2448,20 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
+bool CConnman::ProcessNodeMessages(CNode* pnode)
+{
+    // Receive messages
+    bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
+    if (flagInterruptMsgProc)
+        return false;
+    // Send messages
+    {
+        LOCK(pnode->cs_sendProcessing);
+        m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
+    }
+    return fMoreNodeWork && !pnode->fPauseSend;
+}
+
 void CConnman::ThreadMessageHandler()
 {
     while (!flagInterruptMsgProc)
@@ -2061,16 +2482,7 @@ void CConnman::ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
-            // Send messages
-            {
-                LOCK(pnode->cs_sendProcessing);
-                m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
-            }
+            fMoreWork |= ProcessNodeMessages(pnode);
 
             if (flagInterruptMsgProc)
                 return;
@@ -2090,6 +2502,76 @@ void CConnman::ThreadMessageHandler()
     }
 }
 
+void CConnman::ThreadMessageHandlerScheduler()
+{
+    while (!flagInterruptMsgProc)
+    {
+        std::vector<CNode*> vNodesCopy;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            for (CNode* pnode : vNodesCopy) {
+                pnode->AddRef();
+            }
+        }
+
+        // Queue every node which isn't queued or being processed already. A node stuck in a slow
+        // handler is simply skipped, the others go on with the next free worker.
+        std::unique_lock<std::mutex> lock(mutexMsgProc);
+        bool fQueued = false;
+        for (CNode* pnode : vNodesCopy)
+        {
+            if (pnode->fDisconnect || pnode->fMsgProcScheduled)
+                continue;
+            pnode->fMsgProcScheduled = true;
+            dequeMsgProcNodes.push_back(pnode->AddRef());
+            fQueued = true;
+        }
+        if (fQueued) {
+            condMsgProcWorkers.notify_all();
+        }
+
+        for (CNode* pnode : vNodesCopy)
+            pnode->Release();
+
+        condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake || flagInterruptMsgProc; });
+        fMsgProcWake = false;
+    }
+}
+
+void CConnman::ThreadMessageHandlerWorker()
+{
+    while (true)
+    {
+        CNode* pnode;
+        {
+            std::unique_lock<std::mutex> lock(mutexMsgProc);
+            condMsgProcWorkers.wait(lock, [this] { return flagInterruptMsgProc || !dequeMsgProcNodes.empty(); });
+            if (flagInterruptMsgProc)
+                return;
+            pnode = dequeMsgProcNodes.front();
+            dequeMsgProcNodes.pop_front();
+        }
+
+        bool fMoreWork = false;
+        if (!pnode->fDisconnect) {
+            fMoreWork = ProcessNodeMessages(pnode);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutexMsgProc);
+            if (fMoreWork && !flagInterruptMsgProc && !pnode->fDisconnect) {
+                // back of the line, keeps the reference
+                dequeMsgProcNodes.push_back(pnode);
+                condMsgProcWorkers.notify_one();
+                continue;
+            }
+            pnode->fMsgProcScheduled = false;
+        }
+        pnode->Release();
+    }
+}
+
 
 
 
@@ -2117,6 +2599,13 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, b
         LogPrintf("%s\n", strError);
         return false;
     }
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hListenSocket))
+    {
+        strError = "Error: Couldn't open socket for incoming connections (non-selectable socket created, fd >= FD_SETSIZE ?)";
+        LogPrintf("%s\n", strError);
+        CloseSocket(hListenSocket);
+        return false;
+    }
 #ifndef WIN32
     // Allow binding if the port is still in TIME_WAIT state after
     // the program was closed and restarted.
@@ -2243,7 +2732,9 @@ void CConnman::SetNetworkActive(bool active)
     uiInterface.NotifyNetworkActiveChanged(fNetworkActive);
 }
 
-CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSeed1(nSeed1In)
+CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) :
+    nSeed0(nSeed0In), nSeed1(nSeed1In),
+    netMsgStats(getAllNetMessageTypes(), NET_MESSAGE_COMMAND_OTHER)
 {
     fNetworkActive = true;
     setBannedIsDirty = false;
@@ -2318,6 +2809,15 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+    if (!InitSocketEvents()) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                _("Failed to initialize socket event handling."),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2415,7 +2915,22 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    if (nMessageHandlerThreads > 1) {
+        threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandlerScheduler, this)));
+        for (int i = 0; i < nMessageHandlerThreads; i++) {
+            vThreadMessageHandlerWorkers.emplace_back(&TraceThread<std::function<void()> >, "msgwork", std::function<void()>(std::bind(&CConnman::ThreadMessageHandlerWorker, this)));
+        }
+        LogPrintf("CConnman::%s -- using %d message handler threads\n", __func__, nMessageHandlerThreads);
+    } else {
+        threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    }
+
+    // Process masternode-layer messages
+    if (connOptions.nDSMessageThreads > 0) {
+        dsMessageQueue.Start(connOptions.nDSMessageThreads, [this](CNode* pnode, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived) {
+            m_msgproc->ProcessDSMessage(pnode, strCommand, vRecv, nTimeReceived);
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2446,8 +2961,11 @@ void CConnman::Interrupt()
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    condMsgProcWorkers.notify_all();
+    dsMessageQueue.Interrupt();
 
     interruptNet();
+    WakeSelect();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2473,6 +2991,21 @@ void CConnman::Stop()
 {
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    for (auto& thread : vThreadMessageHandlerWorkers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    vThreadMessageHandlerWorkers.clear();
+    {
+        // release the references of nodes no worker picked up anymore
+        std::unique_lock<std::mutex> lock(mutexMsgProc);
+        for (CNode* pnode : dequeMsgProcNodes) {
+            pnode->fMsgProcScheduled = false;
+            pnode->Release();
+        }
+        dequeMsgProcNodes.clear();
+    }
+    dsMessageQueue.Stop();
     if (threadOpenMasternodeConnections.joinable())
         threadOpenMasternodeConnections.join();
     if (threadOpenConnections.joinable())
@@ -2483,6 +3016,7 @@ void CConnman::Stop()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+    CloseSocketEvents();
 
     if (fAddressesInitialized)
     {
@@ -2758,6 +3292,11 @@ ServiceFlags CConnman::GetLocalServices() const
     return nLocalServices;
 }
 
+void CConnman::SetLocalServices(ServiceFlags nServices)
+{
+    nLocalServices = nServices;
+}
+
 void CConnman::SetBestHeight(int height)
 {
     nBestHeight.store(height, std::memory_order_release);
@@ -2832,9 +3371,12 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fPauseSend = false;
     nProcessQueueSize = 0;
 
-    for (const std::string &msg : getAllNetMessageTypes())
+    for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapProcessMicrosPerMsgCmd[msg] = 0;
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapProcessMicrosPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs) {
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2850,6 +3392,7 @@ CNode::~CNode()
 
 void CNode::AskFor(const CInv& inv)
 {
+    LOCK(cs_askFor);
     if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
         return;
     // a peer may not have multiple non-responded queue positions for a single inv item
@@ -2858,6 +3401,7 @@ void CNode::AskFor(const CInv& inv)
 
     // We're using mapAskFor as a priority queue,
     // the key is the earliest time the request can be sent
+    LOCK(cs_mapAlreadyAskedFor);
     int64_t nRequestTime;
     limitedmap<uint256, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv.hash);
     if (it != mapAlreadyAskedFor.end())
@@ -2882,6 +3426,12 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+void CNode::RemoveAskFor(const uint256& hash)
+{
+    LOCK(cs_askFor);
+    setAskFor.erase(hash);
+}
+
 bool CConnman::NodeFullyConnected(const CNode* pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -2889,19 +3439,30 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    // A shared payload is queued by reference and already knows its hash
+    CSendBufferRef payload;
+    uint256 hash;
+    if (msg.sharedPayload) {
+        payload = CSendBufferRef(msg.sharedPayload, &msg.sharedPayload->data);
+        hash = msg.sharedPayload->hash;
+    } else {
+        hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+        payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+    }
+
+    size_t nMessageSize = payload->size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWakeSelect = false;
     {
         LOCK(pnode->cs_vSend);
         bool optimisticSend(pnode->vSendMsg.empty());
@@ -2912,16 +3473,21 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(std::move(payload));
 
         // If write queue empty, attempt "optimistic write"
-        if (optimisticSend == true)
+        if (optimisticSend == true) {
             nBytesSent = SocketSendData(pnode);
+            // the socket handler has to wait for the socket to become writable now
+            fWakeSelect = !pnode->vSendMsg.empty();
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    if (fWakeSelect)
+        WakeSelect();
 }
 
 
@@ -11,9 +11,11 @@
 #include <amount.h>
 #include <bloom.h>
 #include <compat.h>
+#include <dsmessagequeue.h>
 #include <hash.h>
 #include <limitedmap.h>
 #include <netaddress.h>
+#include <netmsgstats.h>
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
@@ -24,6 +26,7 @@
 
 #include <atomic>
 #include <deque>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -85,10 +88,36 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of threads processing and sending messages, peers are spread over them */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of threads processing and sending messages */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
+/** How the socket handler waits for socket events */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT = 0,
+    SOCKETEVENTS_POLL = 1,
+    SOCKETEVENTS_EPOLL = 2,
+};
+
+/** -socketevents default */
+#if defined(USE_EPOLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#elif defined(USE_POLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+
+/** Parse a -socketevents value, returns false if the mode isn't available on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& modeRet);
+std::string GetSocketEventsModeString(SocketEventsMode mode);
+/** Comma separated list of the modes available on this platform */
+std::string GetSupportedSocketEventsModes();
+
 typedef int64_t NodeId;
 
 struct AddedNodeInfo
@@ -102,6 +131,26 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * A serialized message payload which is immutable once created, so the same bytes can be
+ * queued for any number of peers without copying them. The payload hash is calculated once
+ * as well, the message header checksum is taken from it.
+ */
+struct CSharedNetMsgPayload
+{
+    explicit CSharedNetMsgPayload(std::vector<unsigned char>&& dataIn) :
+        data(std::move(dataIn)),
+        hash(Hash(data.begin(), data.end()))
+    {
+    }
+
+    const std::vector<unsigned char> data;
+    const uint256 hash;
+};
+
+/** A buffer queued for sending, either a message header or a (possibly shared) payload */
+typedef std::shared_ptr<const std::vector<unsigned char>> CSendBufferRef;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -113,6 +162,8 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+    // if set, this is sent as payload instead of data
+    std::shared_ptr<const CSharedNetMsgPayload> sharedPayload;
 };
 
 class NetEventsInterface;
@@ -147,6 +198,9 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        int nDSMessageThreads = 0;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
     };
 
     void Init(const Options& connOptions) {
@@ -160,6 +214,8 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -320,6 +376,8 @@ public:
     bool DisconnectNode(NodeId id);
 
     ServiceFlags GetLocalServices() const;
+    //! Change the services offered to peers which connect from now on
+    void SetLocalServices(ServiceFlags nServices);
 
     //!set the max outbound target in bytes
     void SetMaxOutboundTarget(uint64_t limit);
@@ -354,6 +412,19 @@ public:
     unsigned int GetReceiveFloodSize() const;
 
     void WakeMessageHandler();
+    /** Interrupt the socket handler's wait for socket events, e.g. because a node has data to send now */
+    void WakeSelect();
+
+    /** Hand a masternode-layer message over to the DS message workers, returns false if it has to be processed inline */
+    bool EnqueueDSMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived);
+    /** Should processing of the peer's messages wait until the DS message workers caught up? */
+    bool IsDSMessageQueueFull(NodeId id);
+    CDSMessageQueueStats GetDSMessageQueueStats();
+
+    /** Account a processed message to its command, see CNetMsgStats */
+    void RecordMessageStats(const std::string& strCommand, uint64_t nBytes, int64_t nQueueMicros, int64_t nHandlerMicros, int64_t nLockWaitMicros);
+    std::map<std::string, CNetMsgCmdStats> GetMessageStats() const;
+    void ResetMessageStats();
 
 private:
     struct ListenSocket {
@@ -371,7 +442,22 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
+    void ThreadMessageHandlerScheduler();
+    void ThreadMessageHandlerWorker();
+    /** Process received messages and send messages of a single node, returns true if it has more work */
+    bool ProcessNodeMessages(CNode* pnode);
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool InitSocketEvents();
+    void CloseSocketEvents();
+    bool GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    void SocketEventsSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
     void ThreadOpenMasternodeConnections();
@@ -430,6 +516,15 @@ private:
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
+
+    SocketEventsMode socketEventsMode;
+#ifdef USE_EPOLL
+    int epollfd{-1};
+    // written to by WakeSelect, watched by poll and epoll
+    int wakeupEventFd{-1};
+#endif
+    // set while the socket handler waits for events, so only then WakeSelect has to do a syscall
+    std::atomic<bool> wakeupSelectNeeded{false};
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
@@ -447,7 +542,7 @@ private:
     std::atomic<NodeId> nLastNodeId;
 
     /** Services this instance offers */
-    ServiceFlags nLocalServices;
+    std::atomic<ServiceFlags> nLocalServices;
 
     std::unique_ptr<CSemaphore> semOutbound;
     std::unique_ptr<CSemaphore> semAddnode;
@@ -470,6 +565,17 @@ private:
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
+    /**
+     * With more than one message handler thread, the msghand thread only schedules nodes
+     * and the workers process them. A node is queued at most once and processed by a single
+     * worker at a time, so its messages are still handled in order.
+     */
+    int nMessageHandlerThreads;
+    // nodes waiting for a worker, each holds a reference, guarded by mutexMsgProc
+    std::deque<CNode*> dequeMsgProcNodes;
+    std::condition_variable condMsgProcWorkers;
+    std::vector<std::thread> vThreadMessageHandlerWorkers;
+
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
@@ -479,6 +585,12 @@ private:
     std::thread threadOpenMasternodeConnections;
     std::thread threadMessageHandler;
 
+    /** Workers for masternode, governance and PrivateSend messages */
+    CDSMessageQueue dsMessageQueue;
+
+    /** Processing cost of received messages per command */
+    CNetMsgStats netMsgStats;
+
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
      *  This takes the place of a feeler connection */
@@ -517,6 +629,7 @@ public:
     virtual bool SendMessages(CNode* pnode, std::atomic<bool>& interrupt) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
     virtual void FinalizeNode(NodeId id, bool& update_connection_time) = 0;
+    virtual void ProcessDSMessage(CNode* pnode, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived) = 0;
 };
 
 enum
@@ -550,6 +663,7 @@ extern bool fDiscover;
 extern bool fListen;
 extern bool fRelayTxes;
 
+extern CCriticalSection cs_mapAlreadyAskedFor;
 extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
 
 /** Subversion as sent to the P2P network in `version` messages */
@@ -584,6 +698,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapProcessMicrosPerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -654,16 +769,23 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBufferRef> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
+#ifdef USE_EPOLL
+    // only used by the socket handler: the socket registered with epoll and the events we asked for
+    SOCKET hSocketEpoll{INVALID_SOCKET};
+    uint32_t nEpollEvents{0};
+#endif
 
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
 
     CCriticalSection cs_sendProcessing;
+    // Set while the node is queued for or processed by a message handler worker, guarded by CConnman::mutexMsgProc
+    bool fMsgProcScheduled{false};
 
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes;
@@ -713,12 +835,16 @@ protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // time spent in the message handlers per command, guarded by cs_vProcessMsg
+    mapMsgCmdSize mapProcessMicrosPerMsgCmd;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // vAddrToSend and addrKnown are filled by the message handlers of other peers as well
+    CCriticalSection cs_vAddrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -738,6 +864,8 @@ public:
     // List of non-tx/non-block inventory items
     std::vector<CInv> vInventoryOtherToSend;
     CCriticalSection cs_inventory;
+    // setAskFor and mapAskFor are also touched by the DS message workers
+    CCriticalSection cs_askFor;
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
@@ -812,6 +940,7 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    void RecordProcessTime(const std::string& strCommand, int64_t nMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -843,11 +972,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -895,6 +1026,7 @@ public:
     }
 
     void AskFor(const CInv& inv);
+    void RemoveAskFor(const uint256& hash);
 
     void CloseSocketDisconnect();
 
@@ -8,6 +8,7 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockpayloadcache.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
@@ -852,10 +853,29 @@ static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
+// Serialized once and shared by the messages to all peers, the compact block with witnesses (if present)
+// and the full block with and without witnesses, the latter two are created when first requested
+static std::shared_ptr<const CSharedNetMsgPayload> most_recent_compact_block_payload;
+static std::shared_ptr<const CSharedNetMsgPayload> most_recent_block_payload;
+static std::shared_ptr<const CSharedNetMsgPayload> most_recent_witness_block_payload;
+
+/** Return the serialized most recent block if it has the given hash, nullptr otherwise */
+static std::shared_ptr<const CSharedNetMsgPayload> GetMostRecentBlockPayload(const uint256& hash, int nSendFlags, const CNetMsgMaker& msgMaker)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hash)
+        return nullptr;
+    std::shared_ptr<const CSharedNetMsgPayload>& payload = (nSendFlags & SERIALIZE_TRANSACTION_NO_WITNESS) ? most_recent_block_payload : most_recent_witness_block_payload;
+    if (!payload) {
+        payload = msgMaker.MakePayload(nSendFlags, *most_recent_block);
+    }
+    return payload;
+}
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    std::shared_ptr<const CSharedNetMsgPayload> pcmpctblockPayload = msgMaker.MakePayload(0, *pcmpctblock);
 
     LOCK(cs_main);
 
@@ -873,10 +893,12 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        most_recent_compact_block_payload = pcmpctblockPayload;
+        most_recent_block_payload.reset();
+        most_recent_witness_block_payload.reset();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
+    connman->ForEachNode([this, &pcmpctblockPayload, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -888,7 +910,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msgMaker.MakeFromPayload(NetMsgType::CMPCTBLOCK, pcmpctblockPayload));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1087,11 +1109,13 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    std::shared_ptr<const CSharedNetMsgPayload> a_recent_compact_block_payload;
     bool fWitnessesPresentInARecentCompactBlock;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_payload = most_recent_compact_block_payload;
         fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
     }
 
@@ -1146,24 +1170,57 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
         pfrom->fDisconnect = true;
         send = false;
     }
+    // Peers which connected before a UTXO snapshot was loaded were told we have all blocks,
+    // disconnect them rather than let them wait for one we can't send
+    if (send && !(mi->second->nStatus & BLOCK_HAVE_DATA) && (pfrom->GetLocalServices() & NODE_NETWORK) && !(connman->GetLocalServices() & NODE_NETWORK)) {
+        LogPrint(BCLog::NET, "Block %s is not available anymore, disconnect peer=%d\n", inv.hash.ToString(), pfrom->GetId());
+        pfrom->fDisconnect = true;
+        send = false;
+    }
     // Pruned nodes may have deleted the block, so check whether
     // it's available before trying to send.
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
+        // Full blocks are sent from a serialization shared with other peers: the most recent
+        // block has its own, older blocks go through blockPayloadCache.
+        bool fFullBlock = inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK;
+        int nBlockSendFlags = inv.type == MSG_BLOCK ? SERIALIZE_TRANSACTION_NO_WITNESS : 0;
+        std::shared_ptr<const CSharedNetMsgPayload> payload;
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
+            if (fFullBlock)
+                payload = GetMostRecentBlockPayload(pblock->GetHash(), nBlockSendFlags, msgMaker);
         } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-        else if (inv.type == MSG_WITNESS_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            if (fFullBlock)
+                payload = blockPayloadCache.Get(inv.hash, nBlockSendFlags);
+            if (!payload && fFullBlock && IsRawBlockSerialization(mi->second, nBlockSendFlags, consensusParams)) {
+                // Pass the block on as it is stored, without deserializing it
+                std::vector<uint8_t> vRawBlock;
+                if (!ReadRawBlockFromDisk(vRawBlock, mi->second, Params().MessageStart()))
+                    assert(!"cannot load block from disk");
+                payload = std::make_shared<const CSharedNetMsgPayload>(std::move(vRawBlock));
+                blockPayloadCache.Insert(inv.hash, nBlockSendFlags, payload);
+            }
+            if (!payload) {
+                // Send block from disk
+                std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
+                    assert(!"cannot load block from disk");
+                pblock = pblockRead;
+                if (fFullBlock) {
+                    payload = msgMaker.MakePayload(nBlockSendFlags, *pblock);
+                    blockPayloadCache.Insert(inv.hash, nBlockSendFlags, payload);
+                }
+            }
+        }
+        if (fFullBlock)
+        {
+            if (payload)
+                connman->PushMessage(pfrom, msgMaker.MakeFromPayload(NetMsgType::BLOCK, std::move(payload)));
+            else
+                connman->PushMessage(pfrom, msgMaker.Make(nBlockSendFlags, NetMsgType::BLOCK, *pblock));
+        }
         else if (inv.type == MSG_FILTERED_BLOCK)
         {
             bool sendMerkleBlock = false;
@@ -1200,7 +1257,10 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
             if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
                 if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                    if (nSendFlags == 0 && a_recent_compact_block_payload)
+                        connman->PushMessage(pfrom, msgMaker.MakeFromPayload(NetMsgType::CMPCTBLOCK, a_recent_compact_block_payload));
+                    else
+                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                 } else {
                     CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
                     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -1619,7 +1679,17 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
-bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
+void static ProcessDSMessageInternal(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman* connman)
+{
+    privateSendClient.ProcessMessage(pfrom, strCommand, vRecv, connman);
+    privateSendServer.ProcessMessage(pfrom, strCommand, vRecv, connman);
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
+    mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
+    masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    governance.ProcessMessage(pfrom, strCommand, vRecv, connman);
+}
+
+bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool& fDeferred)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
     if (gArgs.IsArgSet("-dropmessagestest") && GetRand(gArgs.GetArg("-dropmessagestest", 0)) == 0)
@@ -2277,8 +2347,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
+        pfrom->RemoveAskFor(inv.hash);
+        {
+            LOCK(cs_mapAlreadyAskedFor);
+            mapAlreadyAskedFor.erase(inv.hash);
+        }
 
         std::list<CTransactionRef> lRemovedTxn;
 
@@ -2625,7 +2698,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         } // cs_main
 
         if (fProcessBLOCKTXN)
-            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman, interruptMsgProc);
+            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman, interruptMsgProc, fDeferred);
 
         if (fRevertToHeaderProcessing) {
             // Headers received from HB compact block peers are permitted to be
@@ -2821,7 +2894,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr)
@@ -3009,12 +3085,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         if (found)
         {
             //probably one the extensions
-            privateSendClient.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            privateSendServer.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
-            masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
-            governance.ProcessMessage(pfrom, strCommand, vRecv, connman);
+            if (connman->EnqueueDSMessage(pfrom, strCommand, vRecv, nTimeReceived)) {
+                fDeferred = true;
+            } else {
+                ProcessDSMessageInternal(pfrom, strCommand, vRecv, connman);
+            }
         } else {
             // Ignore unknown commands for extensibility
             LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->GetId());
@@ -3080,6 +3155,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (pfrom->fPauseSend)
         return false;
 
+    // Leave the messages where they are while the DS message workers can't take more of this peer,
+    // they are neither dropped nor reordered and the receive queue limit pauses the socket eventually
+    if (connman->IsDSMessageQueueFull(pfrom->GetId()))
+        return false;
+
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
@@ -3127,9 +3207,13 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     // Process message
     bool fRet = false;
+    // set if the message was handed over to the DS message workers, they account for it then
+    bool fDeferred = false;
+    int64_t nTimeStart = GetTimeMicros();
+    CLockWaitTracker lockWaitTracker(cs_main);
     try
     {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, fDeferred);
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3164,6 +3248,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
 
+    if (!fDeferred) {
+        int64_t nProcessMicros = GetTimeMicros() - nTimeStart;
+        connman->RecordMessageStats(strCommand, nMessageSize + CMessageHeader::HEADER_SIZE, nTimeStart - msg.nTime, nProcessMicros, lockWaitTracker.GetWaitMicros());
+        pfrom->RecordProcessTime(strCommand, nProcessMicros);
+    }
+
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
     }
@@ -3173,6 +3263,34 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     return fMoreWork;
 }
 
+void PeerLogicValidation::ProcessDSMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    unsigned int nMessageSize = vRecv.size();
+    int64_t nTimeStart = GetTimeMicros();
+    CLockWaitTracker lockWaitTracker(cs_main);
+    try
+    {
+        ProcessDSMessageInternal(pfrom, strCommand, vRecv, connman);
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, std::string("error parsing message")));
+        LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
+    }
+    catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessDSMessage()");
+    } catch (...) {
+        PrintExceptionContinue(nullptr, "ProcessDSMessage()");
+    }
+
+    int64_t nProcessMicros = GetTimeMicros() - nTimeStart;
+    connman->RecordMessageStats(strCommand, nMessageSize + CMessageHeader::HEADER_SIZE, nTimeStart - nTimeReceived, nProcessMicros, lockWaitTracker.GetWaitMicros());
+    pfrom->RecordProcessTime(strCommand, nProcessMicros);
+
+    LOCK(cs_main);
+    SendRejectsAndCheckIfBanned(pfrom, connman);
+}
+
 void PeerLogicValidation::ConsiderEviction(CNode *pto, int64_t time_in_seconds)
 {
     AssertLockHeld(cs_main);
@@ -3380,6 +3498,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3517,7 +3636,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                            if (nSendFlags == 0 && most_recent_compact_block_payload)
+                                connman->PushMessage(pto, msgMaker.MakeFromPayload(NetMsgType::CMPCTBLOCK, most_recent_compact_block_payload));
+                            else if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
@@ -3808,6 +3929,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         // Message: getdata (non-blocks)
         //
+        LOCK(pto->cs_askFor);
         while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
         {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
@@ -52,6 +52,8 @@ public:
     void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) override;
     /** Process protocol messages received from a given node */
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override;
+    /** Process a masternode, governance or PrivateSend message, called from the DS message workers */
+    void ProcessDSMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived) override;
     /**
     * Send queued protocol messages to be sent to a give node.
     *
@@ -0,0 +1,91 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmsgstats.h>
+
+#include <crypto/common.h>
+
+CNetMsgStats::CCounters::CCounters()
+{
+    for (auto& bucket : vHandlerHistogram) {
+        bucket = 0;
+    }
+}
+
+CNetMsgStats::CNetMsgStats(const std::vector<std::string>& vCommands, const std::string& strOtherIn) :
+    strOther(strOtherIn)
+{
+    for (const std::string& strCommand : vCommands) {
+        mapCounters[strCommand];
+    }
+    mapCounters[strOther];
+}
+
+int CNetMsgStats::HistogramBucket(int64_t nMicros)
+{
+    if (nMicros <= 0) return 0;
+    return std::min((int)CountBits(nMicros), NET_MSG_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void CNetMsgStats::Record(const std::string& strCommand, uint64_t nBytes, int64_t nQueueMicros, int64_t nHandlerMicros, int64_t nLockWaitMicros)
+{
+    auto it = mapCounters.find(strCommand);
+    if (it == mapCounters.end()) {
+        it = mapCounters.find(strOther);
+    }
+    CCounters& counters = it->second;
+
+    nQueueMicros = std::max<int64_t>(nQueueMicros, 0);
+    nHandlerMicros = std::max<int64_t>(nHandlerMicros, 0);
+    nLockWaitMicros = std::max<int64_t>(nLockWaitMicros, 0);
+
+    counters.nCount.fetch_add(1, std::memory_order_relaxed);
+    counters.nBytes.fetch_add(nBytes, std::memory_order_relaxed);
+    counters.nQueueMicros.fetch_add(nQueueMicros, std::memory_order_relaxed);
+    counters.nHandlerMicros.fetch_add(nHandlerMicros, std::memory_order_relaxed);
+    counters.nLockWaitMicros.fetch_add(nLockWaitMicros, std::memory_order_relaxed);
+    counters.vHandlerHistogram[HistogramBucket(nHandlerMicros)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t nMax = counters.nMaxHandlerMicros.load(std::memory_order_relaxed);
+    while ((uint64_t)nHandlerMicros > nMax && !counters.nMaxHandlerMicros.compare_exchange_weak(nMax, nHandlerMicros, std::memory_order_relaxed)) {
+    }
+}
+
+std::map<std::string, CNetMsgCmdStats> CNetMsgStats::GetStats() const
+{
+    std::map<std::string, CNetMsgCmdStats> mapRet;
+    for (const auto& entry : mapCounters) {
+        const CCounters& counters = entry.second;
+        if (counters.nCount.load(std::memory_order_relaxed) == 0) continue;
+
+        CNetMsgCmdStats& stats = mapRet[entry.first];
+        stats.nCount = counters.nCount.load(std::memory_order_relaxed);
+        stats.nBytes = counters.nBytes.load(std::memory_order_relaxed);
+        stats.nQueueMicros = counters.nQueueMicros.load(std::memory_order_relaxed);
+        stats.nHandlerMicros = counters.nHandlerMicros.load(std::memory_order_relaxed);
+        stats.nMaxHandlerMicros = counters.nMaxHandlerMicros.load(std::memory_order_relaxed);
+        stats.nLockWaitMicros = counters.nLockWaitMicros.load(std::memory_order_relaxed);
+        stats.vHandlerHistogram.reserve(NET_MSG_STATS_HISTOGRAM_BUCKETS);
+        for (const auto& bucket : counters.vHandlerHistogram) {
+            stats.vHandlerHistogram.push_back(bucket.load(std::memory_order_relaxed));
+        }
+    }
+    return mapRet;
+}
+
+void CNetMsgStats::Reset()
+{
+    for (auto& entry : mapCounters) {
+        CCounters& counters = entry.second;
+        counters.nCount = 0;
+        counters.nBytes = 0;
+        counters.nQueueMicros = 0;
+        counters.nHandlerMicros = 0;
+        counters.nMaxHandlerMicros = 0;
+        counters.nLockWaitMicros = 0;
+        for (auto& bucket : counters.vHandlerHistogram) {
+            bucket = 0;
+        }
+    }
+}
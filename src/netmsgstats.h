@@ -0,0 +1,86 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMSGSTATS_H
+#define BITCOIN_NETMSGSTATS_H
+
+#include <serialize.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Number of buckets of the handler time histograms, the last one counts everything of 2^22 µs and longer */
+static const int NET_MSG_STATS_HISTOGRAM_BUCKETS = 24;
+
+/** Totals of the received messages of one command */
+struct CNetMsgCmdStats
+{
+    uint64_t nCount = 0;
+    uint64_t nBytes = 0;
+    // time between reception and start of processing
+    uint64_t nQueueMicros = 0;
+    // time spent in the message handler, including the time waiting for cs_main
+    uint64_t nHandlerMicros = 0;
+    uint64_t nMaxHandlerMicros = 0;
+    // time the message handler waited for cs_main
+    uint64_t nLockWaitMicros = 0;
+    // bucket i counts handler times t with 2^(i-1) <= t < 2^i µs, bucket 0 those below 1µs
+    std::vector<uint64_t> vHandlerHistogram;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nCount);
+        READWRITE(nBytes);
+        READWRITE(nQueueMicros);
+        READWRITE(nHandlerMicros);
+        READWRITE(nMaxHandlerMicros);
+        READWRITE(nLockWaitMicros);
+        READWRITE(vHandlerHistogram);
+    }
+};
+
+/**
+ * Per command accounting of the processing cost of received messages.
+ *
+ * The set of commands is fixed at construction, everything else is counted
+ * under strOther. Recording only updates atomic counters so the message
+ * handler threads never wait for each other here.
+ */
+class CNetMsgStats
+{
+private:
+    struct CCounters
+    {
+        std::atomic<uint64_t> nCount{0};
+        std::atomic<uint64_t> nBytes{0};
+        std::atomic<uint64_t> nQueueMicros{0};
+        std::atomic<uint64_t> nHandlerMicros{0};
+        std::atomic<uint64_t> nMaxHandlerMicros{0};
+        std::atomic<uint64_t> nLockWaitMicros{0};
+        std::atomic<uint64_t> vHandlerHistogram[NET_MSG_STATS_HISTOGRAM_BUCKETS];
+
+        CCounters();
+    };
+
+    // never modified after construction, lookups don't need a lock
+    std::map<std::string, CCounters> mapCounters;
+    const std::string strOther;
+
+public:
+    CNetMsgStats(const std::vector<std::string>& vCommands, const std::string& strOtherIn);
+
+    /** Return the histogram bucket of a handler time */
+    static int HistogramBucket(int64_t nMicros);
+
+    void Record(const std::string& strCommand, uint64_t nBytes, int64_t nQueueMicros, int64_t nHandlerMicros, int64_t nLockWaitMicros);
+    /** Return the totals of all commands which were received at least once */
+    std::map<std::string, CNetMsgCmdStats> GetStats() const;
+    void Reset();
+};
+
+#endif // BITCOIN_NETMSGSTATS_H
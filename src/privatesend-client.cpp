@@ -44,11 +44,9 @@ void CPrivateSendClient::ProcessMessage(CNode* pfrom, const std::string& strComm
         vRecv >> dsq;
 
         // process every dsq only once
-        for (const auto& q : vecDarksendQueue) {
-            if(q == dsq) {
-                // LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s seen\n", dsq.ToString());
-                return;
-            }
+        if(darksendQueueStore.Has(dsq)) {
+            // LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s seen\n", dsq.ToString());
+            return;
         }
 
         LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s new\n", dsq.ToString());
@@ -72,18 +70,21 @@ void CPrivateSendClient::ProcessMessage(CNode* pfrom, const std::string& strComm
                 LogPrintf("DSQUEUE -- message doesn't match current Masternode: infoMixingMasternode=%s, addr=%s\n", infoMixingMasternode.addr.ToString(), infoMn.addr.ToString());
                 return;
             }
+            // the masternode can run several sessions, only submit when it's ours which is ready
+            if(dsq.nDenom != nSessionDenom || dsq.nInputCount != nSessionInputCount) {
+                LogPrint(BCLog::PRIVSEND, "DSQUEUE -- ready queue (%s) is not for our session: nSessionDenom=%d, nSessionInputCount=%d\n", dsq.ToString(), nSessionDenom, nSessionInputCount);
+                return;
+            }
 
             if(nState == POOL_STATE_QUEUE) {
                 LogPrint(BCLog::PRIVSEND, "DSQUEUE -- PrivateSend queue (%s) is ready on masternode %s\n", dsq.ToString(), infoMn.addr.ToString());
                 SubmitDenominate(connman);
             }
         } else {
-            for (const auto& q : vecDarksendQueue) {
-                if(q.masternodeOutpoint == dsq.masternodeOutpoint) {
-                    // no way same mn can send another "not yet ready" dsq this soon
-                    LogPrint(BCLog::PRIVSEND, "DSQUEUE -- Masternode %s is sending WAY too many dsq messages\n", infoMn.addr.ToString());
-                    return;
-                }
+            if(darksendQueueStore.HasQueueFromMasternode(dsq.masternodeOutpoint)) {
+                // no way same mn can send another "not yet ready" dsq this soon
+                LogPrint(BCLog::PRIVSEND, "DSQUEUE -- Masternode %s is sending WAY too many dsq messages\n", infoMn.addr.ToString());
+                return;
             }
 
             int nThreshold = infoMn.nLastDsq + mnodeman.CountEnabled(MIN_PRIVATESEND_PEER_PROTO_VERSION)/5;
@@ -100,7 +101,7 @@ void CPrivateSendClient::ProcessMessage(CNode* pfrom, const std::string& strComm
             if(infoMixingMasternode.fInfoValid && infoMixingMasternode.outpoint == dsq.masternodeOutpoint) {
                 dsq.fTried = true;
             }
-            vecDarksendQueue.push_back(dsq);
+            darksendQueueStore.Add(dsq);
             dsq.Relay(connman);
         }
 
@@ -839,7 +840,8 @@ bool CPrivateSendClient::JoinExistingQueue(CAmount nBalanceNeedsAnonymized, CCon
     CWallet * const pwallet = GetWalletForPSRequest();
     std::vector<CAmount> vecStandardDenoms = CPrivateSend::GetStandardDenominations();
     // Look through the queues and see if anything matches
-    for (auto& dsq : vecDarksendQueue) {
+    for (CDarksendQueue* pdsq : darksendQueueStore.GetQueues()) {
+        CDarksendQueue& dsq = *pdsq;
         // only try each queue once
         if(dsq.fTried) continue;
         dsq.fTried = true;
@@ -868,7 +870,7 @@ bool CPrivateSendClient::JoinExistingQueue(CAmount nBalanceNeedsAnonymized, CCon
         }
 
         // mixing rate limit i.e. nLastDsq check should already pass in DSQUEUE ProcessMessage
-        // in order for dsq to get into vecDarksendQueue, so we should be safe to mix already,
+        // in order for dsq to get into darksendQueueStore, so we should be safe to mix already,
         // no need for additional verification here
 
         LogPrint(BCLog::PRIVSEND, "CPrivateSendClient::JoinExistingQueue -- found valid queue: %s\n", dsq.ToString());
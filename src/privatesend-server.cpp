@@ -30,14 +30,7 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
             LogPrint(BCLog::PRIVSEND, "DSACCEPT -- peer=%d using obsolete version %i\n", pfrom->GetId(), pfrom->GetSendVersion());
             connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, strCommand, REJECT_OBSOLETE,
                                strprintf("Version must be %d or greater", MIN_PRIVATESEND_PEER_PROTO_VERSION)));
-            PushStatus(pfrom, STATUS_REJECTED, ERR_VERSION, connman);
-            return;
-        }
-
-        if(IsSessionReady()) {
-            // too many users in this session already, reject new ones
-            LogPrintf("DSACCEPT -- queue is already full!\n");
-            PushStatus(pfrom, STATUS_ACCEPTED, ERR_QUEUE_FULL, connman);
+            PushStatus(pfrom, nullptr, STATUS_REJECTED, ERR_VERSION, connman);
             return;
         }
 
@@ -48,31 +41,56 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
 
         if(dsa.nInputCount < 0 || dsa.nInputCount > PRIVATESEND_ENTRY_MAX_SIZE) return;
 
-        masternode_info_t mnInfo;
-        if(!mnodeman.GetMasternodeInfo(activeMasternode.outpoint, mnInfo)) {
-            PushStatus(pfrom, STATUS_REJECTED, ERR_MN_LIST, connman);
+        LOCK(cs_darksend);
+
+        if(GetSession(pfrom->addr)) {
+            LogPrintf("DSACCEPT -- peer is already in a session, addr=%s\n", pfrom->addr.ToString());
+            PushStatus(pfrom, nullptr, STATUS_REJECTED, ERR_MODE, connman);
             return;
         }
 
-        if(vecSessionCollaterals.size() == 0 && mnInfo.nLastDsq != 0 &&
-            mnInfo.nLastDsq + mnodeman.CountEnabled(MIN_PRIVATESEND_PEER_PROTO_VERSION)/5 > mnodeman.nDsqCount)
-        {
-            LogPrintf("DSACCEPT -- last dsq too recent, must wait: addr=%s\n", pfrom->addr.ToString());
-            PushStatus(pfrom, STATUS_REJECTED, ERR_RECENT, connman);
+        masternode_info_t mnInfo;
+        if(!mnodeman.GetMasternodeInfo(activeMasternode.outpoint, mnInfo)) {
+            PushStatus(pfrom, nullptr, STATUS_REJECTED, ERR_MN_LIST, connman);
             return;
         }
 
+        // older clients act on any ready dsq of their masternode, they only get sessions which run alone
+        bool fMultiSession = pfrom->GetSendVersion() >= MIN_PRIVATESEND_MULTI_SESSION_PROTO_VERSION;
+
         PoolMessage nMessageID = MSG_NOERR;
+        CPrivateSendSession* psession = FindSessionToJoin(dsa, fMultiSession);
+        bool fResult;
+
+        if(psession) {
+            fResult = AddUserToExistingSession(*psession, dsa, pfrom->addr, fMultiSession, nMessageID);
+        } else {
+            if(!CanCreateSession(fMultiSession)) {
+                // too many sessions already or they can't run next to each other, reject new ones
+                LogPrintf("DSACCEPT -- queue is already full!\n");
+                PushStatus(pfrom, nullptr, STATUS_ACCEPTED, ERR_QUEUE_FULL, connman);
+                return;
+            }
+
+            if(mnInfo.nLastDsq != 0 &&
+                mnInfo.nLastDsq + mnodeman.CountEnabled(MIN_PRIVATESEND_PEER_PROTO_VERSION)/5 > mnodeman.nDsqCount)
+            {
+                LogPrintf("DSACCEPT -- last dsq too recent, must wait: addr=%s\n", pfrom->addr.ToString());
+                PushStatus(pfrom, nullptr, STATUS_REJECTED, ERR_RECENT, connman);
+                return;
+            }
+
+            fResult = CreateNewSession(dsa, pfrom->addr, fMultiSession, nMessageID, connman);
+            psession = GetSession(pfrom->addr);
+        }
 
-        bool fResult = nSessionID == 0  ? CreateNewSession(dsa, nMessageID, connman)
-                                        : AddUserToExistingSession(dsa, nMessageID);
         if(fResult) {
             LogPrintf("DSACCEPT -- is compatible, please submit!\n");
-            PushStatus(pfrom, STATUS_ACCEPTED, nMessageID, connman);
+            PushStatus(pfrom, psession, STATUS_ACCEPTED, nMessageID, connman);
             return;
         } else {
             LogPrintf("DSACCEPT -- not compatible with existing transactions!\n");
-            PushStatus(pfrom, STATUS_REJECTED, nMessageID, connman);
+            PushStatus(pfrom, psession, STATUS_REJECTED, nMessageID, connman);
             return;
         }
 
@@ -91,11 +109,9 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
         vRecv >> dsq;
 
         // process every dsq only once
-        for (const auto& q : vecDarksendQueue) {
-            if(q == dsq) {
-                // LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s seen\n", dsq.ToString());
-                return;
-            }
+        if(darksendQueueStore.Has(dsq)) {
+            // LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s seen\n", dsq.ToString());
+            return;
         }
 
         LogPrint(BCLog::PRIVSEND, "DSQUEUE -- %s new\n", dsq.ToString());
@@ -113,12 +129,10 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
         }
 
         if(!dsq.fReady) {
-            for (const auto& q : vecDarksendQueue) {
-                if(q.masternodeOutpoint == dsq.masternodeOutpoint) {
-                    // no way same mn can send another "not yet ready" dsq this soon
-                    LogPrint(BCLog::PRIVSEND, "DSQUEUE -- Masternode %s is sending WAY too many dsq messages\n", mnInfo.addr.ToString());
-                    return;
-                }
+            if(darksendQueueStore.HasQueueFromMasternode(dsq.masternodeOutpoint)) {
+                // no way same mn can send another "not yet ready" dsq this soon
+                LogPrint(BCLog::PRIVSEND, "DSQUEUE -- Masternode %s is sending WAY too many dsq messages\n", mnInfo.addr.ToString());
+                return;
             }
 
             int nThreshold = mnInfo.nLastDsq + mnodeman.CountEnabled(MIN_PRIVATESEND_PEER_PROTO_VERSION)/5;
@@ -131,7 +145,7 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
             mnodeman.AllowMixing(dsq.masternodeOutpoint);
 
             LogPrint(BCLog::PRIVSEND, "DSQUEUE -- new PrivateSend queue (%s) from masternode %s\n", dsq.ToString(), mnInfo.addr.ToString());
-            vecDarksendQueue.push_back(dsq);
+            darksendQueueStore.Add(dsq);
             dsq.Relay(connman);
         }
 
@@ -141,14 +155,17 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
             LogPrint(BCLog::PRIVSEND, "DSVIN -- peer=%d using obsolete version %i\n", pfrom->GetId(), pfrom->GetSendVersion());
             connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, strCommand, REJECT_OBSOLETE,
                                strprintf("Version must be %d or greater", MIN_PRIVATESEND_PEER_PROTO_VERSION)));
-            PushStatus(pfrom, STATUS_REJECTED, ERR_VERSION, connman);
+            PushStatus(pfrom, nullptr, STATUS_REJECTED, ERR_VERSION, connman);
             return;
         }
 
+        LOCK(cs_darksend);
+
         //do we have enough users in the current session?
-        if(!IsSessionReady()) {
+        CPrivateSendSession* psession = GetSession(pfrom->addr);
+        if(!psession || !psession->IsReady()) {
             LogPrintf("DSVIN -- session not complete!\n");
-            PushStatus(pfrom, STATUS_REJECTED, ERR_SESSION, connman);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_SESSION, connman);
             return;
         }
 
@@ -159,32 +176,32 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
 
         if(entry.vecTxDSIn.size() > PRIVATESEND_ENTRY_MAX_SIZE) {
             LogPrintf("DSVIN -- ERROR: too many inputs! %d/%d\n", entry.vecTxDSIn.size(), PRIVATESEND_ENTRY_MAX_SIZE);
-            PushStatus(pfrom, STATUS_REJECTED, ERR_MAXIMUM, connman);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_MAXIMUM, connman);
             return;
         }
 
         if(entry.vecTxOut.size() > PRIVATESEND_ENTRY_MAX_SIZE) {
             LogPrintf("DSVIN -- ERROR: too many outputs! %d/%d\n", entry.vecTxOut.size(), PRIVATESEND_ENTRY_MAX_SIZE);
-            PushStatus(pfrom, STATUS_REJECTED, ERR_MAXIMUM, connman);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_MAXIMUM, connman);
             return;
         }
 
-        if(nSessionInputCount != 0 && entry.vecTxDSIn.size() != nSessionInputCount) {
-            LogPrintf("DSVIN -- ERROR: incorrect number of inputs! %d/%d\n", entry.vecTxDSIn.size(), nSessionInputCount);
-            PushStatus(pfrom, STATUS_REJECTED, ERR_INVALID_INPUT_COUNT, connman);
+        if(psession->nSessionInputCount != 0 && entry.vecTxDSIn.size() != psession->nSessionInputCount) {
+            LogPrintf("DSVIN -- ERROR: incorrect number of inputs! %d/%d\n", entry.vecTxDSIn.size(), psession->nSessionInputCount);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_INVALID_INPUT_COUNT, connman);
             return;
         }
 
-        if(nSessionInputCount != 0 && entry.vecTxOut.size() != nSessionInputCount) {
-            LogPrintf("DSVIN -- ERROR: incorrect number of outputs! %d/%d\n", entry.vecTxOut.size(), nSessionInputCount);
-            PushStatus(pfrom, STATUS_REJECTED, ERR_INVALID_INPUT_COUNT, connman);
+        if(psession->nSessionInputCount != 0 && entry.vecTxOut.size() != psession->nSessionInputCount) {
+            LogPrintf("DSVIN -- ERROR: incorrect number of outputs! %d/%d\n", entry.vecTxOut.size(), psession->nSessionInputCount);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_INVALID_INPUT_COUNT, connman);
             return;
         }
 
         //do we have the same denominations as the current session?
-        if(!IsOutputsCompatibleWithSessionDenom(entry.vecTxOut)) {
+        if(!IsOutputsCompatibleWithSessionDenom(*psession, entry.vecTxOut)) {
             LogPrintf("DSVIN -- not compatible with existing transactions!\n");
-            PushStatus(pfrom, STATUS_REJECTED, ERR_EXISTING_TX, connman);
+            PushStatus(pfrom, psession, STATUS_REJECTED, ERR_EXISTING_TX, connman);
             return;
         }
 
@@ -201,12 +218,12 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
 
                 if(txout.scriptPubKey.size() != 25) {
                     LogPrintf("DSVIN -- non-standard pubkey detected! scriptPubKey=%s\n", ScriptToAsmStr(txout.scriptPubKey));
-                    PushStatus(pfrom, STATUS_REJECTED, ERR_NON_STANDARD_PUBKEY, connman);
+                    PushStatus(pfrom, psession, STATUS_REJECTED, ERR_NON_STANDARD_PUBKEY, connman);
                     return;
                 }
 /*                if(!txout.scriptPubKey.IsPayToPublicKeyHash()) {
                     LogPrintf("DSVIN -- invalid script! scriptPubKey=%s\n", ScriptToAsmStr(txout.scriptPubKey));
-                    PushStatus(pfrom, STATUS_REJECTED, ERR_INVALID_SCRIPT, connman);
+                    PushStatus(pfrom, psession, STATUS_REJECTED, ERR_INVALID_SCRIPT, connman);
                     return;
                 }
 */            }
@@ -221,7 +238,7 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
                     nValueIn += coin.out.nValue;
                 } else {
                     LogPrintf("DSVIN -- missing input! tx=%s", tx.GetHash().ToString());
-                    PushStatus(pfrom, STATUS_REJECTED, ERR_MISSING_TX, connman);
+                    PushStatus(pfrom, psession, STATUS_REJECTED, ERR_MISSING_TX, connman);
                     return;
                 }
             }
@@ -230,7 +247,7 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
             CAmount nFee = nValueIn - nValueOut;
             if(nFee != 0) {
                 LogPrintf("DSVIN -- there should be no fee in mixing tx! fees: %lld, tx=%s", nFee, tx.GetHash().ToString());
-                PushStatus(pfrom, STATUS_REJECTED, ERR_FEES, connman);
+                PushStatus(pfrom, psession, STATUS_REJECTED, ERR_FEES, connman);
                 return;
             }
         }
@@ -238,14 +255,15 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
         PoolMessage nMessageID = MSG_NOERR;
 
         entry.addr = pfrom->addr;
-        if(AddEntry(entry, nMessageID)) {
-            PushStatus(pfrom, STATUS_ACCEPTED, nMessageID, connman);
-            CheckPool(connman);
-            RelayStatus(STATUS_ACCEPTED, connman);
+        if(AddEntry(*psession, entry, nMessageID)) {
+            PushStatus(pfrom, psession, STATUS_ACCEPTED, nMessageID, connman);
+            CheckPool(*psession, connman);
+            RelayStatus(*psession, STATUS_ACCEPTED, connman);
         } else {
-            PushStatus(pfrom, STATUS_REJECTED, nMessageID, connman);
-            SetNull();
+            PushStatus(pfrom, psession, STATUS_REJECTED, nMessageID, connman);
+            ResetSession(*psession);
         }
+        RemoveFinishedSessions();
 
     } else if(strCommand == NetMsgType::DSSIGNFINALTX) {
 
@@ -261,83 +279,151 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
 
         LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- vecTxIn.size() %s\n", vecTxIn.size());
 
-        int nTxInIndex = 0;
-        int nTxInsCount = (int)vecTxIn.size();
+        LOCK(cs_darksend);
 
-        for (const auto& txin : vecTxIn) {
-            nTxInIndex++;
-            if(!AddScriptSig(txin)) {
-                LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- AddScriptSig() failed at %d/%d, session: %d\n", nTxInIndex, nTxInsCount, nSessionID);
-                RelayStatus(STATUS_REJECTED, connman);
-                return;
-            }
-            LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- AddScriptSig() %d/%d success\n", nTxInIndex, nTxInsCount);
+        CPrivateSendSession* psession = GetSession(pfrom->addr);
+        if(!psession || psession->nState != POOL_STATE_SIGNING) {
+            LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- no session in signing mode, addr=%s\n", pfrom->addr.ToString());
+            return;
         }
+
+        if(!AddScriptSigs(*psession, vecTxIn)) {
+            LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- AddScriptSigs() failed, session: %d\n", psession->nSessionID);
+            RelayStatus(*psession, STATUS_REJECTED, connman);
+            RemoveFinishedSessions();
+            return;
+        }
+        LogPrint(BCLog::PRIVSEND, "DSSIGNFINALTX -- AddScriptSigs() %d inputs success\n", vecTxIn.size());
         // all is good
-        CheckPool(connman);
+        CheckPool(*psession, connman);
+        RemoveFinishedSessions();
     }
 }
 
 void CPrivateSendServer::SetNull()
 {
     // MN side
-    vecSessionCollaterals.clear();
+    mapSessions.clear();
+    mapSessionByAddr.clear();
 
     CPrivateSendBase::SetNull();
 }
 
+CPrivateSendSession* CPrivateSendServer::GetSession(const CService& addr)
+{
+    auto itAddr = mapSessionByAddr.find(addr);
+    if(itAddr == mapSessionByAddr.end()) return nullptr;
+
+    auto it = mapSessions.find(itAddr->second);
+    if(it == mapSessions.end() || it->second.IsFinished()) return nullptr;
+
+    return &it->second;
+}
+
+CPrivateSendSession* CPrivateSendServer::FindSessionToJoin(const CDarksendAccept& dsa, bool fMultiSession)
+{
+    if(!fMultiSession && mapSessions.size() > 1) return nullptr;
+
+    for (auto& sessionpair : mapSessions) {
+        CPrivateSendSession& session = sessionpair.second;
+        if(session.nState == POOL_STATE_QUEUE && !session.IsReady() &&
+                session.nSessionDenom == dsa.nDenom && session.nSessionInputCount == dsa.nInputCount) {
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+bool CPrivateSendServer::CanCreateSession(bool fMultiSession) const
+{
+    if(mapSessions.empty()) return true;
+    if(!fMultiSession || (int)mapSessions.size() >= PRIVATESEND_SERVER_MAX_SESSIONS) return false;
+
+    for (const auto& sessionpair : mapSessions) {
+        if(sessionpair.second.fLegacy && !sessionpair.second.IsFinished()) return false;
+    }
+    return true;
+}
+
+void CPrivateSendServer::ResetSession(CPrivateSendSession& session)
+{
+    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::ResetSession -- nSessionID: %d  nState: %d\n", session.nSessionID, session.nState);
+    session.nState = POOL_STATE_IDLE;
+}
+
+void CPrivateSendServer::RemoveFinishedSessions()
+{
+    auto it = mapSessions.begin();
+    while(it != mapSessions.end()) {
+        if(it->second.IsFinished()) {
+            for (const auto& addr : it->second.setParticipants) {
+                mapSessionByAddr.erase(addr);
+            }
+            mapSessions.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
 //
 // Check the mixing progress and send client updates if a Masternode
 //
-void CPrivateSendServer::CheckPool(CConnman* connman)
+void CPrivateSendServer::CheckPool(CPrivateSendSession& session, CConnman* connman)
 {
     if (!fMasternodeMode) return;
 
-    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckPool -- entries count %lu\n", GetEntriesCount());
+    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckPool -- nSessionID: %d  entries count %lu\n", session.nSessionID, session.GetEntriesCount());
 
     // If entries are full, create finalized transaction
-    if (nState == POOL_STATE_ACCEPTING_ENTRIES && GetEntriesCount() >= CPrivateSend::GetMaxPoolTransactions()) {
+    if (session.nState == POOL_STATE_ACCEPTING_ENTRIES && session.GetEntriesCount() >= CPrivateSend::GetMaxPoolTransactions()) {
         LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckPool -- FINALIZE TRANSACTIONS\n");
-        CreateFinalTransaction(connman);
+        CreateFinalTransaction(session, connman);
         return;
     }
 
     // If we have all of the signatures, try to compile the transaction
-    if (nState == POOL_STATE_SIGNING && IsSignaturesComplete()) {
+    if (session.nState == POOL_STATE_SIGNING && IsSignaturesComplete(session)) {
         LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckPool -- SIGNING\n");
-        CommitFinalTransaction(connman);
+        CommitFinalTransaction(session, connman);
         return;
     }
 }
 
-void CPrivateSendServer::CreateFinalTransaction(CConnman* connman)
+void CPrivateSendServer::CreateFinalTransaction(CPrivateSendSession& session, CConnman* connman)
 {
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CreateFinalTransaction -- FINALIZE TRANSACTIONS\n");
 
     CMutableTransaction txNew;
 
+    session.mapFinalTxInPos.clear();
+    session.nFinalTxSignedCount = 0;
+
     // make our new transaction
-    for(int i = 0; i < GetEntriesCount(); i++) {
-        for (const auto& txout : vecEntries[i].vecTxOut)
+    for(size_t i = 0; i < session.vecEntries.size(); i++) {
+        for (const auto& txout : session.vecEntries[i].vecTxOut)
             txNew.vout.push_back(txout);
 
-        for (const auto& txdsin : vecEntries[i].vecTxDSIn)
-            txNew.vin.push_back(txdsin);
+        for (size_t j = 0; j < session.vecEntries[i].vecTxDSIn.size(); j++) {
+            session.mapFinalTxInPos.emplace(session.vecEntries[i].vecTxDSIn[j].prevout, CPrivateSendSession::CFinalTxInPos{(unsigned int)txNew.vin.size(), i, j});
+            txNew.vin.push_back(session.vecEntries[i].vecTxDSIn[j]);
+        }
     }
 
-    finalMutableTransaction = txNew;
+    session.finalMutableTransaction = txNew;
+    session.finalTransactionUnsigned = MakeTransactionRef(txNew);
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CreateFinalTransaction -- finalMutableTransaction=%s", txNew.GetHash().ToString());
 
     // request signatures from clients
-    RelayFinalTransaction(finalMutableTransaction, connman);
-    SetState(POOL_STATE_SIGNING);
+    RelayFinalTransaction(session, *session.finalTransactionUnsigned, connman);
+    SetState(session, POOL_STATE_SIGNING);
 }
 
-void CPrivateSendServer::CommitFinalTransaction(CConnman* connman)
+void CPrivateSendServer::CommitFinalTransaction(CPrivateSendSession& session, CConnman* connman)
 {
     if(!fMasternodeMode) return; // check and relay final tx only on masternode
 
-    CTransactionRef finalTransaction = MakeTransactionRef(finalMutableTransaction);
+    CTransactionRef finalTransaction = MakeTransactionRef(session.finalMutableTransaction);
     uint256 hashTx = finalTransaction->GetHash();
 
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CommitFinalTransaction -- finalTransaction=%s", finalTransaction->ToString());
@@ -350,9 +436,9 @@ void CPrivateSendServer::CommitFinalTransaction(CConnman* connman)
         if(!lockMain || !AcceptToMemoryPool(mempool, validationState, finalTransaction, nullptr, nullptr, false, maxTxFee, true))
         {
             LogPrintf("CPrivateSendServer::CommitFinalTransaction -- AcceptToMemoryPool() error: Transaction not valid\n");
-            SetNull();
             // not much we can do in this case, just notify clients
-            RelayCompletedTransaction(ERR_INVALID_TX, connman);
+            RelayCompletedTransaction(session, ERR_INVALID_TX, connman);
+            ResetSession(session);
             return;
         }
     }
@@ -372,14 +458,14 @@ void CPrivateSendServer::CommitFinalTransaction(CConnman* connman)
     connman->RelayInv(inv);
 
     // Tell the clients it was successful
-    RelayCompletedTransaction(MSG_SUCCESS, connman);
+    RelayCompletedTransaction(session, MSG_SUCCESS, connman);
 
     // Randomly charge clients
-    ChargeRandomFees(connman);
+    ChargeRandomFees(session, connman);
 
     // Reset
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CommitFinalTransaction -- COMPLETED -- RESETTING\n");
-    SetNull();
+    ResetSession(session);
 }
 
 //
@@ -394,41 +480,14 @@ void CPrivateSendServer::CommitFinalTransaction(CConnman* connman)
 // transaction for the client to be able to enter the pool. This transaction is kept by the Masternode
 // until the transaction is either complete or fails.
 //
-void CPrivateSendServer::ChargeFees(CConnman* connman)
+void CPrivateSendServer::ChargeFees(CPrivateSendSession& session, CConnman* connman)
 {
     if(!fMasternodeMode) return;
 
     //we don't need to charge collateral for every offence.
     if(GetRandInt(100) > 33) return;
 
-    std::vector<CTransactionRef> vecOffendersCollaterals;
-
-    if(nState == POOL_STATE_ACCEPTING_ENTRIES) {
-        for (const auto& txCollateral : vecSessionCollaterals) {
-            bool fFound = false;
-            for (const auto& entry : vecEntries)
-                if(*entry.txCollateral == *txCollateral)
-                    fFound = true;
-
-            // This queue entry didn't send us the promised transaction
-            if(!fFound) {
-                LogPrintf("CPrivateSendServer::ChargeFees -- found uncooperative node (didn't send transaction), found offence\n");
-                vecOffendersCollaterals.push_back(txCollateral);
-            }
-        }
-    }
-
-    if(nState == POOL_STATE_SIGNING) {
-        // who didn't sign?
-        for (const auto& entry : vecEntries) {
-            for (const auto& txdsin : entry.vecTxDSIn) {
-                if(!txdsin.fHasSig) {
-                    LogPrintf("CPrivateSendServer::ChargeFees -- found uncooperative node (didn't sign), found offence\n");
-                    vecOffendersCollaterals.push_back(entry.txCollateral);
-                }
-            }
-        }
-    }
+    std::vector<CTransactionRef> vecOffendersCollaterals = GetOffendersCollaterals(session);
 
     // no offences found
     if(vecOffendersCollaterals.empty()) return;
@@ -442,9 +501,9 @@ void CPrivateSendServer::ChargeFees(CConnman* connman)
     //charge one of the offenders randomly
     std::random_shuffle(vecOffendersCollaterals.begin(), vecOffendersCollaterals.end());
 
-    if(nState == POOL_STATE_ACCEPTING_ENTRIES || nState == POOL_STATE_SIGNING) {
+    if(session.nState == POOL_STATE_ACCEPTING_ENTRIES || session.nState == POOL_STATE_SIGNING) {
         LogPrintf("CPrivateSendServer::ChargeFees -- found uncooperative node (didn't %s transaction), charging fees: %s\n",
-                (nState == POOL_STATE_SIGNING) ? "sign" : "send", vecOffendersCollaterals[0]->ToString());
+                (session.nState == POOL_STATE_SIGNING) ? "sign" : "send", vecOffendersCollaterals[0]->ToString());
 
         LOCK(cs_main);
 
@@ -464,6 +523,40 @@ void CPrivateSendServer::ChargeFees(CConnman* connman)
     }
 }
 
+std::vector<CTransactionRef> CPrivateSendServer::GetOffendersCollaterals(const CPrivateSendSession& session) const
+{
+    std::vector<CTransactionRef> vecOffendersCollaterals;
+
+    if(session.nState == POOL_STATE_ACCEPTING_ENTRIES) {
+        for (const auto& txCollateral : session.vecSessionCollaterals) {
+            bool fFound = false;
+            for (const auto& entry : session.vecEntries)
+                if(*entry.txCollateral == *txCollateral)
+                    fFound = true;
+
+            // This queue entry didn't send us the promised transaction
+            if(!fFound) {
+                LogPrintf("CPrivateSendServer::GetOffendersCollaterals -- found uncooperative node (didn't send transaction), found offence\n");
+                vecOffendersCollaterals.push_back(txCollateral);
+            }
+        }
+    }
+
+    if(session.nState == POOL_STATE_SIGNING) {
+        // who didn't sign?
+        for (const auto& entry : session.vecEntries) {
+            for (const auto& txdsin : entry.vecTxDSIn) {
+                if(!txdsin.fHasSig) {
+                    LogPrintf("CPrivateSendServer::GetOffendersCollaterals -- found uncooperative node (didn't sign), found offence\n");
+                    vecOffendersCollaterals.push_back(entry.txCollateral);
+                }
+            }
+        }
+    }
+
+    return vecOffendersCollaterals;
+}
+
 /*
     Charge the collateral randomly.
     Mixing is completely free, to pay miners we randomly pay the collateral of users.
@@ -476,13 +569,13 @@ void CPrivateSendServer::ChargeFees(CConnman* connman)
     stop these kinds of attacks 1 in 10 successful transactions are charged. This
     adds up to a cost of 0.001CHC per transaction on average.
 */
-void CPrivateSendServer::ChargeRandomFees(CConnman* connman)
+void CPrivateSendServer::ChargeRandomFees(CPrivateSendSession& session, CConnman* connman)
 {
     if(!fMasternodeMode) return;
 
     LOCK(cs_main);
 
-    for (const auto& txCollateral : vecSessionCollaterals) {
+    for (const auto& txCollateral : session.vecSessionCollaterals) {
         if(GetRandInt(100) > 10) return;
         LogPrintf("CPrivateSendServer::ChargeRandomFees -- charging random fees, txCollateral=%s", txCollateral->GetHash().ToString());
 
@@ -511,15 +604,23 @@ void CPrivateSendServer::CheckTimeout(CConnman* connman)
 
     CheckQueue();
 
-    int nTimeout = (nState == POOL_STATE_SIGNING) ? PRIVATESEND_SIGNING_TIMEOUT : PRIVATESEND_QUEUE_TIMEOUT;
-    bool fTimeout = GetTime() - nTimeLastSuccessfulStep >= nTimeout;
+    LOCK(cs_darksend);
+
+    for (auto& sessionpair : mapSessions) {
+        CPrivateSendSession& session = sessionpair.second;
+
+        int nTimeout = (session.nState == POOL_STATE_SIGNING) ? PRIVATESEND_SIGNING_TIMEOUT : PRIVATESEND_QUEUE_TIMEOUT;
+        bool fTimeout = GetTime() - session.nTimeLastSuccessfulStep >= nTimeout;
 
-    if(nState != POOL_STATE_IDLE && fTimeout) {
-        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckTimeout -- %s timed out (%ds) -- resetting\n",
-                (nState == POOL_STATE_SIGNING) ? "Signing" : "Session", nTimeout);
-        ChargeFees(connman);
-        SetNull();
+        if(session.nState != POOL_STATE_IDLE && fTimeout) {
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckTimeout -- %s timed out (%ds) -- resetting, nSessionID: %d\n",
+                    (session.nState == POOL_STATE_SIGNING) ? "Signing" : "Session", nTimeout, session.nSessionID);
+            ChargeFees(session, connman);
+            ResetSession(session);
+        }
     }
+
+    RemoveFinishedSessions();
 }
 
 /*
@@ -531,53 +632,38 @@ void CPrivateSendServer::CheckForCompleteQueue(CConnman* connman)
 {
     if(!fMasternodeMode) return;
 
-    if(nState == POOL_STATE_QUEUE && IsSessionReady()) {
-        SetState(POOL_STATE_ACCEPTING_ENTRIES);
+    LOCK(cs_darksend);
 
-        CDarksendQueue dsq(nSessionDenom, nSessionInputCount, activeMasternode.outpoint, GetAdjustedTime(), true);
-        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckForCompleteQueue -- queue is ready, signing and relaying (%s)\n", dsq.ToString());
-        dsq.Sign();
-        dsq.Relay(connman);
+    for (auto& sessionpair : mapSessions) {
+        CPrivateSendSession& session = sessionpair.second;
+
+        if(session.nState == POOL_STATE_QUEUE && session.IsReady()) {
+            SetState(session, POOL_STATE_ACCEPTING_ENTRIES);
+
+            CDarksendQueue dsq(session.nSessionDenom, session.nSessionInputCount, activeMasternode.outpoint, GetAdjustedTime(), true);
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CheckForCompleteQueue -- queue is ready, signing and relaying (%s)\n", dsq.ToString());
+            dsq.Sign();
+            dsq.Relay(connman);
+        }
     }
 }
 
 // Check to make sure a given input matches an input in the pool and its scriptSig is valid
-bool CPrivateSendServer::IsInputScriptSigValid(const CTxIn& txin)
+bool CPrivateSendServer::IsInputScriptSigValid(const CPrivateSendSession& session, const CTxIn& txin)
 {
-    CMutableTransaction txNew;
-    txNew.vin.clear();
-    txNew.vout.clear();
+    auto it = session.mapFinalTxInPos.find(txin.prevout);
+    if(it == session.mapFinalTxInPos.end() || !session.finalTransactionUnsigned) {
+        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+        return false;
+    }
 
-    int i = 0;
-    int nTxInIndex = -1;
-    CScript sigPubKey = CScript();
+    const CPrivateSendSession::CFinalTxInPos& pos = it->second;
+    const CScript& sigPubKey = session.vecEntries[pos.nEntry].vecTxDSIn[pos.nTxDSIn].prevPubKey;
     CAmount amount = CAmount();
 
-    for (const auto& entry : vecEntries) {
-
-        for (const auto& txout : entry.vecTxOut)
-            txNew.vout.push_back(txout);
-
-        for (const auto& txdsin : entry.vecTxDSIn) {
-            txNew.vin.push_back(txdsin);
-
-            if(txdsin.prevout == txin.prevout) {
-                nTxInIndex = i;
-                sigPubKey = txdsin.prevPubKey;
-            }
-            i++;
-        }
-    }
-
-    if(nTxInIndex >= 0) { //might have to do this one input at a time?
-        txNew.vin[nTxInIndex].scriptSig = txin.scriptSig;
-        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- verifying scriptSig %s\n", ScriptToAsmStr(txin.scriptSig).substr(0,24));
-        if(!VerifyScript(txNew.vin[nTxInIndex].scriptSig, sigPubKey, nullptr, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, MutableTransactionSignatureChecker(&txNew, nTxInIndex, amount))) {
-            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- VerifyScript() failed on input %d\n", nTxInIndex);
-            return false;
-        }
-    } else {
-        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- verifying scriptSig %s\n", ScriptToAsmStr(txin.scriptSig).substr(0,24));
+    if(!VerifyScript(txin.scriptSig, sigPubKey, nullptr, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, TransactionSignatureChecker(session.finalTransactionUnsigned.get(), pos.nTxIn, amount))) {
+        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::IsInputScriptSigValid -- VerifyScript() failed on input %d\n", pos.nTxIn);
         return false;
     }
 
@@ -588,7 +674,7 @@ bool CPrivateSendServer::IsInputScriptSigValid(const CTxIn& txin)
 //
 // Add a clients transaction to the pool
 //
-bool CPrivateSendServer::AddEntry(const CDarkSendEntry& entryNew, PoolMessage& nMessageIDRet)
+bool CPrivateSendServer::AddEntry(CPrivateSendSession& session, const CDarkSendEntry& entryNew, PoolMessage& nMessageIDRet)
 {
     if(!fMasternodeMode) return false;
 
@@ -606,7 +692,7 @@ bool CPrivateSendServer::AddEntry(const CDarkSendEntry& entryNew, PoolMessage& n
         return false;
     }
 
-    if(GetEntriesCount() >= CPrivateSend::GetMaxPoolTransactions()) {
+    if(session.GetEntriesCount() >= CPrivateSend::GetMaxPoolTransactions()) {
         LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddEntry -- entries is full!\n");
         nMessageIDRet = ERR_ENTRIES_FULL;
         return false;
@@ -614,78 +700,77 @@ bool CPrivateSendServer::AddEntry(const CDarkSendEntry& entryNew, PoolMessage& n
 
     for (const auto& txin : entryNew.vecTxDSIn) {
         LogPrint(BCLog::PRIVSEND, "looking for txin -- %s\n", txin.ToString());
-        for (const auto& entry : vecEntries) {
-            for (const auto& txdsin : entry.vecTxDSIn) {
-                if(txdsin.prevout == txin.prevout) {
-                    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddEntry -- found in txin\n");
-                    nMessageIDRet = ERR_ALREADY_HAVE;
-                    return false;
+        // inputs can't be mixed in two sessions at once either
+        for (const auto& sessionpair : mapSessions) {
+            for (const auto& entry : sessionpair.second.vecEntries) {
+                for (const auto& txdsin : entry.vecTxDSIn) {
+                    if(txdsin.prevout == txin.prevout) {
+                        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddEntry -- found in txin\n");
+                        nMessageIDRet = ERR_ALREADY_HAVE;
+                        return false;
+                    }
                 }
             }
         }
     }
 
-    vecEntries.push_back(entryNew);
+    session.vecEntries.push_back(entryNew);
 
-    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddEntry -- adding entry\n");
+    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddEntry -- adding entry, nSessionID: %d\n", session.nSessionID);
     nMessageIDRet = MSG_ENTRIES_ADDED;
-    nTimeLastSuccessfulStep = GetTime();
+    session.nTimeLastSuccessfulStep = GetTime();
 
     return true;
 }
 
-bool CPrivateSendServer::AddScriptSig(const CTxIn& txinNew)
+bool CPrivateSendServer::AddScriptSigs(CPrivateSendSession& session, const std::vector<CTxIn>& vecTxIn)
 {
-    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- scriptSig=%s\n", ScriptToAsmStr(txinNew.scriptSig).substr(0,24));
-
-    for (const auto& entry : vecEntries) {
-        for (const auto& txdsin : entry.vecTxDSIn) {
-            if(txdsin.scriptSig == txinNew.scriptSig) {
-                LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- already exists\n");
-                return false;
-            }
+    // verify the whole batch before touching the pool, a single bad signature rejects all of them
+    std::set<COutPoint> setSeen;
+    for (const auto& txin : vecTxIn) {
+        if(!setSeen.insert(txin.prevout).second) {
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSigs -- duplicate input %s\n", txin.prevout.ToStringShort());
+            return false;
         }
-    }
-
-    if(!IsInputScriptSigValid(txinNew)) {
-        LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- Invalid scriptSig\n");
-        return false;
-    }
-
-    LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- scriptSig=%s new\n", ScriptToAsmStr(txinNew.scriptSig).substr(0,24));
-
-    for (auto& txin : finalMutableTransaction.vin) {
-        if(txin.prevout == txinNew.prevout && txin.nSequence == txinNew.nSequence) {
-            txin.scriptSig = txinNew.scriptSig;
-            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- adding to finalMutableTransaction, scriptSig=%s\n", ScriptToAsmStr(txinNew.scriptSig).substr(0,24));
+        auto it = session.mapFinalTxInPos.find(txin.prevout);
+        if(it == session.mapFinalTxInPos.end()) {
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSigs -- input not in pool, %s\n", txin.ToString());
+            return false;
         }
-    }
-    for(int i = 0; i < GetEntriesCount(); i++) {
-        if(vecEntries[i].AddScriptSig(txinNew)) {
-            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSig -- adding to entries, scriptSig=%s\n", ScriptToAsmStr(txinNew.scriptSig).substr(0,24));
-            return true;
+        const CTxDSIn& txdsin = session.vecEntries[it->second.nEntry].vecTxDSIn[it->second.nTxDSIn];
+        if(txdsin.fHasSig || txdsin.nSequence != txin.nSequence) {
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSigs -- input already signed or sequence mismatch, %s\n", txin.prevout.ToStringShort());
+            return false;
+        }
+        if(!IsInputScriptSigValid(session, txin)) {
+            LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::AddScriptSigs -- Invalid scriptSig\n");
+            return false;
         }
     }
 
-    LogPrintf("CPrivateSendServer::AddScriptSig -- Couldn't set sig!\n" );
-    return false;
+    for (const auto& txin : vecTxIn) {
+        const CPrivateSendSession::CFinalTxInPos& pos = session.mapFinalTxInPos.at(txin.prevout);
+        CTxDSIn& txdsin = session.vecEntries[pos.nEntry].vecTxDSIn[pos.nTxDSIn];
+        session.finalMutableTransaction.vin[pos.nTxIn].scriptSig = txin.scriptSig;
+        txdsin.scriptSig = txin.scriptSig;
+        txdsin.fHasSig = true;
+        session.nFinalTxSignedCount++;
+    }
+
+    return true;
 }
 
 // Check to make sure everything is signed
-bool CPrivateSendServer::IsSignaturesComplete()
+bool CPrivateSendServer::IsSignaturesComplete(const CPrivateSendSession& session)
 {
-    for (const auto& entry : vecEntries)
-        for (const auto& txdsin : entry.vecTxDSIn)
-            if(!txdsin.fHasSig) return false;
-
-    return true;
+    return session.finalTransactionUnsigned && session.nFinalTxSignedCount >= session.finalMutableTransaction.vin.size();
 }
 
-bool CPrivateSendServer::IsOutputsCompatibleWithSessionDenom(const std::vector<CTxOut>& vecTxOut)
+bool CPrivateSendServer::IsOutputsCompatibleWithSessionDenom(const CPrivateSendSession& session, const std::vector<CTxOut>& vecTxOut)
 {
     if(CPrivateSend::GetDenominations(vecTxOut) == 0) return false;
 
-    for (const auto& entry : vecEntries) {
+    for (const auto& entry : session.vecEntries) {
         LogPrintf("CPrivateSendServer::IsOutputsCompatibleWithSessionDenom -- vecTxOut denom %d, entry.vecTxOut denom %d\n",
                 CPrivateSend::GetDenominations(vecTxOut), CPrivateSend::GetDenominations(entry.vecTxOut));
         if(CPrivateSend::GetDenominations(vecTxOut) != CPrivateSend::GetDenominations(entry.vecTxOut)) return false;
@@ -722,16 +807,9 @@ bool CPrivateSendServer::IsAcceptableDSA(const CDarksendAccept& dsa, PoolMessage
     return true;
 }
 
-bool CPrivateSendServer::CreateNewSession(const CDarksendAccept& dsa, PoolMessage& nMessageIDRet, CConnman* connman)
+bool CPrivateSendServer::CreateNewSession(const CDarksendAccept& dsa, const CService& addr, bool fMultiSession, PoolMessage& nMessageIDRet, CConnman* connman)
 {
-    if(!fMasternodeMode || nSessionID != 0) return false;
-
-    // new session can only be started in idle mode
-    if(nState != POOL_STATE_IDLE) {
-        nMessageIDRet = ERR_MODE;
-        LogPrintf("CPrivateSendServer::CreateNewSession -- incompatible mode: nState=%d\n", nState);
-        return false;
-    }
+    if(!fMasternodeMode) return false;
 
     if(!IsAcceptableDSA(dsa, nMessageIDRet)) {
         return false;
@@ -739,12 +817,14 @@ bool CPrivateSendServer::CreateNewSession(const CDarksendAccept& dsa, PoolMessag
 
     // start new session
     nMessageIDRet = MSG_NOERR;
-    nSessionID = GetRandInt(999999)+1;
-    nSessionDenom = dsa.nDenom;
-    nSessionInputCount = dsa.nInputCount;
+    int nNewSessionID;
+    do {
+        nNewSessionID = GetRandInt(999999)+1;
+    } while(mapSessions.count(nNewSessionID));
 
-    SetState(POOL_STATE_QUEUE);
-    nTimeLastSuccessfulStep = GetTime();
+    CPrivateSendSession& session = mapSessions.emplace(std::piecewise_construct,
+            std::forward_as_tuple(nNewSessionID),
+            std::forward_as_tuple(nNewSessionID, dsa.nDenom, dsa.nInputCount)).first->second;
 
     if(!fUnitTest) {
         //broadcast that I'm accepting entries, only if it's the first entry through
@@ -752,41 +832,44 @@ bool CPrivateSendServer::CreateNewSession(const CDarksendAccept& dsa, PoolMessag
         LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::CreateNewSession -- signing and relaying new queue: %s\n", dsq.ToString());
         dsq.Sign();
         dsq.Relay(connman);
-        vecDarksendQueue.push_back(dsq);
+        darksendQueueStore.Add(dsq);
     }
 
-    vecSessionCollaterals.push_back(MakeTransactionRef(dsa.txCollateral));
-    LogPrintf("CPrivateSendServer::CreateNewSession -- new session created, nSessionID: %d  nSessionDenom: %d (%s)  vecSessionCollaterals.size(): %d\n",
-            nSessionID, nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom), vecSessionCollaterals.size());
+    session.fLegacy = !fMultiSession;
+    session.vecSessionCollaterals.push_back(MakeTransactionRef(dsa.txCollateral));
+    session.setParticipants.insert(addr);
+    mapSessionByAddr[addr] = nNewSessionID;
+    LogPrintf("CPrivateSendServer::CreateNewSession -- new session created, nSessionID: %d  nSessionDenom: %d (%s)  vecSessionCollaterals.size(): %d  sessions: %d\n",
+            session.nSessionID, session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom), session.vecSessionCollaterals.size(), mapSessions.size());
 
     return true;
 }
 
-bool CPrivateSendServer::AddUserToExistingSession(const CDarksendAccept& dsa, PoolMessage& nMessageIDRet)
+bool CPrivateSendServer::AddUserToExistingSession(CPrivateSendSession& session, const CDarksendAccept& dsa, const CService& addr, bool fMultiSession, PoolMessage& nMessageIDRet)
 {
-    if(!fMasternodeMode || nSessionID == 0 || IsSessionReady()) return false;
+    if(!fMasternodeMode || session.IsReady()) return false;
 
     if(!IsAcceptableDSA(dsa, nMessageIDRet)) {
         return false;
     }
 
     // we only add new users to an existing session when we are in queue mode
-    if(nState != POOL_STATE_QUEUE) {
+    if(session.nState != POOL_STATE_QUEUE) {
         nMessageIDRet = ERR_MODE;
-        LogPrintf("CPrivateSendServer::AddUserToExistingSession -- incompatible mode: nState=%d\n", nState);
+        LogPrintf("CPrivateSendServer::AddUserToExistingSession -- incompatible mode: nState=%d\n", session.nState);
         return false;
     }
 
-    if(dsa.nDenom != nSessionDenom) {
+    if(dsa.nDenom != session.nSessionDenom) {
         LogPrintf("CPrivateSendServer::AddUserToExistingSession -- incompatible denom %d (%s) != nSessionDenom %d (%s)\n",
-                    dsa.nDenom, CPrivateSend::GetDenominationsToString(dsa.nDenom), nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom));
+                    dsa.nDenom, CPrivateSend::GetDenominationsToString(dsa.nDenom), session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom));
         nMessageIDRet = ERR_DENOM;
         return false;
     }
 
-    if(dsa.nInputCount != nSessionInputCount) {
+    if(dsa.nInputCount != session.nSessionInputCount) {
         LogPrintf("CPrivateSendServer::AddUserToExistingSession -- incompatible count %d != nSessionInputCount %d\n",
-                    dsa.nInputCount, nSessionInputCount);
+                    dsa.nInputCount, session.nSessionInputCount);
         nMessageIDRet = ERR_INVALID_INPUT_COUNT;
         return false;
     }
@@ -794,50 +877,56 @@ bool CPrivateSendServer::AddUserToExistingSession(const CDarksendAccept& dsa, Po
     // count new user as accepted to an existing session
 
     nMessageIDRet = MSG_NOERR;
-    nTimeLastSuccessfulStep = GetTime();
-    vecSessionCollaterals.push_back(MakeTransactionRef(dsa.txCollateral));
+    session.nTimeLastSuccessfulStep = GetTime();
+    session.fLegacy |= !fMultiSession;
+    session.vecSessionCollaterals.push_back(MakeTransactionRef(dsa.txCollateral));
+    session.setParticipants.insert(addr);
+    mapSessionByAddr[addr] = session.nSessionID;
 
     LogPrintf("CPrivateSendServer::AddUserToExistingSession -- new user accepted, nSessionID: %d  nSessionDenom: %d (%s)  nSessionInputCount: %d  vecSessionCollaterals.size(): %d\n",
-            nSessionID, nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom), nSessionInputCount, vecSessionCollaterals.size());
+            session.nSessionID, session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom), session.nSessionInputCount, session.vecSessionCollaterals.size());
 
     return true;
 }
 
-void CPrivateSendServer::RelayFinalTransaction(const CTransaction& txFinal, CConnman* connman)
+void CPrivateSendServer::RelayFinalTransaction(CPrivateSendSession& session, const CTransaction& txFinal, CConnman* connman)
 {
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::%s -- nSessionID: %d  nSessionDenom: %d (%s)\n",
-            __func__, nSessionID, nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom));
+            __func__, session.nSessionID, session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom));
 
     // final mixing tx with empty signatures should be relayed to mixing participants only
-    for (const auto entry : vecEntries) {
-        bool fOk = connman->ForNode(entry.addr, [&txFinal, &connman, this](CNode* pnode) {
+    for (const auto& entry : session.vecEntries) {
+        bool fOk = connman->ForNode(entry.addr, [&txFinal, &connman, &session](CNode* pnode) {
             CNetMsgMaker msgMaker(pnode->GetSendVersion());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSFINALTX, nSessionID, txFinal));
+            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSFINALTX, session.nSessionID, txFinal));
             return true;
         });
         if(!fOk) {
             // no such node? maybe this client disconnected or our own connection went down
-            RelayStatus(STATUS_REJECTED, connman);
+            RelayStatus(session, STATUS_REJECTED, connman);
             break;
         }
     }
 }
 
-void CPrivateSendServer::PushStatus(CNode* pnode, PoolStatusUpdate nStatusUpdate, PoolMessage nMessageID, CConnman* connman)
+void CPrivateSendServer::PushStatus(CNode* pnode, const CPrivateSendSession* psession, PoolStatusUpdate nStatusUpdate, PoolMessage nMessageID, CConnman* connman)
 {
     if(!pnode) return;
+    int nMsgSessionID = psession ? psession->nSessionID : 0;
+    int nMsgState = psession ? psession->nState : POOL_STATE_IDLE;
+    int nMsgEntriesCount = psession ? psession->GetEntriesCount() : 0;
     CNetMsgMaker msgMaker(pnode->GetSendVersion());
-    connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSSTATUSUPDATE, nSessionID, (int)nState, (int)vecEntries.size(), (int)nStatusUpdate, (int)nMessageID));
+    connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSSTATUSUPDATE, nMsgSessionID, nMsgState, nMsgEntriesCount, (int)nStatusUpdate, (int)nMessageID));
 }
 
-void CPrivateSendServer::RelayStatus(PoolStatusUpdate nStatusUpdate, CConnman* connman, PoolMessage nMessageID)
+void CPrivateSendServer::RelayStatus(CPrivateSendSession& session, PoolStatusUpdate nStatusUpdate, CConnman* connman, PoolMessage nMessageID)
 {
     unsigned int nDisconnected{};
     // status updates should be relayed to mixing participants only
-    for (const auto entry : vecEntries) {
+    for (const auto& entry : session.vecEntries) {
         // make sure everyone is still connected
-        bool fOk = connman->ForNode(entry.addr, [&nStatusUpdate, &nMessageID, &connman, this](CNode* pnode) {
-            PushStatus(pnode, nStatusUpdate, nMessageID, connman);
+        bool fOk = connman->ForNode(entry.addr, [&nStatusUpdate, &nMessageID, &connman, &session, this](CNode* pnode) {
+            PushStatus(pnode, &session, nStatusUpdate, nMessageID, connman);
             return true;
         });
         if(!fOk) {
@@ -849,44 +938,44 @@ void CPrivateSendServer::RelayStatus(PoolStatusUpdate nStatusUpdate, CConnman* c
 
     // smth went wrong
     LogPrintf("CPrivateSendServer::%s -- can't continue, %llu client(s) disconnected, nSessionID: %d  nSessionDenom: %d (%s)\n",
-            __func__, nDisconnected, nSessionID, nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom));
+            __func__, nDisconnected, session.nSessionID, session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom));
 
     // notify everyone else that this session should be terminated
-    for (const auto& entry : vecEntries) {
-        connman->ForNode(entry.addr, [&connman, this](CNode* pnode) {
-            PushStatus(pnode, STATUS_REJECTED, MSG_NOERR, connman);
+    for (const auto& entry : session.vecEntries) {
+        connman->ForNode(entry.addr, [&connman, &session, this](CNode* pnode) {
+            PushStatus(pnode, &session, STATUS_REJECTED, MSG_NOERR, connman);
             return true;
         });
     }
 
-    if(nDisconnected == vecEntries.size()) {
+    if(nDisconnected == session.vecEntries.size()) {
         // all clients disconnected, there is probably some issues with our own connection
-        // do not charge any fees, just reset the pool
-        SetNull();
+        // do not charge any fees, just reset the session
+        ResetSession(session);
     }
 }
 
-void CPrivateSendServer::RelayCompletedTransaction(PoolMessage nMessageID, CConnman* connman)
+void CPrivateSendServer::RelayCompletedTransaction(CPrivateSendSession& session, PoolMessage nMessageID, CConnman* connman)
 {
     LogPrint(BCLog::PRIVSEND, "CPrivateSendServer::%s -- nSessionID: %d  nSessionDenom: %d (%s)\n",
-            __func__, nSessionID, nSessionDenom, CPrivateSend::GetDenominationsToString(nSessionDenom));
+            __func__, session.nSessionID, session.nSessionDenom, CPrivateSend::GetDenominationsToString(session.nSessionDenom));
 
     // final mixing tx with empty signatures should be relayed to mixing participants only
-    for (const auto& entry : vecEntries) {
-        bool fOk = connman->ForNode(entry.addr, [&nMessageID, &connman, this](CNode* pnode) {
+    for (const auto& entry : session.vecEntries) {
+        bool fOk = connman->ForNode(entry.addr, [&nMessageID, &connman, &session](CNode* pnode) {
             CNetMsgMaker msgMaker(pnode->GetSendVersion());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSCOMPLETE, nSessionID, (int)nMessageID));
+            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::DSCOMPLETE, session.nSessionID, (int)nMessageID));
             return true;
         });
         if(!fOk) {
             // no such node? maybe client disconnected or our own connection went down
-            RelayStatus(STATUS_REJECTED, connman);
+            RelayStatus(session, STATUS_REJECTED, connman);
             break;
         }
     }
 }
 
-void CPrivateSendServer::SetState(PoolState nStateNew)
+void CPrivateSendServer::SetState(CPrivateSendSession& session, PoolState nStateNew)
 {
     if(!fMasternodeMode) return;
 
@@ -895,8 +984,34 @@ void CPrivateSendServer::SetState(PoolState nStateNew)
         return;
     }
 
-    LogPrintf("CPrivateSendServer::SetState -- nState: %d, nStateNew: %d\n", nState, nStateNew);
-    nState = nStateNew;
+    LogPrintf("CPrivateSendServer::SetState -- nSessionID: %d, nState: %d, nStateNew: %d\n", session.nSessionID, session.nState, nStateNew);
+    session.nState = nStateNew;
+}
+
+int CPrivateSendServer::GetSessionsCount() const
+{
+    LOCK(cs_darksend);
+    return mapSessions.size();
+}
+
+std::string CPrivateSendServer::GetStateString() const
+{
+    LOCK(cs_darksend);
+    PoolState nStateMax = POOL_STATE_IDLE;
+    for (const auto& sessionpair : mapSessions) {
+        nStateMax = std::max(nStateMax, sessionpair.second.nState);
+    }
+    return CPrivateSendBase::GetStateString(nStateMax);
+}
+
+int CPrivateSendServer::GetEntriesCount() const
+{
+    LOCK(cs_darksend);
+    int nCount = 0;
+    for (const auto& sessionpair : mapSessions) {
+        nCount += sessionpair.second.GetEntriesCount();
+    }
+    return nCount;
 }
 
 //TODO: Rename/move to core
@@ -5,63 +5,134 @@
 #ifndef PRIVATESENDSERVER_H
 #define PRIVATESENDSERVER_H
 
+#include <coins.h>
 #include <net.h>
 #include <privatesend.h>
 
+#include <map>
+#include <set>
+#include <unordered_map>
+
 class CPrivateSendServer;
 
+/** Maximum number of mixing sessions a masternode runs at the same time */
+static const int PRIVATESEND_SERVER_MAX_SESSIONS = 5;
+
 // The main object for accessing mixing
 extern CPrivateSendServer privateSendServer;
 
-/** Used to keep track of current status of mixing pool
+/** A single mixing session run by this masternode, every session has its own state machine
  */
-class CPrivateSendServer : public CPrivateSendBase
+class CPrivateSendSession
 {
-private:
+public:
+    /// Where an input of the final transaction came from
+    struct CFinalTxInPos
+    {
+        unsigned int nTxIn; // index in finalMutableTransaction.vin
+        size_t nEntry;      // index in vecEntries
+        size_t nTxDSIn;     // index in vecEntries[nEntry].vecTxDSIn
+    };
+
+    int nSessionID;
+    int nSessionDenom; //Users must submit an denom matching this
+    int nSessionInputCount; //Users must submit a count matching this
+
+    PoolState nState; // POOL_STATE_IDLE means the session is over and should be removed
+    bool fLegacy; // a participant can't tell sessions apart, no other session may run next to this one
+    int64_t nTimeLastSuccessfulStep; // the time when last successful mixing step was performed
+
+    std::vector<CDarkSendEntry> vecEntries;
+
     // Mixing uses collateral transactions to trust parties entering the pool
     // to behave honestly. If they don't it takes their money.
     std::vector<CTransactionRef> vecSessionCollaterals;
+    // Clients which were accepted into this session
+    std::set<CService> setParticipants;
+
+    CMutableTransaction finalMutableTransaction; // the finalized transaction ready for signing
+
+    // Built once in CreateFinalTransaction and used to verify every signature we receive.
+    // Signature hashes don't commit to other inputs' scriptSigs, so the unsigned transaction is enough.
+    std::unordered_map<COutPoint, CFinalTxInPos, SaltedOutpointHasher> mapFinalTxInPos;
+    CTransactionRef finalTransactionUnsigned;
+    size_t nFinalTxSignedCount;
+
+    CPrivateSendSession(int nSessionIDIn, int nSessionDenomIn, int nSessionInputCountIn) :
+        nSessionID(nSessionIDIn),
+        nSessionDenom(nSessionDenomIn),
+        nSessionInputCount(nSessionInputCountIn),
+        nState(POOL_STATE_QUEUE),
+        fLegacy(false),
+        nTimeLastSuccessfulStep(GetTime()),
+        nFinalTxSignedCount(0)
+        {}
+
+    /// Do we have enough users to take entries?
+    bool IsReady() const { return (int)vecSessionCollaterals.size() >= CPrivateSend::GetMaxPoolTransactions(); }
+    bool IsFinished() const { return nState == POOL_STATE_IDLE; }
+    int GetEntriesCount() const { return vecEntries.size(); }
+};
+
+/** Used to keep track of current status of mixing pool
+ */
+class CPrivateSendServer : public CPrivateSendBase
+{
+protected:
+    // Sessions in progress, indexed by session id
+    std::map<int, CPrivateSendSession> mapSessions;
+    // The session every participating client belongs to
+    std::map<CService, int> mapSessionByAddr;
 
     bool fUnitTest;
 
+    CPrivateSendSession* GetSession(const CService& addr);
+    /// Find a session in queue mode a new user with this dsa could join
+    CPrivateSendSession* FindSessionToJoin(const CDarksendAccept& dsa, bool fMultiSession);
+    /// Can a session for this user be started next to the ones in progress?
+    bool CanCreateSession(bool fMultiSession) const;
+    /// Mark the session as finished, it is removed by RemoveFinishedSessions
+    void ResetSession(CPrivateSendSession& session);
+    void RemoveFinishedSessions();
+
     /// Add a clients entry to the pool
-    bool AddEntry(const CDarkSendEntry& entryNew, PoolMessage& nMessageIDRet);
-    /// Add signature to a txin
-    bool AddScriptSig(const CTxIn& txin);
+    bool AddEntry(CPrivateSendSession& session, const CDarkSendEntry& entryNew, PoolMessage& nMessageIDRet);
+    /// Add signatures to txins, all of them are verified first and only added if every one is valid
+    bool AddScriptSigs(CPrivateSendSession& session, const std::vector<CTxIn>& vecTxIn);
 
+    /// Collaterals of the users who didn't send their entry or didn't sign
+    std::vector<CTransactionRef> GetOffendersCollaterals(const CPrivateSendSession& session) const;
     /// Charge fees to bad actors (Charge clients a fee if they're abusive)
-    void ChargeFees(CConnman* connman);
+    void ChargeFees(CPrivateSendSession& session, CConnman* connman);
     /// Rarely charge fees to pay miners
-    void ChargeRandomFees(CConnman* connman);
+    void ChargeRandomFees(CPrivateSendSession& session, CConnman* connman);
 
     /// Check for process
-    void CheckPool(CConnman* connman);
+    void CheckPool(CPrivateSendSession& session, CConnman* connman);
 
-    void CreateFinalTransaction(CConnman* connman);
-    void CommitFinalTransaction(CConnman* connman);
+    void CreateFinalTransaction(CPrivateSendSession& session, CConnman* connman);
+    void CommitFinalTransaction(CPrivateSendSession& session, CConnman* connman);
 
     /// Is this nDenom and txCollateral acceptable?
     bool IsAcceptableDSA(const CDarksendAccept& dsa, PoolMessage &nMessageIDRet);
-    bool CreateNewSession(const CDarksendAccept& dsa, PoolMessage &nMessageIDRet, CConnman* connman);
-    bool AddUserToExistingSession(const CDarksendAccept& dsa, PoolMessage &nMessageIDRet);
-    /// Do we have enough users to take entries?
-    bool IsSessionReady() { return (int)vecSessionCollaterals.size() >= CPrivateSend::GetMaxPoolTransactions(); }
+    bool CreateNewSession(const CDarksendAccept& dsa, const CService& addr, bool fMultiSession, PoolMessage &nMessageIDRet, CConnman* connman);
+    bool AddUserToExistingSession(CPrivateSendSession& session, const CDarksendAccept& dsa, const CService& addr, bool fMultiSession, PoolMessage &nMessageIDRet);
 
     /// Check that all inputs are signed. (Are all inputs signed?)
-    bool IsSignaturesComplete();
+    bool IsSignaturesComplete(const CPrivateSendSession& session);
     /// Check to make sure a given input matches an input in the pool and its scriptSig is valid
-    bool IsInputScriptSigValid(const CTxIn& txin);
+    bool IsInputScriptSigValid(const CPrivateSendSession& session, const CTxIn& txin);
     /// Are these outputs compatible with other client in the pool?
-    bool IsOutputsCompatibleWithSessionDenom(const std::vector<CTxOut>& vecTxOut);
+    bool IsOutputsCompatibleWithSessionDenom(const CPrivateSendSession& session, const std::vector<CTxOut>& vecTxOut);
 
     // Set the 'state' value, with some logging and capturing when the state changed
-    void SetState(PoolState nStateNew);
+    void SetState(CPrivateSendSession& session, PoolState nStateNew);
 
     /// Relay mixing Messages
-    void RelayFinalTransaction(const CTransaction& txFinal, CConnman* connman);
-    void PushStatus(CNode* pnode, PoolStatusUpdate nStatusUpdate, PoolMessage nMessageID, CConnman* connman);
-    void RelayStatus(PoolStatusUpdate nStatusUpdate, CConnman* connman, PoolMessage nMessageID = MSG_NOERR);
-    void RelayCompletedTransaction(PoolMessage nMessageID, CConnman* connman);
+    void RelayFinalTransaction(CPrivateSendSession& session, const CTransaction& txFinal, CConnman* connman);
+    void PushStatus(CNode* pnode, const CPrivateSendSession* psession, PoolStatusUpdate nStatusUpdate, PoolMessage nMessageID, CConnman* connman);
+    void RelayStatus(CPrivateSendSession& session, PoolStatusUpdate nStatusUpdate, CConnman* connman, PoolMessage nMessageID = MSG_NOERR);
+    void RelayCompletedTransaction(CPrivateSendSession& session, PoolMessage nMessageID, CConnman* connman);
 
     void SetNull();
 
@@ -73,6 +144,12 @@ public:
 
     void CheckTimeout(CConnman* connman);
     void CheckForCompleteQueue(CConnman* connman);
+
+    int GetSessionsCount() const;
+    /// The most advanced state of all sessions
+    std::string GetStateString() const override;
+    /// Entries of all sessions
+    int GetEntriesCount() const override;
 };
 
 void ThreadCheckPrivateSendServer(CConnman& connman);
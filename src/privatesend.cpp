@@ -136,6 +136,43 @@ bool CDarksendBroadcastTx::IsExpired(int nHeight)
     return (nConfirmedHeight != -1) && (nHeight - nConfirmedHeight > 24);
 }
 
+void CDarksendQueueStore::Add(const CDarksendQueue& dsq)
+{
+    uint256 hash = dsq.GetSignatureHash();
+    if(!mapQueues.emplace(hash, dsq).second) return;
+
+    mapQueuesByTime.emplace(dsq.nTime, hash);
+    mapQueueCountByMasternode[dsq.masternodeOutpoint]++;
+}
+
+void CDarksendQueueStore::RemoveExpired()
+{
+    // queues are sorted by time, so stop at the first one which is still valid
+    auto it = mapQueuesByTime.begin();
+    while(it != mapQueuesByTime.end()) {
+        auto itQueue = mapQueues.find(it->second);
+        if(!itQueue->second.IsExpired()) break;
+
+        LogPrint(BCLog::PRIVSEND, "CDarksendQueueStore::%s -- Removing expired queue (%s)\n", __func__, itQueue->second.ToString());
+        auto itCount = mapQueueCountByMasternode.find(itQueue->second.masternodeOutpoint);
+        if(--itCount->second == 0) {
+            mapQueueCountByMasternode.erase(itCount);
+        }
+        mapQueues.erase(itQueue);
+        mapQueuesByTime.erase(it++);
+    }
+}
+
+std::vector<CDarksendQueue*> CDarksendQueueStore::GetQueues()
+{
+    std::vector<CDarksendQueue*> vecQueues;
+    vecQueues.reserve(mapQueues.size());
+    for (const auto& pair : mapQueuesByTime) {
+        vecQueues.push_back(&mapQueues.at(pair.second));
+    }
+    return vecQueues;
+}
+
 void CPrivateSendBase::SetNull()
 {
     // Both sides
@@ -155,18 +192,12 @@ void CPrivateSendBase::CheckQueue()
     if(!lockDS) return; // it's ok to fail here, we run this quite frequently
 
     // check mixing queue objects for timeouts
-    std::vector<CDarksendQueue>::iterator it = vecDarksendQueue.begin();
-    while(it != vecDarksendQueue.end()) {
-        if((*it).IsExpired()) {
-            LogPrint(BCLog::PRIVSEND, "CPrivateSendBase::%s -- Removing expired queue (%s)\n", __func__, (*it).ToString());
-            it = vecDarksendQueue.erase(it);
-        } else ++it;
-    }
+    darksendQueueStore.RemoveExpired();
 }
 
-std::string CPrivateSendBase::GetStateString() const
+std::string CPrivateSendBase::GetStateString(PoolState nStateIn)
 {
-    switch(nState) {
+    switch(nStateIn) {
         case POOL_STATE_IDLE:                   return "IDLE";
         case POOL_STATE_CONNECTING:             return "CONNECTING";
         case POOL_STATE_QUEUE:                  return "QUEUE";
@@ -180,7 +211,8 @@ std::string CPrivateSendBase::GetStateString() const
 
 // Definitions for static data members
 std::vector<CAmount> CPrivateSend::vecStandardDenominations;
-std::map<uint256, CDarksendBroadcastTx> CPrivateSend::mapDSTX;
+std::unordered_map<uint256, CDarksendBroadcastTx, SaltedTxidHasher> CPrivateSend::mapDSTX;
+std::map<int, std::set<uint256> > CPrivateSend::mapDSTXByConfirmedHeight;
 CCriticalSection CPrivateSend::cs_mapdstx;
 
 void CPrivateSend::InitStandardDenominations()
@@ -418,13 +450,23 @@ CDarksendBroadcastTx CPrivateSend::GetDSTX(const uint256& hash)
 void CPrivateSend::CheckDSTXes(int nHeight)
 {
     LOCK(cs_mapdstx);
-    std::map<uint256, CDarksendBroadcastTx>::iterator it = mapDSTX.begin();
-    while(it != mapDSTX.end()) {
-        if (it->second.IsExpired(nHeight)) {
-            mapDSTX.erase(it++);
-        } else {
-            ++it;
+    // only confirmed dstxes expire, the oldest confirmations come first
+    auto itHeight = mapDSTXByConfirmedHeight.begin();
+    while(itHeight != mapDSTXByConfirmedHeight.end()) {
+        // all dstxes of a bucket were confirmed at the same height
+        bool fExpired = true;
+        for (const auto& hash : itHeight->second) {
+            auto it = mapDSTX.find(hash);
+            if (it == mapDSTX.end()) continue;
+            fExpired = it->second.IsExpired(nHeight);
+            break;
+        }
+        if (!fExpired) break;
+
+        for (const auto& hash : itHeight->second) {
+            mapDSTX.erase(hash);
         }
+        mapDSTXByConfirmedHeight.erase(itHeight++);
     }
     LogPrint(BCLog::PRIVSEND, "CPrivateSend::CheckDSTXes -- mapDSTX.size()=%llu\n", mapDSTX.size());
 }
@@ -443,10 +485,24 @@ void CPrivateSend::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex
     if (tx.IsCoinBase()) return;
 
     uint256 txHash = tx.GetHash();
-    if (!mapDSTX.count(txHash)) return;
+    auto it = mapDSTX.find(txHash);
+    if (it == mapDSTX.end()) return;
+
+    // move it to the bucket of its new confirmation height
+    int nHeightOld = it->second.GetConfirmedHeight();
+    if (nHeightOld != -1) {
+        auto itHeight = mapDSTXByConfirmedHeight.find(nHeightOld);
+        if (itHeight != mapDSTXByConfirmedHeight.end()) {
+            itHeight->second.erase(txHash);
+            if (itHeight->second.empty()) mapDSTXByConfirmedHeight.erase(itHeight);
+        }
+    }
 
     // When tx is 0-confirmed or conflicted, pindes is nullptr and nConfirmedHeight should be set to -1
-    mapDSTX[txHash].SetConfirmedHeight(pindex == nullptr ? -1 : pindex->nHeight);
+    it->second.SetConfirmedHeight(pindex == nullptr ? -1 : pindex->nHeight);
+    if (pindex != nullptr) {
+        mapDSTXByConfirmedHeight[pindex->nHeight].insert(txHash);
+    }
     LogPrint(BCLog::PRIVSEND, "CPrivateSendClient::SyncTransaction -- txid=%s\n", txHash.ToString());
 }
 
@@ -457,6 +513,26 @@ void CPrivateSend::TransactionAddedToMempool(const CTransactionRef& ptx) {
 
 }
 
+void CPrivateSend::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted)
+{
+    LOCK(cs_mapdstx);
+    for (const auto& tx : vtxConflicted) {
+        SyncTransaction(tx, nullptr, -1);
+    }
+
+    for (size_t i = 0; i < pblock->vtx.size(); i++) {
+        SyncTransaction(pblock->vtx[i], pindex, i);
+    }
+}
+
+void CPrivateSend::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs_mapdstx);
+    for (const auto& tx : pblock->vtx) {
+        SyncTransaction(tx, nullptr, -1);
+    }
+}
+
 //TODO: Rename/move to core
 void ThreadCheckPrivateSend(CConnman& connman)
 {
@@ -7,11 +7,17 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <coins.h>
 #include <primitives/transaction.h>
 #include <pubkey.h>
 #include <sync.h>
 #include <tinyformat.h>
 #include <timedata.h>
+#include <txmempool.h>
+
+#include <map>
+#include <set>
+#include <unordered_map>
 
 class CPrivateSend;
 class CConnman;
@@ -24,6 +30,9 @@ static const int PRIVATESEND_SIGNING_TIMEOUT        = 30;
 
 //! minimum peer version accepted by mixing pool
 static const int MIN_PRIVATESEND_PEER_PROTO_VERSION = 70015;
+//! clients from this version on only submit to the ready queue of their own session,
+//! a masternode doesn't run any other session next to one with an older client
+static const int MIN_PRIVATESEND_MULTI_SESSION_PROTO_VERSION = 70016;
 
 static const size_t PRIVATESEND_ENTRY_MAX_SIZE      = 9;
 
@@ -308,9 +317,32 @@ public:
     bool CheckSignature(const CPubKey& pubKeyMasternode) const;
 
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
+    int GetConfirmedHeight() const { return nConfirmedHeight; }
     bool IsExpired(int nHeight);
 };
 
+/** Mixing queues seen on the network, indexed by hash for duplicate checks,
+ *  by masternode for rate checks and by time for expiry.
+ */
+class CDarksendQueueStore
+{
+private:
+    std::unordered_map<uint256, CDarksendQueue, SaltedTxidHasher> mapQueues;
+    // queue hashes ordered by nTime, the oldest queues expire first
+    std::multimap<int64_t, uint256> mapQueuesByTime;
+    // number of queues we have from every masternode
+    std::unordered_map<COutPoint, int, SaltedOutpointHasher> mapQueueCountByMasternode;
+
+public:
+    bool Has(const CDarksendQueue& dsq) const { return mapQueues.count(dsq.GetSignatureHash()); }
+    bool HasQueueFromMasternode(const COutPoint& outpoint) const { return mapQueueCountByMasternode.count(outpoint); }
+    void Add(const CDarksendQueue& dsq);
+    void RemoveExpired();
+    /// All queues, oldest first
+    std::vector<CDarksendQueue*> GetQueues();
+    size_t size() const { return mapQueues.size(); }
+};
+
 // base class
 class CPrivateSendBase
 {
@@ -318,7 +350,7 @@ protected:
     mutable CCriticalSection cs_darksend;
 
     // The current mixing sessions in progress on the network
-    std::vector<CDarksendQueue> vecDarksendQueue;
+    CDarksendQueueStore darksendQueueStore;
 
     std::vector<CDarkSendEntry> vecEntries; // Masternode/clients entries
 
@@ -337,12 +369,14 @@ public:
     int nSessionInputCount; //Users must submit a count matching this
 
     CPrivateSendBase() { SetNull(); }
+    virtual ~CPrivateSendBase() {}
 
-    int GetQueueSize() const { return vecDarksendQueue.size(); }
+    int GetQueueSize() const { return darksendQueueStore.size(); }
     int GetState() const { return nState; }
-    std::string GetStateString() const;
+    static std::string GetStateString(PoolState nStateIn);
+    virtual std::string GetStateString() const { return GetStateString(nState); }
 
-    int GetEntriesCount() const { return vecEntries.size(); }
+    virtual int GetEntriesCount() const { return vecEntries.size(); }
 };
 
 // helper class
@@ -359,7 +393,9 @@ private:
 
     // static members
     static std::vector<CAmount> vecStandardDenominations;
-    static std::map<uint256, CDarksendBroadcastTx> mapDSTX;
+    static std::unordered_map<uint256, CDarksendBroadcastTx, SaltedTxidHasher> mapDSTX;
+    // hashes of confirmed dstxes by confirmation height, they expire a fixed number of blocks later
+    static std::map<int, std::set<uint256> > mapDSTXByConfirmedHeight;
 
     static CCriticalSection cs_mapdstx;
 
@@ -403,6 +439,8 @@ public:
 
     static void UpdatedBlockTip(const CBlockIndex *pindex);
     static void TransactionAddedToMempool(const CTransactionRef& tx);
+    static void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted);
+    static void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock);
 };
 
 void ThreadCheckPrivateSend(CConnman& connman);
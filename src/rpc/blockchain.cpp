@@ -10,10 +10,12 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinstats.h>
 #include <core_io.h>
 #include <consensus/validation.h>
 #include <validation.h>
 #include <hash.h>
+#include <net.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
@@ -22,6 +24,7 @@
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txoutsnapshot.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <hash.h>
@@ -872,9 +875,18 @@ UniValue getblock(const JSONRPCRequest& request)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    if ((fHavePruned || fHaveSnapshot) && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    if (verbosity <= 0 && IsRawBlockSerialization(pblockindex, RPCSerializationFlags(), Params().GetConsensus()))
+    {
+        // The stored block is what we'd return, no need to deserialize it
+        std::vector<uint8_t> vRawBlock;
+        if (!ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        return HexStr(vRawBlock.begin(), vRawBlock.end());
+    }
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -894,77 +906,6 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1016,38 +957,60 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless hash_type is muhash or none and the statistics are tracked (-trackcoinstats).\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"  (string, optional, default=hash_serialized_2) Which UTXO set hash to compute: 'hash_serialized_2', 'muhash' or 'none'\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (only when the UTXO set was read)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_type hash_serialized_2)\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash3072 of the unspent outputs (only with hash_type muhash)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED;
+    if (!request.params[0].isNull()) {
+        const std::string& strHashType = request.params[0].get_str();
+        if (strHashType == "muhash") {
+            hash_type = CoinStatsHashType::MUHASH;
+        } else if (strHashType == "none") {
+            hash_type = CoinStatsHashType::NONE;
+        } else if (strHashType != "hash_serialized_2") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+        }
+    }
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    if (GetUTXOStats(pcoinsdbview.get(), stats, hash_type)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+        if (!stats.fTracked) {
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+        }
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        }
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
@@ -1056,6 +1019,184 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set to a snapshot file, which loadtxoutset can load.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) The snapshot file, relative to the data directory if not absolute. It must not exist yet.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,          (numeric) The number of unspent transaction outputs written\n"
+            "  \"base_hash\": \"hash\",        (string) The hash of the block the snapshot is at\n"
+            "  \"base_height\": n,            (numeric) The height of that block\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, as reported by gettxoutsetinfo\n"
+            "  \"path\": \"path\"              (string) The absolute path of the snapshot file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    FlushStateToDisk();
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CSnapshotMetadata metadata;
+    {
+        LOCK(cs_main);
+        pcursor.reset(pcoinsdbview->Cursor());
+        const CBlockIndex* pindexBase = mapBlockIndex.find(pcursor->GetBestBlock())->second;
+        metadata.hashBlock = pindexBase->GetBlockHash();
+        metadata.nHeight = pindexBase->nHeight;
+        metadata.nChainTx = pindexBase->nChainTx;
+    }
+
+    uint64_t nCoins;
+    uint256 hashSerialized;
+    if (!DumpUTXOSnapshot(pcursor.get(), metadata, path, nCoins, hashSerialized))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write the UTXO snapshot");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", nCoins));
+    ret.push_back(Pair("base_hash", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", metadata.nHeight));
+    ret.push_back(Pair("hash_serialized_2", hashSerialized.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "loadtxoutset \"path\" \"hash_serialized_2\"\n"
+            "\nReplace the unspent transaction output set with a snapshot written by dumptxoutset and make its block\n"
+            "the tip of the active chain, without downloading or validating the blocks before it.\n"
+            "The block must be known from the headers, and the active chain must not have reached it yet.\n"
+            "Blocks before the snapshot are treated like pruned blocks, they are neither kept nor served to peers.\n"
+            "NODE_NETWORK stops being offered, peers which need the earlier blocks have to get them elsewhere.\n"
+            "Not available with -txindex: the transactions before the snapshot would never be indexed. This rules out\n"
+            "masternodes, which need -txindex to check governance collaterals; they still have to sync the whole chain.\n"
+            "The node is busy while the coins are written, progress is logged and a shutdown aborts the load, after which\n"
+            "the chainstate has to be rebuilt with -reindex-chainstate.\n"
+            "\nArguments:\n"
+            "1. \"path\"               (string, required) The snapshot file, relative to the data directory if not absolute\n"
+            "2. \"hash_serialized_2\"  (string, required) The hash_serialized_2 reported by gettxoutsetinfo on a trusted node\n"
+            "                          at the snapshot block. The snapshot is rejected if its hash doesn't match.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,      (numeric) The number of unspent transaction outputs loaded\n"
+            "  \"bestblock\": \"hash\",   (string) The hash of the block at the tip of the chain\n"
+            "  \"height\": n             (numeric) The current block height\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\" \"hash\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", \"hash\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    uint256 hashExpected = ParseHashV(request.params[1], "hash_serialized_2");
+
+    uint64_t nCoins = 0;
+    std::string strError;
+    if (!LoadUTXOSnapshot(Params(), path, hashExpected, nCoins, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    // The blocks before the snapshot base can't be served anymore
+    if (g_connman) {
+        g_connman->SetLocalServices(ServiceFlags(g_connman->GetLocalServices() & ~NODE_NETWORK));
+    }
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_loaded", nCoins));
+    ret.push_back(Pair("bestblock", chainActive.Tip()->GetBlockHash().GetHex()));
+    ret.push_back(Pair("height", chainActive.Height()));
+    return ret;
+}
+
+static UniValue DBInfoToJSON(const CDBWrapper& db)
+{
+    const CDBOptions& dboptions = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("blockcache", (uint64_t)dboptions.nBlockCacheSize));
+    options.push_back(Pair("writebuffer", (uint64_t)dboptions.nWriteBufferSize));
+    options.push_back(Pair("maxopenfiles", dboptions.nMaxOpenFiles));
+    options.push_back(Pair("bloombits", dboptions.nBloomBits));
+    options.push_back(Pair("compression", dboptions.fCompression));
+
+    uint64_t nHits = db.GetBlockCacheHits();
+    uint64_t nMisses = db.GetBlockCacheMisses();
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("usage", (uint64_t)db.GetBlockCacheUsage()));
+    cache.push_back(Pair("hits", nHits));
+    cache.push_back(Pair("misses", nMisses));
+    cache.push_back(Pair("hitrate", nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+
+    UniValue levels(UniValue::VARR);
+    std::string strValue;
+    for (int nLevel = 0; db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue); nLevel++) {
+        levels.push_back(atoi(strValue));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("options", options));
+    ret.push_back(Pair("blockcache", cache));
+    if (db.GetProperty("leveldb.approximate-memory-usage", strValue)) {
+        ret.push_back(Pair("memory_usage", atoi64(strValue)));
+    }
+    ret.push_back(Pair("files_per_level", levels));
+    if (db.GetProperty("leveldb.stats", strValue)) {
+        ret.push_back(Pair("compaction_stats", strValue));
+    }
+    return ret;
+}
+
+UniValue getdbinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getdbinfo\n"
+            "\nReturns the settings and LevelDB statistics of the chainstate and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {              (json object) The chainstate database\n"
+            "    \"options\": {               (json object) The options the database was opened with\n"
+            "      \"blockcache\": n,         (numeric) Block cache size in bytes\n"
+            "      \"writebuffer\": n,        (numeric) Write buffer size in bytes\n"
+            "      \"maxopenfiles\": n,       (numeric) Maximum number of open table files\n"
+            "      \"bloombits\": n,          (numeric) Bloom filter bits per key\n"
+            "      \"compression\": true|false (boolean) Whether table blocks are compressed\n"
+            "    },\n"
+            "    \"blockcache\": {\n"
+            "      \"usage\": n,              (numeric) Bytes held by the block cache\n"
+            "      \"hits\": n,               (numeric) Block cache lookups which found the block\n"
+            "      \"misses\": n,             (numeric) Block cache lookups which read from disk\n"
+            "      \"hitrate\": x.xxx         (numeric) hits / (hits + misses)\n"
+            "    },\n"
+            "    \"memory_usage\": n,         (numeric) Approximate memory used by the database\n"
+            "    \"files_per_level\": [n,...], (array) Number of table files at each level\n"
+            "    \"compaction_stats\": \"str\"  (string) LevelDB's per level size and compaction statistics\n"
+            "  },\n"
+            "  \"blockindex\": {...}          (json object) The block index (and txindex) database, same fields\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbinfo", "")
+            + HelpExampleRpc("getdbinfo", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("chainstate", DBInfoToJSON(pcoinsdbview->GetDB())));
+    ret.push_back(Pair("blockindex", DBInfoToJSON(*pblocktree)));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1743,7 +1884,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
+    { "blockchain",         "getdbinfo",              &getdbinfo,              {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path","hash_serialized_2"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
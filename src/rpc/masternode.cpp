@@ -100,6 +100,9 @@ UniValue getpoolinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("queue",             pprivateSendBase->GetQueueSize()));
     obj.push_back(Pair("entries",           pprivateSendBase->GetEntriesCount()));
     obj.push_back(Pair("status",            privateSendClient.GetStatus()));
+    if (fMasternodeMode) {
+        obj.push_back(Pair("sessions",      privateSendServer.GetSessionsCount()));
+    }
 
     masternode_info_t mnInfo;
     if (privateSendClient.GetMixingMasternodeInfo(mnInfo)) {
@@ -117,6 +120,7 @@ UniValue getpoolinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("state",             privateSendServer.GetStateString()));
     obj.push_back(Pair("queue",             privateSendServer.GetQueueSize()));
     obj.push_back(Pair("entries",           privateSendServer.GetEntriesCount()));
+    obj.push_back(Pair("sessions",          privateSendServer.GetSessionsCount()));
 #endif // ENABLE_WALLET
 
     return obj;
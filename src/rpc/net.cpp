@@ -6,6 +6,7 @@
 
 #include <rpc/server.h>
 
+#include <blockpayloadcache.h>
 #include <chainparams.h>
 #include <clientversion.h>
 #include <core_io.h>
@@ -111,6 +112,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"proctime_per_msg\": {\n"
+            "       \"addr\": n,              (numeric) The total time spent processing received messages in microseconds, aggregated by message type\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -186,6 +191,13 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue procPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapProcessMicrosPerMsgCmd) {
+            if (i.second > 0)
+                procPerMsgCmd.push_back(Pair(i.first, i.second));
+        }
+        obj.push_back(Pair("proctime_per_msg", procPerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -369,6 +381,14 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"blockcache\":                (cache of serialized blocks served to peers)\n"
+            "  {\n"
+            "    \"entries\": n,     (numeric) Number of cached blocks\n"
+            "    \"usage\": n,       (numeric) Memory used by the cache in bytes\n"
+            "    \"maxsize\": n,     (numeric) Maximum size of the cache in bytes\n"
+            "    \"hits\": n,        (numeric) Number of requested blocks sent from the cache\n"
+            "    \"misses\": n       (numeric) Number of requested blocks read from disk\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -391,9 +411,117 @@ UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    CBlockPayloadCacheStats cacheStats = blockPayloadCache.GetStats();
+    UniValue blockCache(UniValue::VOBJ);
+    blockCache.push_back(Pair("entries", (uint64_t)cacheStats.nEntries));
+    blockCache.push_back(Pair("usage", (uint64_t)cacheStats.nUsage));
+    blockCache.push_back(Pair("maxsize", (uint64_t)cacheStats.nMaxSize));
+    blockCache.push_back(Pair("hits", cacheStats.nHits));
+    blockCache.push_back(Pair("misses", cacheStats.nMisses));
+    obj.push_back(Pair("blockcache", blockCache));
+    return obj;
+}
+
+UniValue getdsmessagequeueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getdsmessagequeueinfo\n"
+            "\nReturns information about the queue of masternode, governance and PrivateSend messages.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,           (numeric) Number of worker threads, 0 if messages are processed on the message handler thread\n"
+            "  \"depth\": n,             (numeric) Number of messages waiting to be processed\n"
+            "  \"peers\": n,             (numeric) Number of peers with queued or in-flight messages\n"
+            "  \"processed\": n,         (numeric) Total number of processed messages\n"
+            "  \"throttled\": n,         (numeric) Number of times processing of a peer's messages was held back because the queue was full\n"
+            "  \"avgwaittime\": n,       (numeric) Average time a message spent in the queue in microseconds\n"
+            "  \"maxwaittime\": n,       (numeric) Maximum time a message spent in the queue in microseconds\n"
+            "  \"avgprocesstime\": n,    (numeric) Average time to process a message in microseconds\n"
+            "  \"maxprocesstime\": n     (numeric) Maximum time to process a message in microseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdsmessagequeueinfo", "")
+            + HelpExampleRpc("getdsmessagequeueinfo", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    CDSMessageQueueStats stats = g_connman->GetDSMessageQueueStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("threads", stats.nThreads));
+    obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+    obj.push_back(Pair("peers", (uint64_t)stats.nPeers));
+    obj.push_back(Pair("processed", stats.nProcessed));
+    obj.push_back(Pair("throttled", stats.nThrottled));
+    obj.push_back(Pair("avgwaittime", stats.nProcessed ? stats.nTotalWaitMicros / (int64_t)stats.nProcessed : 0));
+    obj.push_back(Pair("maxwaittime", stats.nMaxWaitMicros));
+    obj.push_back(Pair("avgprocesstime", stats.nProcessed ? stats.nTotalProcessMicros / (int64_t)stats.nProcessed : 0));
+    obj.push_back(Pair("maxprocesstime", stats.nMaxProcessMicros));
     return obj;
 }
 
+UniValue getnetmsgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getnetmsgstats ( reset )\n"
+            "\nReturns the processing cost of received messages, aggregated by message type.\n"
+            "Times are in microseconds, message types which were never received are omitted.\n"
+            "\nArguments:\n"
+            "1. reset          (boolean, optional, default=false) Reset the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"mnp\": {                   (object) Message type\n"
+            "    \"count\": n,              (numeric) Number of processed messages\n"
+            "    \"bytes\": n,              (numeric) Total size of the messages including headers\n"
+            "    \"queuetime\": n,          (numeric) Total time between reception and start of processing\n"
+            "    \"handlertime\": n,        (numeric) Total time spent in the message handler\n"
+            "    \"maxhandlertime\": n,     (numeric) Longest time spent in the message handler\n"
+            "    \"cs_main_wait\": n,       (numeric) Total time the message handler waited for cs_main\n"
+            "    \"histogram\": [           (array) Number of messages by handler time, entry i counts times below 2^i\n"
+            "       n,                     (numeric) microseconds which don't fit an earlier entry, the last entry counts the rest\n"
+            "       ...\n"
+            "    ]\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleCli("getnetmsgstats", "true")
+            + HelpExampleRpc("getnetmsgstats", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    bool fReset = !request.params[0].isNull() && request.params[0].get_bool();
+
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& entry : g_connman->GetMessageStats()) {
+        const CNetMsgCmdStats& stats = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("bytes", stats.nBytes));
+        obj.push_back(Pair("queuetime", stats.nQueueMicros));
+        obj.push_back(Pair("handlertime", stats.nHandlerMicros));
+        obj.push_back(Pair("maxhandlertime", stats.nMaxHandlerMicros));
+        obj.push_back(Pair("cs_main_wait", stats.nLockWaitMicros));
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t nBucket : stats.vHandlerHistogram) {
+            histogram.push_back(nBucket);
+        }
+        obj.push_back(Pair("histogram", histogram));
+        ret.push_back(Pair(entry.first, obj));
+    }
+
+    if (fReset) {
+        g_connman->ResetMessageStats();
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -636,6 +764,8 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getdsmessagequeueinfo",  &getdsmessagequeueinfo,  {} },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         {"reset"} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -7,6 +7,7 @@
 #include <set>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <utiltime.h>
 
 #include <stdio.h>
 
@@ -21,6 +22,39 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef HAVE_THREAD_LOCAL
+static thread_local CLockWaitTracker* lockwaittracker = nullptr;
+#endif
+
+CLockWaitTracker::CLockWaitTracker(const CCriticalSection& csIn) : cs(&csIn), prev(nullptr), nWaitMicros(0)
+{
+#ifdef HAVE_THREAD_LOCAL
+    prev = lockwaittracker;
+    lockwaittracker = this;
+#endif
+}
+
+CLockWaitTracker::~CLockWaitTracker()
+{
+#ifdef HAVE_THREAD_LOCAL
+    lockwaittracker = prev;
+#endif
+}
+
+void WaitForLock(std::unique_lock<CCriticalSection>& lock)
+{
+#ifdef HAVE_THREAD_LOCAL
+    CLockWaitTracker* tracker = lockwaittracker;
+    if (tracker && tracker->cs == lock.mutex()) {
+        int64_t nTimeStart = GetTimeMicros();
+        lock.lock();
+        tracker->nWaitMicros += GetTimeMicros() - nTimeStart;
+        return;
+    }
+#endif
+    lock.lock();
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
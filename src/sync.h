@@ -9,6 +9,7 @@
 #include <threadsafety.h>
 
 #include <condition_variable>
+#include <stdint.h>
 #include <thread>
 #include <mutex>
 
@@ -112,6 +113,32 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Measures how long the current thread waits for a contended lock on cs while
+ * the tracker is in scope. Only the innermost tracker of a thread is active.
+ */
+class CLockWaitTracker
+{
+private:
+    const CCriticalSection* cs;
+    CLockWaitTracker* prev;
+    int64_t nWaitMicros;
+
+    friend void WaitForLock(std::unique_lock<CCriticalSection>& lock);
+
+public:
+    explicit CLockWaitTracker(const CCriticalSection& csIn);
+    ~CLockWaitTracker();
+
+    CLockWaitTracker(const CLockWaitTracker&) = delete;
+    CLockWaitTracker& operator=(const CLockWaitTracker&) = delete;
+
+    int64_t GetWaitMicros() const { return nWaitMicros; }
+};
+
+/** Blocks until lock is acquired, accounting the wait to the active CLockWaitTracker */
+void WaitForLock(std::unique_lock<CCriticalSection>& lock);
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
@@ -121,14 +148,12 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            WaitForLock(lock);
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -9,6 +9,8 @@
 #include <hash.h>
 #include <netbase.h>
 #include <random.h>
+#include <streams.h>
+#include <utilstrencodings.h>
 
 class CAddrManTest : public CAddrMan
 {
@@ -78,6 +80,40 @@ static CService ResolveService(std::string ip, int port = 0)
     return ResolveService(ip.c_str(), port);
 }
 
+//! Every entry with the "new" buckets it is in, independent of the order addrman serializes them in
+static std::map<std::string, std::string> DescribeEntries(const CAddrMan& addrman)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+
+    unsigned char nVersion, nKeySize;
+    uint256 nKey;
+    int nNew, nTried, nUBuckets;
+    ss >> nVersion >> nKeySize >> nKey >> nNew >> nTried >> nUBuckets;
+    std::vector<CAddrInfo> vInfo(nNew + nTried);
+    for (CAddrInfo& info : vInfo) {
+        ss >> info;
+    }
+    std::map<int, std::string> mapBuckets;
+    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+        int nSize;
+        ss >> nSize;
+        for (int n = 0; n < nSize; n++) {
+            int nIndex;
+            ss >> nIndex;
+            mapBuckets[nIndex] += strprintf(" %d", bucket);
+        }
+    }
+
+    std::map<std::string, std::string> mapEntries;
+    for (int i = 0; i < (int)vInfo.size(); i++) {
+        CDataStream ssInfo(SER_DISK, CLIENT_VERSION);
+        ssInfo << vInfo[i];
+        mapEntries[vInfo[i].ToString()] = HexStr(ssInfo.begin(), ssInfo.end()) + (i < nNew ? " new" + mapBuckets[i] : " tried");
+    }
+    return mapEntries;
+}
+
 BOOST_FIXTURE_TEST_SUITE(addrman_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(addrman_simple)
@@ -217,6 +253,107 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    // A few addresses spread over the buckets, every one of them can be selected.
+    std::set<std::string> setAdded;
+    for (int i = 1; i <= 8; i++) {
+        CService addr = ResolveService(strprintf("250.%d.1.1", i), 8333);
+        if (addrman.Add(CAddress(addr, NODE_NONE), ResolveIP(strprintf("251.%d.1.1", i))))
+            setAdded.insert(addr.ToString());
+    }
+    BOOST_CHECK_EQUAL(setAdded.size(), 8);
+
+    std::set<std::string> setSelected;
+    for (int i = 0; i < 1000; i++) {
+        setSelected.insert(addrman.Select(true).ToString());
+    }
+    BOOST_CHECK(setSelected == setAdded);
+
+    // Test: an address moved to tried leaves its "new" positions.
+    CService addrTried = ResolveService("250.1.1.1", 8333);
+    addrman.Good(CAddress(addrTried, NODE_NONE));
+    setAdded.erase(addrTried.ToString());
+    setSelected.clear();
+    for (int i = 0; i < 1000; i++) {
+        setSelected.insert(addrman.Select(true).ToString());
+    }
+    BOOST_CHECK(setSelected == setAdded);
+
+    bool fSelectedTried = false;
+    for (int i = 0; i < 100; i++) {
+        fSelectedTried |= addrman.Select().ToString() == addrTried.ToString();
+    }
+    BOOST_CHECK(fSelectedTried);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_apply_changes)
+{
+    CAddrManTest addrman;
+
+    // The state written to peers.dat.
+    for (int i = 1; i < 64; i++) {
+        addrman.Add(CAddress(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE), ResolveIP(strprintf("252.%d.1.1", i % 8)));
+    }
+    for (int i = 1; i < 16; i++) {
+        addrman.Good(CAddress(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE));
+    }
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    addrman.SerializeAndResetChanges(ssPeers);
+    CAddrManTest addrmanDisk;
+    ssPeers >> addrmanDisk;
+    BOOST_CHECK(DescribeEntries(addrmanDisk) == DescribeEntries(addrman));
+
+    std::vector<CAddrManChange> vChanges;
+    BOOST_CHECK(addrman.TakeChanges(vChanges));
+    BOOST_CHECK(vChanges.empty());
+
+    // Test: new addresses, known ones in more buckets, moves to tried and failed attempts all carry over.
+    for (int i = 64; i < 128; i++) {
+        addrman.Add(CAddress(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE), ResolveIP(strprintf("252.%d.1.1", i % 8)));
+    }
+    for (int i = 16; i < 32; i++) {
+        CAddress addr(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        addrman.Add(addr, ResolveIP("253.1.1.1"));
+    }
+    for (int i = 32; i < 48; i++) {
+        addrman.Good(CAddress(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE));
+    }
+    for (int i = 48; i < 56; i++) {
+        addrman.Attempt(CAddress(ResolveService(strprintf("250.1.%d.1", i), 8333), NODE_NONE), true);
+    }
+    BOOST_CHECK(addrman.TakeChanges(vChanges));
+    BOOST_CHECK(!vChanges.empty());
+    addrmanDisk.ApplyChanges(vChanges);
+    BOOST_CHECK_EQUAL(addrmanDisk.size(), addrman.size());
+    BOOST_CHECK(DescribeEntries(addrmanDisk) == DescribeEntries(addrman));
+
+    // Test: the changes were taken, only what changed after that is tracked.
+    BOOST_CHECK(addrman.TakeChanges(vChanges));
+    BOOST_CHECK(vChanges.empty());
+
+    // Test: a deleted address is removed.
+    CService addrDeleted = ResolveService("250.1.100.1", 8333);
+    BOOST_CHECK(addrmanDisk.Find(addrDeleted) != nullptr);
+    CAddrManChange change;
+    change.addr = addrDeleted;
+    addrmanDisk.ApplyChanges({change});
+    BOOST_CHECK(addrmanDisk.Find(addrDeleted) == nullptr);
+    BOOST_CHECK_EQUAL(addrmanDisk.size(), addrman.size() - 1);
+
+    // Test: too many changes to be tracked require writing all of peers.dat.
+    for (int i = 0; i <= ADDRMAN_CHANGES_MAX; i++) {
+        addrman.Add(CAddress(ResolveService(strprintf("251.%d.%d.1", i >> 8, i & 0xff), 8333), NODE_NONE), ResolveIP("252.1.1.1"));
+    }
+    BOOST_CHECK(!addrman.TakeChanges(vChanges));
+    addrman.SerializeAndResetChanges(ssPeers);
+    BOOST_CHECK(addrman.TakeChanges(vChanges));
+    BOOST_CHECK(vChanges.empty());
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -0,0 +1,130 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilewriter.h>
+#include <validation.h>
+
+#include <test/test_chaincoin.h>
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilewriter_tests, TestingSetup)
+
+//! a file number the test chain doesn't use
+static const int TEST_FILE = 1000;
+
+static std::vector<unsigned char> MakeTestRecord(size_t nSize, unsigned char c)
+{
+    // 8 byte header followed by the data
+    std::vector<unsigned char> vchRecord(8 + nSize, c);
+    for (size_t i = 0; i < 8; i++)
+        vchRecord[i] = 0xff;
+    return vchRecord;
+}
+
+static std::vector<unsigned char> ReadTestFile(CBlockFileWriter::FileType type)
+{
+    CDiskBlockPos pos(TEST_FILE, 0);
+    FILE* file = type == CBlockFileWriter::BLOCK_FILE ? OpenBlockFile(pos, true) : OpenUndoFile(pos, true);
+    BOOST_REQUIRE(file);
+    std::vector<unsigned char> vchData;
+    unsigned char buf[4096];
+    size_t nRead;
+    while ((nRead = fread(buf, 1, sizeof(buf), file)) > 0)
+        vchData.insert(vchData.end(), buf, buf + nRead);
+    fclose(file);
+    return vchData;
+}
+
+static void WriteTestRecords(CBlockFileWriter& writer, CBlockFileWriter::FileType type, std::vector<unsigned char>& vchExpected)
+{
+    writer.Allocate(type, CDiskBlockPos(TEST_FILE, 0), 1 << 16);
+    for (int i = 0; i < 100; i++) {
+        std::vector<unsigned char> vchRecord = MakeTestRecord(100 + i, i);
+        CDiskBlockPos pos(TEST_FILE, vchExpected.size());
+        vchExpected.insert(vchExpected.end(), vchRecord.begin(), vchRecord.end());
+        writer.Write(type, pos, 8, std::move(vchRecord));
+
+        // Readable right away, from the queue or the file
+        std::vector<unsigned char> vchData;
+        if (writer.GetPending(type, CDiskBlockPos(TEST_FILE, pos.nPos + 8), vchData)) {
+            BOOST_CHECK(vchData == std::vector<unsigned char>(100 + i, i));
+        }
+    }
+    writer.Finalize(type, TEST_FILE, vchExpected.size());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilewriter_thread)
+{
+    CBlockFileWriter writer;
+    bool fAborted = false;
+    // A queue smaller than a record still lets one record through at a time
+    writer.Start(1000, [&fAborted](const std::string&) { fAborted = true; });
+    BOOST_CHECK(writer.IsRunning());
+
+    std::vector<unsigned char> vchBlocks, vchUndo;
+    WriteTestRecords(writer, CBlockFileWriter::BLOCK_FILE, vchBlocks);
+    WriteTestRecords(writer, CBlockFileWriter::UNDO_FILE, vchUndo);
+    BOOST_CHECK(writer.Flush());
+
+    // Nothing is pending after a flush, the preallocated space was truncated
+    std::vector<unsigned char> vchData;
+    BOOST_CHECK(!writer.GetPending(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(TEST_FILE, 8), vchData));
+    BOOST_CHECK(ReadTestFile(CBlockFileWriter::BLOCK_FILE) == vchBlocks);
+    BOOST_CHECK(ReadTestFile(CBlockFileWriter::UNDO_FILE) == vchUndo);
+
+    writer.Stop();
+    BOOST_CHECK(!writer.IsRunning());
+    BOOST_CHECK(!fAborted);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilewriter_synchronous)
+{
+    // Without the thread, records are written before Write returns
+    CBlockFileWriter writer;
+    std::vector<unsigned char> vchRecord = MakeTestRecord(100, 1);
+    std::vector<unsigned char> vchExpected = vchRecord;
+    writer.Write(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(TEST_FILE, 0), 8, std::move(vchRecord));
+
+    std::vector<unsigned char> vchData;
+    BOOST_CHECK(!writer.GetPending(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(TEST_FILE, 8), vchData));
+    BOOST_CHECK(writer.Flush());
+    BOOST_CHECK(ReadTestFile(CBlockFileWriter::BLOCK_FILE) == vchExpected);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilewriter_failure)
+{
+    // A directory in place of the block file makes every write to it fail
+    const int nBadFile = TEST_FILE + 1;
+    fs::create_directories(GetBlockPosFilename(CDiskBlockPos(nBadFile, 0), "blk"));
+    std::vector<unsigned char> vchData;
+
+    // Without the thread the caller learns about it right away, and so does the abort handler
+    {
+        CBlockFileWriter writer;
+        int nAborted = 0;
+        writer.Start(0, [&nAborted](const std::string&) { nAborted++; });
+        BOOST_CHECK(!writer.IsRunning());
+        BOOST_CHECK(!writer.Write(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(nBadFile, 0), 8, MakeTestRecord(100, 1)));
+        BOOST_CHECK_EQUAL(nAborted, 1);
+        BOOST_CHECK(!writer.Flush());
+    }
+
+    // With the thread it's reported by the abort handler and the next flush, and later writes are refused
+    {
+        CBlockFileWriter writer;
+        std::atomic<int> nAborted(0);
+        writer.Start(1000, [&nAborted](const std::string&) { nAborted++; });
+        BOOST_CHECK(writer.Write(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(nBadFile, 0), 8, MakeTestRecord(100, 1)));
+        BOOST_CHECK(!writer.Flush());
+        BOOST_CHECK_EQUAL(nAborted, 1);
+        BOOST_CHECK(!writer.GetPending(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(nBadFile, 8), vchData));
+        BOOST_CHECK(!writer.Write(CBlockFileWriter::BLOCK_FILE, CDiskBlockPos(TEST_FILE, 0), 8, MakeTestRecord(100, 1)));
+        writer.Stop();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
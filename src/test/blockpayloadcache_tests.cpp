@@ -0,0 +1,71 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockpayloadcache.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockpayloadcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CSharedNetMsgPayload> MakeTestPayload(size_t nSize, unsigned char c)
+{
+    return std::make_shared<const CSharedNetMsgPayload>(std::vector<unsigned char>(nSize, c));
+}
+
+BOOST_AUTO_TEST_CASE(blockpayloadcache_lru)
+{
+    // room for two 1000 byte payloads but not three
+    CBlockPayloadCache cache(3000);
+    uint256 hash1 = uint256S("01");
+    uint256 hash2 = uint256S("02");
+    uint256 hash3 = uint256S("03");
+
+    BOOST_CHECK(!cache.Get(hash1, 0));
+    cache.Insert(hash1, 0, MakeTestPayload(1000, 1));
+    cache.Insert(hash2, 0, MakeTestPayload(1000, 2));
+
+    auto payload = cache.Get(hash1, 0);
+    BOOST_CHECK(payload && payload->data.size() == 1000 && payload->data[0] == 1);
+    // other flags are a different entry
+    BOOST_CHECK(!cache.Get(hash1, 1));
+
+    // hash1 was used last, hash2 is evicted
+    cache.Insert(hash3, 0, MakeTestPayload(1000, 3));
+    BOOST_CHECK(cache.Get(hash1, 0));
+    BOOST_CHECK(!cache.Get(hash2, 0));
+    BOOST_CHECK(cache.Get(hash3, 0));
+
+    CBlockPayloadCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK(stats.nUsage <= stats.nMaxSize);
+    BOOST_CHECK_EQUAL(stats.nHits, 3U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 3U);
+
+    // evicted payloads stay valid for whoever still holds them
+    cache.Clear();
+    BOOST_CHECK(payload->data[999] == 1);
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockpayloadcache_size)
+{
+    CBlockPayloadCache cache(3000);
+    uint256 hash = uint256S("01");
+
+    // too large for the cache
+    cache.Insert(hash, 0, MakeTestPayload(3000, 1));
+    BOOST_CHECK(!cache.Get(hash, 0));
+
+    cache.Insert(hash, 0, MakeTestPayload(1000, 1));
+    BOOST_CHECK(cache.Get(hash, 0));
+
+    // disabling the cache drops everything
+    cache.SetMaxSize(0);
+    BOOST_CHECK(!cache.Get(hash, 0));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+#include <chainparams.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+class CBlockPrefetcherTest : public CBlockPrefetcher
+{
+public:
+    //! Wait until the workers read every queued block
+    bool WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return condDone.wait_for(lock, std::chrono::seconds(30), [this] { return queuePending.empty() && nRunning == 0; });
+    }
+};
+
+static void Prefetch(CBlockPrefetcher& prefetcher, const std::vector<int>& vHeights)
+{
+    LOCK(cs_main);
+    std::vector<const CBlockIndex*> vpindex;
+    for (int nHeight : vHeights) {
+        vpindex.push_back(chainActive[nHeight]);
+    }
+    prefetcher.Prefetch(vpindex, pcoinsdbview.get());
+}
+
+static bool CheckGet(CBlockPrefetcher& prefetcher, const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CBlock> pblock = prefetcher.Get(pindex);
+    return pblock && pblock->GetHash() == pindex->GetBlockHash() && pblock->fChecked;
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockprefetch_get)
+{
+    CBlockPrefetcherTest prefetcher;
+    prefetcher.Start(BLOCK_PREFETCH_THREADS, MAX_BLOCK_PREFETCH, Params().GetConsensus());
+
+    std::vector<int> vHeights;
+    for (int nHeight = 1; nHeight <= 20; nHeight++) {
+        vHeights.push_back(nHeight);
+    }
+    Prefetch(prefetcher, vHeights);
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+
+    // blocks are read and checked, and taken only once
+    for (int nHeight : vHeights) {
+        BOOST_CHECK(CheckGet(prefetcher, chainActive[nHeight]));
+        BOOST_CHECK(prefetcher.Get(chainActive[nHeight]) == nullptr);
+    }
+    BOOST_CHECK(prefetcher.Get(chainActive[21]) == nullptr);
+
+    // a block which can't be read is left to the caller
+    CBlockIndex indexBad = *chainActive[30];
+    indexBad.nDataPos = chainActive[31]->nDataPos;
+    {
+        LOCK(cs_main);
+        prefetcher.Prefetch({&indexBad, chainActive[31]}, pcoinsdbview.get());
+    }
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+    BOOST_CHECK(prefetcher.Get(&indexBad) == nullptr);
+    BOOST_CHECK(CheckGet(prefetcher, chainActive[31]));
+
+    // and so is one we don't have the data of
+    {
+        LOCK(cs_main);
+        chainActive[40]->nStatus &= ~BLOCK_HAVE_DATA;
+    }
+    Prefetch(prefetcher, {40, 41});
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+    BOOST_CHECK(prefetcher.Get(chainActive[40]) == nullptr);
+    BOOST_CHECK(CheckGet(prefetcher, chainActive[41]));
+    {
+        LOCK(cs_main);
+        chainActive[40]->nStatus |= BLOCK_HAVE_DATA;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockprefetch_reorder)
+{
+    CBlockPrefetcherTest prefetcher;
+    prefetcher.Start(BLOCK_PREFETCH_THREADS, MAX_BLOCK_PREFETCH, Params().GetConsensus());
+
+    Prefetch(prefetcher, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+
+    // as after a reorg, blocks which aren't wanted anymore are dropped, the others kept
+    Prefetch(prefetcher, {6, 7, 8, 9, 10, 16, 17, 18, 19, 20});
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+    for (int nHeight = 1; nHeight <= 5; nHeight++) {
+        BOOST_CHECK(prefetcher.Get(chainActive[nHeight]) == nullptr);
+    }
+
+    // they can be taken in any order
+    for (int nHeight : {20, 8, 16, 6, 19, 10, 7, 18, 9, 17}) {
+        BOOST_CHECK(CheckGet(prefetcher, chainActive[nHeight]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockprefetch_cancel)
+{
+    // keep most blocks waiting for a worker
+    const int nDepth = 2;
+    CBlockPrefetcherTest prefetcher;
+    prefetcher.Start(1, nDepth, Params().GetConsensus());
+
+    std::vector<int> vHeights;
+    for (int nHeight = 1; nHeight <= 40; nHeight++) {
+        vHeights.push_back(nHeight);
+    }
+    Prefetch(prefetcher, vHeights);
+    prefetcher.Cancel();
+    BOOST_CHECK(prefetcher.WaitIdle());
+    for (int nHeight : vHeights) {
+        BOOST_CHECK(prefetcher.Get(chainActive[nHeight]) == nullptr);
+    }
+
+    // the blocks in flight when it was cancelled don't hold back new ones
+    Prefetch(prefetcher, {60, 61});
+    BOOST_REQUIRE(prefetcher.WaitIdle());
+    BOOST_CHECK(CheckGet(prefetcher, chainActive[60]));
+    BOOST_CHECK(CheckGet(prefetcher, chainActive[61]));
+
+    // nothing is queued once it's stopped
+    prefetcher.Interrupt();
+    prefetcher.Stop();
+    BOOST_CHECK(!prefetcher.IsRunning());
+    Prefetch(prefetcher, {70});
+    BOOST_CHECK(prefetcher.Get(chainActive[70]) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
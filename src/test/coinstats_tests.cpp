@@ -0,0 +1,123 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coinstats.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <validation.h>
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinstats_tests, TestChain100Setup)
+
+//! Compare the tracked stats to a walk of the UTXO set, which seeds them again
+static void CheckTrackedStats()
+{
+    FlushStateToDisk();
+    CCoinsStats tracked;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), tracked, CoinStatsHashType::MUHASH));
+    BOOST_CHECK(tracked.fTracked);
+    {
+        LOCK(cs_main);
+        g_coinstats_tracker.Invalidate();
+    }
+    CCoinsStats walked;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), walked, CoinStatsHashType::MUHASH));
+    BOOST_CHECK(!walked.fTracked);
+    BOOST_CHECK(tracked.hashBlock == walked.hashBlock);
+    BOOST_CHECK_EQUAL(tracked.nHeight, walked.nHeight);
+    BOOST_CHECK_EQUAL(tracked.hashMuHash, walked.hashMuHash);
+    BOOST_CHECK_EQUAL(tracked.nTransactionOutputs, walked.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(tracked.nBogoSize, walked.nBogoSize);
+    BOOST_CHECK_EQUAL(tracked.nTotalAmount, walked.nTotalAmount);
+}
+
+BOOST_AUTO_TEST_CASE(coinstats_walk_and_tracker)
+{
+    FlushStateToDisk();
+    {
+        LOCK(cs_main);
+        g_coinstats_tracker.Load(*pcoinsdbview, true);
+    }
+    // Nothing was tracked while the chain was built
+    CTrackedCoinsStats trackedStats;
+    BOOST_CHECK(!g_coinstats_tracker.Get(trackedStats));
+
+    // The partitioned walk gives the same hash as reading the set in one go
+    CCoinsStats stats;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), stats, CoinStatsHashType::HASH_SERIALIZED));
+    uint64_t nCoins;
+    BOOST_CHECK_EQUAL(stats.hashSerialized, HashUTXOSet(*pcoinsdbview, nCoins));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, nCoins);
+    BOOST_CHECK(stats.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(stats.nHeight, chainActive.Height());
+    BOOST_CHECK(!stats.fTracked);
+    BOOST_CHECK(!g_coinstats_tracker.Get(trackedStats));
+
+    // A walk for the MuHash seeds the tracked stats
+    CCoinsStats statsMuHash;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), statsMuHash, CoinStatsHashType::MUHASH));
+    BOOST_CHECK(!statsMuHash.fTracked);
+    BOOST_CHECK_EQUAL(statsMuHash.nTransactions, stats.nTransactions);
+    BOOST_CHECK(g_coinstats_tracker.Get(trackedStats));
+    CheckTrackedStats();
+
+    // Spend a coinbase output, creating and destroying coins
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[1].nValue = 0;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    CheckTrackedStats();
+
+    // The stats are stored along with the coins
+    FlushStateToDisk();
+    {
+        LOCK(cs_main);
+        g_coinstats_tracker.Load(*pcoinsdbview, true);
+    }
+    BOOST_CHECK(g_coinstats_tracker.Get(trackedStats));
+    BOOST_CHECK(trackedStats.hashBlock == block.GetHash());
+
+    // Disconnecting the block puts the coins back
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        InvalidateBlock(state, Params(), chainActive.Tip());
+    }
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.hashPrevBlock);
+    CheckTrackedStats();
+
+    // The tracked stats answer without a walk, except for the number of transactions
+    CCoinsStats statsNone;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), statsNone, CoinStatsHashType::NONE));
+    BOOST_CHECK(statsNone.fTracked);
+    BOOST_CHECK_EQUAL(statsNone.nTransactionOutputs, statsMuHash.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(statsNone.nTotalAmount, statsMuHash.nTotalAmount);
+
+    {
+        LOCK(cs_main);
+        g_coinstats_tracker.Load(*pcoinsdbview, false);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
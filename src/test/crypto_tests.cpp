@@ -4,6 +4,7 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -11,6 +12,7 @@
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
 #include <random.h>
+#include <streams.h>
 #include <utilstrencodings.h>
 #include <test/test_chaincoin.h>
 
@@ -524,6 +526,68 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    MuHash3072 muhash;
+    muhash.Insert(tmp, sizeof(tmp));
+    return muhash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    unsigned char data[3][32] = {{0}, {1}, {2}};
+    MuHash3072 acc;
+    acc.Insert(data[0], 32).Insert(data[1], 32).Remove(data[2], 32);
+    BOOST_CHECK_EQUAL(acc.Finalize(), uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+    BOOST_CHECK_EQUAL(MuHash3072().Finalize(), uint256S("dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8"));
+
+    // The same multiset gives the same hash, whatever the order of the updates
+    for (int iter = 0; iter < 10; ++iter) {
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        uint256 results[4];
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 muhash;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    muhash /= FromInt(t & 3);
+                } else {
+                    muhash *= FromInt(t & 3);
+                }
+            }
+            results[order] = muhash.Finalize();
+        }
+        BOOST_CHECK(results[0] == results[1]);
+        BOOST_CHECK(results[0] == results[2]);
+        BOOST_CHECK(results[0] == results[3]);
+    }
+
+    // Removing an element undoes inserting it
+    MuHash3072 x = FromInt(InsecureRandBits(4));
+    MuHash3072 y = FromInt(InsecureRandBits(4));
+    MuHash3072 z = x;
+    z *= y;
+    z /= y;
+    BOOST_CHECK(z.Finalize() == x.Finalize());
+    MuHash3072 w;
+    w.Insert(data[1], 32).Remove(data[1], 32);
+    BOOST_CHECK(w.Finalize() == MuHash3072().Finalize());
+
+    // A serialized state can be updated further
+    CDataStream ss(SER_DISK, 0);
+    ss << acc;
+    MuHash3072 acc2;
+    ss >> acc2;
+    acc.Insert(data[2], 32);
+    acc2.Insert(data[2], 32);
+    BOOST_CHECK(acc.Finalize() == acc2.Finalize());
+    BOOST_CHECK(acc.Finalize() == FromInt(0).Insert(data[1], 32).Finalize());
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
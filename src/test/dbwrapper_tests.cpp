@@ -117,6 +117,39 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Test per database option overrides
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    CDBOptions dboptions(8 << 20);
+    BOOST_CHECK_EQUAL(dboptions.nBlockCacheSize, 4U << 20);
+    BOOST_CHECK_EQUAL(dboptions.nWriteBufferSize, 2U << 20);
+
+    gArgs.ForceSetArg("-dboption", "test:maxopenfiles=100");
+    dboptions.ApplyArgs("other");
+    BOOST_CHECK_EQUAL(dboptions.nMaxOpenFiles, 64);
+    dboptions.ApplyArgs("test");
+    BOOST_CHECK_EQUAL(dboptions.nMaxOpenFiles, 100);
+
+    gArgs.ForceSetArg("-dboption", "test:blockcache=16");
+    dboptions.ApplyArgs("test");
+    BOOST_CHECK_EQUAL(dboptions.nBlockCacheSize, 16U << 20);
+
+    // Invalid and unknown options are ignored
+    for (const char* strArg : {"test:bloombits", "test:bloombits=-1", "test:bloombits=x", "test:nosuchoption=1"}) {
+        gArgs.ForceSetArg("-dboption", strArg);
+        dboptions.ApplyArgs("test");
+        BOOST_CHECK_EQUAL(dboptions.nBloomBits, 10);
+    }
+    gArgs.ForceSetArg("-dboption", "");
+
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, dboptions, true);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().nBlockCacheSize, 16U << 20);
+    std::string strValue;
+    BOOST_CHECK(dbw.GetProperty("leveldb.num-files-at-level0", strValue));
+    BOOST_CHECK(!dbw.GetProperty("leveldb.nosuchproperty", strValue));
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -0,0 +1,142 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dsmessagequeue.h>
+#include <net.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(dsmessagequeue_tests, BasicTestingSetup)
+
+static std::vector<std::unique_ptr<CNode>> MakeTestNodes(int nCount)
+{
+    std::vector<std::unique_ptr<CNode>> vNodes;
+    CAddress addr(CService(CNetAddr(), 9999), NODE_NONE);
+    for (int i = 0; i < nCount; i++) {
+        vNodes.emplace_back(new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true));
+    }
+    return vNodes;
+}
+
+static void EnqueueTestMessage(CDSMessageQueue& queue, CNode* pnode, int n)
+{
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    vRecv << n;
+    BOOST_CHECK(queue.Enqueue(pnode, NetMsgType::MNPING, vRecv, 0));
+}
+
+BOOST_AUTO_TEST_CASE(dsmessagequeue_order)
+{
+    const int nPeers = 4;
+    const int nMessages = 200;
+    std::vector<std::unique_ptr<CNode>> vNodes = MakeTestNodes(nPeers);
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::vector<std::vector<int>> vReceived(nPeers);
+    std::vector<bool> vBusy(nPeers, false);
+    bool fConcurrent = false;
+    int nReceived = 0;
+
+    CDSMessageQueue queue;
+    queue.Start(3, [&](CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived) {
+        NodeId id = pfrom->GetId();
+        int n;
+        vRecv >> n;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            // messages of one peer are never processed at the same time
+            fConcurrent |= vBusy[id];
+            vBusy[id] = true;
+        }
+        MilliSleep(n % 10 == 0 ? 1 : 0);
+        std::unique_lock<std::mutex> lock(cs);
+        vBusy[id] = false;
+        vReceived[id].push_back(n);
+        nReceived++;
+        cond.notify_all();
+    });
+    BOOST_CHECK(queue.IsRunning());
+
+    for (int n = 0; n < nMessages; n++) {
+        for (int id = 0; id < nPeers; id++) {
+            EnqueueTestMessage(queue, vNodes[id].get(), n);
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [&] { return nReceived == nPeers * nMessages; });
+    }
+
+    BOOST_CHECK(!fConcurrent);
+    for (int id = 0; id < nPeers; id++) {
+        BOOST_REQUIRE_EQUAL(vReceived[id].size(), (size_t)nMessages);
+        for (int n = 0; n < nMessages; n++) {
+            BOOST_CHECK_EQUAL(vReceived[id][n], n);
+        }
+    }
+    CDSMessageQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nProcessed, (uint64_t)nPeers * nMessages);
+    BOOST_CHECK_EQUAL(stats.nDepth, 0U);
+    BOOST_CHECK_EQUAL(stats.nThrottled, 0U);
+
+    queue.Interrupt();
+    queue.Stop();
+    BOOST_CHECK(!queue.IsRunning());
+
+    // Nothing is queued once it's stopped, the caller processes the message
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!queue.Enqueue(vNodes[0].get(), NetMsgType::MNPING, vRecv, 0));
+    BOOST_CHECK(!queue.IsFull(0));
+}
+
+BOOST_AUTO_TEST_CASE(dsmessagequeue_limits)
+{
+    // Without workers messages stay queued
+    const int nPeers = MAX_DSMSG_QUEUE_TOTAL / MAX_DSMSG_QUEUE_PER_PEER + 2;
+    std::vector<std::unique_ptr<CNode>> vNodes = MakeTestNodes(nPeers);
+    CDSMessageQueue queue;
+    queue.Start(0, [](CNode*, const std::string&, CDataStream&, int64_t) {});
+
+    // A peer is throttled once its own queue is full, others aren't
+    for (size_t n = 0; n < MAX_DSMSG_QUEUE_PER_PEER; n++) {
+        BOOST_CHECK(!queue.IsFull(0));
+        EnqueueTestMessage(queue, vNodes[0].get(), n);
+    }
+    BOOST_CHECK(queue.IsFull(0));
+    BOOST_CHECK(!queue.IsFull(1));
+    BOOST_CHECK_EQUAL(queue.GetStats().nThrottled, 1U);
+
+    // Up to the total limit
+    for (int id = 1; id < nPeers - 2; id++) {
+        for (size_t n = 0; n < MAX_DSMSG_QUEUE_PER_PEER; n++) {
+            EnqueueTestMessage(queue, vNodes[id].get(), n);
+        }
+    }
+    BOOST_CHECK_EQUAL(queue.GetStats().nDepth, MAX_DSMSG_QUEUE_TOTAL);
+
+    // A peer with queued messages waits for the total to go down, a peer without any still gets one in
+    CNode* pnodeSome = vNodes[nPeers - 2].get();
+    CNode* pnodeNone = vNodes[nPeers - 1].get();
+    BOOST_CHECK(!queue.IsFull(pnodeSome->GetId()));
+    EnqueueTestMessage(queue, pnodeSome, 0);
+    BOOST_CHECK(queue.IsFull(pnodeSome->GetId()));
+    BOOST_CHECK(!queue.IsFull(pnodeNone->GetId()));
+
+    CDSMessageQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nDepth, MAX_DSMSG_QUEUE_TOTAL + 1);
+    BOOST_CHECK_EQUAL(stats.nPeers, (size_t)nPeers - 1);
+    BOOST_CHECK_EQUAL(stats.nThrottled, 2U);
+
+    // Stopping releases the queued messages' node references
+    BOOST_CHECK_EQUAL(vNodes[0]->GetRefCount(), (int)MAX_DSMSG_QUEUE_PER_PEER);
+    queue.Interrupt();
+    queue.Stop();
+    BOOST_CHECK_EQUAL(vNodes[0]->GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(queue.GetStats().nDepth, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <masternode-collateral.h>
+#include <script/sign.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_collateral_tests, TestChain100Setup)
+
+static CMutableTransaction SpendToKey(const COutPoint& prevout, const CKey& key, CAmount nValue)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+static void InvalidateTip()
+{
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    SyncWithValidationInterfaceQueue();
+}
+
+static bool HaveUnspentCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs_main);
+    return collateralWatcher.HaveUnspentCollateral(outpoint);
+}
+
+BOOST_AUTO_TEST_CASE(collateral_reorg)
+{
+    RegisterValidationInterface(&collateralWatcher);
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction txCollateral = SpendToKey(COutPoint(coinbaseTxns[0].GetHash(), 0), coinbaseKey, 10 * CENT);
+    COutPoint outpoint(txCollateral.GetHash(), 0);
+
+    CreateAndProcessBlock({txCollateral}, scriptPubKey);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(HaveUnspentCollateral(outpoint));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(collateralWatcher.GetCollateralConfirmations(outpoint), 1);
+    }
+
+    // A one block reorg takes the collateral away...
+    InvalidateTip();
+    BOOST_CHECK(!HaveUnspentCollateral(outpoint));
+
+    // ...and brings it back when it's mined again in the competing block
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CreateAndProcessBlock({txCollateral}, CScript() << ToByteVector(keyOther.GetPubKey()) << OP_CHECKSIG);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(HaveUnspentCollateral(outpoint));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(collateralWatcher.GetCollateralConfirmations(outpoint), 1);
+    }
+
+    // Spending it and disconnecting the spend
+    CreateAndProcessBlock({SpendToKey(outpoint, coinbaseKey, 9 * CENT)}, scriptPubKey);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(!HaveUnspentCollateral(outpoint));
+    InvalidateTip();
+    BOOST_CHECK(HaveUnspentCollateral(outpoint));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(collateralWatcher.GetCollateralConfirmations(outpoint), 1);
+    }
+
+    UnregisterValidationInterface(&collateralWatcher);
+    collateralWatcher.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
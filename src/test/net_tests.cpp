@@ -33,6 +33,11 @@ public:
     {
         CAddrMan::Serialize(s);
     }
+
+    bool Has(const CService& addr)
+    {
+        return Find(addr) != nullptr;
+    }
 };
 
 class CAddrManCorrupted : public CAddrManSerializationMock
@@ -161,6 +166,121 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+static void FlipByte(const fs::path& path, long nPos)
+{
+    FILE* file = fsbridge::fopen(path, "rb+");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE(fseek(file, nPos, SEEK_SET) == 0);
+    int c = fgetc(file);
+    BOOST_REQUIRE(fseek(file, nPos, SEEK_SET) == 0);
+    fputc(c ^ 0xff, file);
+    fclose(file);
+}
+
+static void AddJournalTestAddrs(CAddrMan& addrman, int nBegin, int nEnd)
+{
+    CService source;
+    Lookup("252.5.1.1", source, 8333, false);
+    for (int i = nBegin; i < nEnd; i++) {
+        CService addr;
+        Lookup(strprintf("250.%d.7.1", i).c_str(), addr, 8333, false);
+        // recent enough not to be replaced when it collides with another one
+        CAddress addrNew(addr, NODE_NONE);
+        addrNew.nTime = GetAdjustedTime();
+        addrman.Add(addrNew, source);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(caddrdb_journal, TestingSetup)
+{
+    const fs::path pathAddr = GetDataDir() / "peers.dat";
+    const fs::path pathJournal = GetDataDir() / "peers.journal";
+    const uint64_t nJournalHeaderSize = 4 + 32;
+
+    CAddrManUncorrupted addrman;
+    addrman.MakeDeterministic();
+    AddJournalTestAddrs(addrman, 1, 32);
+    size_t nSizeSnapshot = addrman.size();
+
+    // Test: without peers.dat all of it is written, with an empty journal belonging to it.
+    CAddrDB adb;
+    BOOST_CHECK(adb.Write(addrman));
+    BOOST_CHECK(fs::exists(pathAddr));
+    BOOST_CHECK_EQUAL(fs::file_size(pathJournal), nJournalHeaderSize);
+    const uint64_t nAddrSize = fs::file_size(pathAddr);
+
+    // Test: changes are appended to the journal as batches, peers.dat stays as it is.
+    AddJournalTestAddrs(addrman, 32, 40);
+    CService addrGood;
+    Lookup("250.1.7.1", addrGood, 8333, false);
+    addrman.Good(CAddress(addrGood, NODE_NONE));
+    BOOST_CHECK(adb.Write(addrman));
+    const uint64_t nFirstBatchEnd = fs::file_size(pathJournal);
+    BOOST_CHECK(nFirstBatchEnd > nJournalHeaderSize);
+    size_t nSizeFirstBatch = addrman.size();
+
+    AddJournalTestAddrs(addrman, 40, 44);
+    BOOST_CHECK(adb.Write(addrman));
+    const uint64_t nSecondBatchEnd = fs::file_size(pathJournal);
+    BOOST_CHECK(nSecondBatchEnd > nFirstBatchEnd);
+    BOOST_CHECK_EQUAL(fs::file_size(pathAddr), nAddrSize);
+
+    // Test: reading applies the journal on top of peers.dat.
+    {
+        CAddrManUncorrupted addrmanRead;
+        BOOST_CHECK(adb.Read(addrmanRead));
+        BOOST_CHECK_EQUAL(addrmanRead.size(), addrman.size());
+        BOOST_CHECK(addrmanRead.Has(addrGood));
+        BOOST_CHECK_EQUAL(fs::file_size(pathJournal), nSecondBatchEnd);
+    }
+
+    // Test: an incompletely written batch is cut off, the ones before it are kept.
+    fs::resize_file(pathJournal, nSecondBatchEnd - 1);
+    CAddrManUncorrupted addrmanRead;
+    BOOST_CHECK(adb.Read(addrmanRead));
+    BOOST_CHECK_EQUAL(addrmanRead.size(), nSizeFirstBatch);
+    BOOST_CHECK_EQUAL(fs::file_size(pathJournal), nFirstBatchEnd);
+
+    // Test: the next batch follows the good ones.
+    AddJournalTestAddrs(addrmanRead, 44, 48);
+    BOOST_CHECK(adb.Write(addrmanRead));
+    const uint64_t nThirdBatchEnd = fs::file_size(pathJournal);
+    BOOST_CHECK(nThirdBatchEnd > nFirstBatchEnd);
+    {
+        CAddrManUncorrupted addrmanReread;
+        BOOST_CHECK(adb.Read(addrmanReread));
+        BOOST_CHECK_EQUAL(addrmanReread.size(), addrmanRead.size());
+    }
+
+    // Test: a batch which doesn't match its checksum is cut off as well.
+    FlipByte(pathJournal, nThirdBatchEnd - 1);
+    {
+        CAddrManUncorrupted addrmanReread;
+        BOOST_CHECK(adb.Read(addrmanReread));
+        BOOST_CHECK_EQUAL(addrmanReread.size(), nSizeFirstBatch);
+        BOOST_CHECK_EQUAL(fs::file_size(pathJournal), nFirstBatchEnd);
+    }
+
+    // Test: a journal which doesn't belong to peers.dat is ignored...
+    FlipByte(pathJournal, 4);
+    {
+        CAddrManUncorrupted addrmanReread;
+        BOOST_CHECK(adb.Read(addrmanReread));
+        BOOST_CHECK_EQUAL(addrmanReread.size(), nSizeSnapshot);
+    }
+
+    // ...and replaced along with peers.dat by the next write.
+    AddJournalTestAddrs(addrmanRead, 48, 52);
+    BOOST_CHECK(adb.Write(addrmanRead));
+    BOOST_CHECK_EQUAL(fs::file_size(pathJournal), nJournalHeaderSize);
+    BOOST_CHECK(fs::file_size(pathAddr) != nAddrSize);
+    {
+        CAddrManUncorrupted addrmanReread;
+        BOOST_CHECK(adb.Read(addrmanReread));
+        BOOST_CHECK_EQUAL(addrmanReread.size(), addrmanRead.size());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(cnode_simple_test)
 {
     SOCKET hSocket = INVALID_SOCKET;
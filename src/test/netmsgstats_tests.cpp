@@ -0,0 +1,61 @@
+// Copyright (c) 2017-2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmsgstats.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(netmsgstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(netmsgstats_histogram_bucket)
+{
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(-5), 0);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(0), 0);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(1), 1);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(2), 2);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(3), 2);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(4), 3);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(1023), 10);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(1024), 11);
+    BOOST_CHECK_EQUAL(CNetMsgStats::HistogramBucket(int64_t{1} << 40), NET_MSG_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE(netmsgstats_record)
+{
+    CNetMsgStats stats({"ping", "mnp"}, "*other*");
+    BOOST_CHECK(stats.GetStats().empty());
+
+    stats.Record("mnp", 100, 10, 300, 50);
+    stats.Record("mnp", 200, 20, 5, 0);
+    stats.Record("unknown", 42, 0, 1, 0);
+    stats.Record("foo", 8, 0, 1, 0);
+
+    std::map<std::string, CNetMsgCmdStats> mapStats = stats.GetStats();
+    BOOST_CHECK_EQUAL(mapStats.size(), 2);
+    BOOST_CHECK(!mapStats.count("ping"));
+    BOOST_CHECK(!mapStats.count("unknown"));
+
+    const CNetMsgCmdStats& mnp = mapStats["mnp"];
+    BOOST_CHECK_EQUAL(mnp.nCount, 2);
+    BOOST_CHECK_EQUAL(mnp.nBytes, 300);
+    BOOST_CHECK_EQUAL(mnp.nQueueMicros, 30);
+    BOOST_CHECK_EQUAL(mnp.nHandlerMicros, 305);
+    BOOST_CHECK_EQUAL(mnp.nMaxHandlerMicros, 300);
+    BOOST_CHECK_EQUAL(mnp.nLockWaitMicros, 50);
+    BOOST_CHECK_EQUAL(mnp.vHandlerHistogram.size(), NET_MSG_STATS_HISTOGRAM_BUCKETS);
+    BOOST_CHECK_EQUAL(mnp.vHandlerHistogram[CNetMsgStats::HistogramBucket(300)], 1);
+    BOOST_CHECK_EQUAL(mnp.vHandlerHistogram[CNetMsgStats::HistogramBucket(5)], 1);
+
+    // commands which aren't known are counted together
+    const CNetMsgCmdStats& other = mapStats["*other*"];
+    BOOST_CHECK_EQUAL(other.nCount, 2);
+    BOOST_CHECK_EQUAL(other.nBytes, 50);
+
+    stats.Reset();
+    BOOST_CHECK(stats.GetStats().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+
+#include <test/test_chaincoin.h>
+
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuses_freed_blocks)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // blocks of a size are handed out back to back and reused after being freed
+    void* a = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    void* b = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL(static_cast<char*>(b) - static_cast<char*>(a), 16);
+    resource.Deallocate(a, 16, 8);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), 16U);
+    BOOST_CHECK(resource.Allocate(16, 8) == a);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), 0U);
+
+    // a different size doesn't get a block of another size
+    resource.Deallocate(b, 16, 8);
+    void* c = resource.Allocate(24, 8);
+    BOOST_CHECK(c != b);
+    BOOST_CHECK(resource.Allocate(9, 8) == b);
+
+    // sizes are rounded up to the alignment, zero takes one unit
+    void* d = resource.Allocate(0, 8);
+    void* e = resource.Allocate(1, 8);
+    BOOST_CHECK_EQUAL(static_cast<char*>(e) - static_cast<char*>(d), 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_chunks)
+{
+    PoolResource<64, 8> resource(256);
+
+    // four 64 byte blocks fill the first chunk
+    for (int i = 0; i < 4; i++) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    void* p = resource.Allocate(40, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // the 24 bytes left of the second chunk don't fit a 64 byte block but are kept for their size
+    for (int i = 0; i < 3; i++) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), 24U);
+    void* q = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(static_cast<char*>(q) - static_cast<char*>(p), 40 + 3 * 64);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+
+    // larger blocks and larger alignments don't come from the chunks
+    void* r = resource.Allocate(65, 8);
+    resource.Deallocate(r, 65, 8);
+    void* s = resource.Allocate(8, 16);
+    resource.Deallocate(s, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_unordered_map)
+{
+    typedef PoolAllocator<std::pair<const int, int>, sizeof(std::pair<const int, int>) + sizeof(void*) * 4, alignof(void*)> Allocator;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Allocator> Map;
+
+    Allocator::ResourceType resource;
+    {
+        Map map(0, std::hash<int>(), std::equal_to<int>(), Allocator(&resource));
+        for (int i = 0; i < 100000; i++) {
+            map[i] = i;
+        }
+        size_t nChunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(nChunks > 1);
+        BOOST_CHECK(memusage::DynamicUsage(map) >= nChunks * resource.ChunkSizeBytes() + sizeof(void*) * map.bucket_count());
+
+        // erased nodes are reused, no new chunks are needed
+        for (int i = 0; i < 50000; i++) {
+            map.erase(i);
+        }
+        for (int i = 100000; i < 150000; i++) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+        for (int i = 50000; i < 150000; i++) {
+            BOOST_CHECK_EQUAL(map.at(i), i);
+        }
+    }
+
+    // without a resource the map allocates every node on its own
+    Map map;
+    map[1] = 1;
+    BOOST_CHECK(map.get_allocator().resource() == nullptr);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const int, int> >)) + memusage::MallocUsage(sizeof(void*) * map.bucket_count()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
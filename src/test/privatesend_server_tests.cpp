@@ -0,0 +1,209 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netbase.h>
+#include <privatesend-server.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+class CPrivateSendServerTest : public CPrivateSendServer
+{
+    uint32_t nCollaterals;
+
+public:
+    CPrivateSendServerTest() : nCollaterals(0)
+    {
+        fUnitTest = true;
+    }
+
+    using CPrivateSendServer::GetSession;
+    using CPrivateSendServer::ResetSession;
+    using CPrivateSendServer::RemoveFinishedSessions;
+    using CPrivateSendServer::SetState;
+    using CPrivateSendServer::GetOffendersCollaterals;
+
+    //! The dsa part of ProcessMessage which decides where a user goes
+    bool Accept(const CService& addr, int nDenom, bool fMultiSession = true)
+    {
+        // every user has its own collateral
+        CMutableTransaction txCollateral;
+        txCollateral.nLockTime = ++nCollaterals;
+        CDarksendAccept dsa(nDenom, 0, txCollateral);
+
+        PoolMessage nMessageID = MSG_NOERR;
+        CPrivateSendSession* psession = FindSessionToJoin(dsa, fMultiSession);
+        if(psession) {
+            return AddUserToExistingSession(*psession, dsa, addr, fMultiSession, nMessageID);
+        }
+        return CanCreateSession(fMultiSession) && CreateNewSession(dsa, addr, fMultiSession, nMessageID, nullptr);
+    }
+
+    //! Pretend the user sent its entry with one input
+    void AddTestEntry(CPrivateSendSession& session, size_t nUser, bool fHasSig)
+    {
+        CTxDSIn txdsin(CTxIn(COutPoint(uint256(), session.vecEntries.size())), CScript());
+        txdsin.fHasSig = fHasSig;
+        CDarkSendEntry entry;
+        entry.vecTxDSIn.push_back(txdsin);
+        entry.txCollateral = session.vecSessionCollaterals[nUser];
+        session.vecEntries.push_back(entry);
+    }
+};
+
+struct PrivateSendServerTestingSetup : public TestingSetup
+{
+    bool fMasternodeModePrev;
+
+    PrivateSendServerTestingSetup() : fMasternodeModePrev(fMasternodeMode)
+    {
+        fMasternodeMode = true;
+        CPrivateSend::InitStandardDenominations();
+    }
+
+    ~PrivateSendServerTestingSetup()
+    {
+        fMasternodeMode = fMasternodeModePrev;
+        SetMockTime(0);
+    }
+};
+
+static CService TestAddr(int n)
+{
+    return LookupNumeric("1.2.3.4", 10000 + n);
+}
+
+BOOST_FIXTURE_TEST_SUITE(privatesend_server_tests, PrivateSendServerTestingSetup)
+
+BOOST_AUTO_TEST_CASE(privatesend_server_session_routing)
+{
+    CPrivateSendServerTest server;
+
+    // users with the same denom share a session, others get their own
+    BOOST_CHECK(server.Accept(TestAddr(1), 1));
+    BOOST_CHECK(server.Accept(TestAddr(2), 1));
+    BOOST_CHECK(server.Accept(TestAddr(3), 2));
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 2);
+    CPrivateSendSession* psession1 = server.GetSession(TestAddr(1));
+    CPrivateSendSession* psession3 = server.GetSession(TestAddr(3));
+    BOOST_REQUIRE(psession1 && psession3);
+    BOOST_CHECK(server.GetSession(TestAddr(2)) == psession1);
+    BOOST_CHECK(psession1 != psession3);
+    BOOST_CHECK_EQUAL(psession3->nSessionDenom, 2);
+
+    // a user can't be in two sessions and a ready session isn't joined anymore
+    BOOST_CHECK(server.Accept(TestAddr(4), 1));
+    BOOST_CHECK(psession1->IsReady());
+    BOOST_CHECK(server.Accept(TestAddr(5), 1));
+    BOOST_CHECK(server.GetSession(TestAddr(5)) != psession1);
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 3);
+
+    // up to the session limit
+    for (int nDenom = 3; server.GetSessionsCount() < PRIVATESEND_SERVER_MAX_SESSIONS; nDenom++) {
+        BOOST_CHECK(server.Accept(TestAddr(100 + nDenom), nDenom));
+    }
+    BOOST_CHECK(!server.Accept(TestAddr(6), 15));
+    BOOST_CHECK(server.GetSession(TestAddr(6)) == nullptr);
+
+    // older clients are only served when their session runs alone
+    BOOST_CHECK(!server.Accept(TestAddr(7), 2, false));
+    server.ResetSession(*psession1);
+    server.RemoveFinishedSessions();
+    BOOST_CHECK(server.GetSession(TestAddr(1)) == nullptr);
+    BOOST_CHECK(server.GetSession(TestAddr(2)) == nullptr);
+    BOOST_CHECK(!server.Accept(TestAddr(7), 1, false));
+
+    CPrivateSendServerTest serverLegacy;
+    BOOST_CHECK(serverLegacy.Accept(TestAddr(1), 1, false));
+    BOOST_CHECK(serverLegacy.GetSession(TestAddr(1))->fLegacy);
+    // it's joined as usual, but nothing runs next to it
+    BOOST_CHECK(serverLegacy.Accept(TestAddr(2), 1));
+    BOOST_CHECK(!serverLegacy.Accept(TestAddr(3), 2));
+    BOOST_CHECK_EQUAL(serverLegacy.GetSessionsCount(), 1);
+    serverLegacy.ResetSession(*serverLegacy.GetSession(TestAddr(1)));
+    serverLegacy.RemoveFinishedSessions();
+    BOOST_CHECK(serverLegacy.Accept(TestAddr(3), 2));
+    BOOST_CHECK(!serverLegacy.GetSession(TestAddr(3))->fLegacy);
+
+    // an older client joining a session which runs alone keeps it alone
+    BOOST_CHECK(serverLegacy.Accept(TestAddr(4), 2, false));
+    BOOST_CHECK(serverLegacy.GetSession(TestAddr(3))->fLegacy);
+    BOOST_CHECK(!serverLegacy.Accept(TestAddr(5), 1));
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_server_session_timeouts)
+{
+    CPrivateSendServerTest server;
+    int64_t nStartTime = GetTime();
+
+    SetMockTime(nStartTime);
+    BOOST_CHECK(server.Accept(TestAddr(1), 1));
+    SetMockTime(nStartTime + 60);
+    BOOST_CHECK(server.Accept(TestAddr(2), 2));
+
+    // every session times out on its own
+    SetMockTime(nStartTime + PRIVATESEND_QUEUE_TIMEOUT - 1);
+    server.CheckTimeout(nullptr);
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 2);
+    SetMockTime(nStartTime + PRIVATESEND_QUEUE_TIMEOUT);
+    server.CheckTimeout(nullptr);
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 1);
+    BOOST_CHECK(server.GetSession(TestAddr(1)) == nullptr);
+    BOOST_CHECK(server.GetSession(TestAddr(2)) != nullptr);
+
+    // the user is free to start over
+    BOOST_CHECK(server.Accept(TestAddr(1), 1));
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 2);
+
+    // signing has a shorter timeout
+    CPrivateSendSession* psession = server.GetSession(TestAddr(2));
+    server.SetState(*psession, POOL_STATE_SIGNING);
+    psession->nTimeLastSuccessfulStep = GetTime();
+    SetMockTime(GetTime() + PRIVATESEND_SIGNING_TIMEOUT);
+    server.CheckTimeout(nullptr);
+    BOOST_CHECK(server.GetSession(TestAddr(2)) == nullptr);
+    BOOST_CHECK(server.GetSession(TestAddr(1)) != nullptr);
+    BOOST_CHECK_EQUAL(server.GetSessionsCount(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_server_fee_charging)
+{
+    CPrivateSendServerTest server;
+
+    for (int i = 0; i < CPrivateSend::GetMaxPoolTransactions(); i++) {
+        BOOST_CHECK(server.Accept(TestAddr(i), 1));
+        BOOST_CHECK(server.Accept(TestAddr(100 + i), 2));
+    }
+    CPrivateSendSession& session1 = *server.GetSession(TestAddr(0));
+    CPrivateSendSession& session2 = *server.GetSession(TestAddr(100));
+    BOOST_REQUIRE(session1.IsReady() && session2.IsReady());
+
+    // nobody is charged while the session is queued
+    BOOST_CHECK(server.GetOffendersCollaterals(session1).empty());
+
+    // users who didn't send their entries are charged, in their own session only
+    server.SetState(session1, POOL_STATE_ACCEPTING_ENTRIES);
+    server.SetState(session2, POOL_STATE_ACCEPTING_ENTRIES);
+    server.AddTestEntry(session1, 0, false);
+    server.AddTestEntry(session1, 1, false);
+    std::vector<CTransactionRef> vecOffenders = server.GetOffendersCollaterals(session1);
+    BOOST_REQUIRE_EQUAL(vecOffenders.size(), session1.vecSessionCollaterals.size() - 2);
+    BOOST_CHECK(*vecOffenders[0] == *session1.vecSessionCollaterals[2]);
+    BOOST_CHECK_EQUAL(server.GetOffendersCollaterals(session2).size(), session2.vecSessionCollaterals.size());
+
+    // users who didn't sign are charged
+    for (size_t i = 0; i < session2.vecSessionCollaterals.size(); i++) {
+        server.AddTestEntry(session2, i, i != 1);
+    }
+    server.SetState(session2, POOL_STATE_SIGNING);
+    vecOffenders = server.GetOffendersCollaterals(session2);
+    BOOST_REQUIRE_EQUAL(vecOffenders.size(), 1U);
+    BOOST_CHECK(*vecOffenders[0] == *session2.vecSessionCollaterals[1]);
+    BOOST_CHECK_EQUAL(server.GetOffendersCollaterals(session1).size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -13,6 +13,7 @@
 #include <net_processing.h>
 #include <ui_interface.h>
 #include <streams.h>
+#include <txoutsnapshot.h>
 #include <rpc/server.h>
 #include <rpc/register.h>
 #include <script/sigcache.h>
@@ -190,3 +191,30 @@ CBlock getBlock9tx()
     stream >> block;
     return block;
 }
+
+uint256 HashUTXOSet(CCoinsView& view, uint64_t& nCoins)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << pcursor->GetBestBlock();
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    nCoins = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            throw std::runtime_error("Unable to read the coins database");
+        if (!outputs.empty() && key.hash != prevkey) {
+            HashTxOutputs(ss, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = coin;
+        nCoins++;
+    }
+    if (!outputs.empty()) {
+        HashTxOutputs(ss, prevkey, outputs);
+    }
+    return ss.GetHash();
+}
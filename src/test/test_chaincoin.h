@@ -118,6 +118,9 @@ struct TestMemPoolEntryHelper
 
 CBlock getBlock9tx();
 
+/** Reference hash_serialized_2 of a coins view: a plain walk of its cursor, one HashTxOutputs per transaction */
+uint256 HashUTXOSet(CCoinsView& view, uint64_t& nCoins);
+
 // define an implicit conversion here so that uint256 may be used directly in BOOST_CHECK_*
 std::ostream& operator<<(std::ostream& os, const uint256& num);
 
@@ -0,0 +1,126 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <txdb.h>
+#include <txoutsnapshot.h>
+#include <test/test_chaincoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txoutsnapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(txoutsnapshot_roundtrip)
+{
+    CCoinsViewDB dbSource(1 << 20, true);
+    uint256 hashBlock = InsecureRand256();
+    {
+        CCoinsViewCache cache(&dbSource);
+        for (int i = 0; i < 200; i++) {
+            uint256 txid = InsecureRand256();
+            uint32_t nOutputs = 1 + InsecureRandRange(4);
+            for (uint32_t n = 0; n < nOutputs; n++) {
+                CTxOut out(InsecureRandRange(1000000), CScript() << ToByteVector(InsecureRand256()));
+                cache.AddCoin(COutPoint(txid, n * 3), Coin(std::move(out), InsecureRandRange(100000), InsecureRandBool()), false);
+            }
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CSnapshotMetadata metadata;
+    metadata.hashBlock = hashBlock;
+    metadata.nHeight = 1000;
+    metadata.nChainTx = 5000;
+    fs::path path = pathTemp / "utxo.dat";
+    uint64_t nCoins;
+    uint256 hashSerialized;
+    std::unique_ptr<CCoinsViewCursor> pcursor(dbSource.Cursor());
+    BOOST_CHECK(DumpUTXOSnapshot(pcursor.get(), metadata, path, nCoins, hashSerialized));
+    BOOST_CHECK(!fs::exists(path.string() + ".incomplete"));
+    uint64_t nCoinsSource;
+    BOOST_CHECK_EQUAL(hashSerialized, HashUTXOSet(dbSource, nCoinsSource));
+    BOOST_CHECK_EQUAL(nCoins, nCoinsSource);
+
+    // Load the snapshot on top of other coins
+    CCoinsViewDB dbTarget(1 << 20, true);
+    {
+        CCoinsViewCache cache(&dbTarget);
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(dbTarget.StartBulkLoad(hashBlock));
+    BOOST_CHECK(dbTarget.GetBestBlock().IsNull());
+    CSnapshotReader reader(path);
+    BOOST_CHECK(reader.GetMetadata().hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(reader.GetMetadata().nHeight, 1000);
+    BOOST_CHECK_EQUAL(reader.GetMetadata().nChainTx, 5000U);
+    uint256 hash;
+    std::map<uint32_t, Coin> outputs;
+    std::vector<std::pair<COutPoint, Coin>> vCoins;
+    while (reader.ReadNext(hash, outputs)) {
+        for (auto& output : outputs) {
+            vCoins.emplace_back(COutPoint(hash, output.first), output.second);
+        }
+    }
+    BOOST_CHECK_EQUAL(reader.Finish(), hashSerialized);
+    BOOST_CHECK_EQUAL(reader.GetCoinsRead(), nCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), nCoins);
+    BOOST_CHECK(dbTarget.BulkWrite(vCoins));
+    {
+        // Completing the transition sets the best block
+        CCoinsViewCache cache(&dbTarget);
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(dbTarget.GetBestBlock() == hashBlock);
+    uint64_t nCoinsTarget;
+    BOOST_CHECK_EQUAL(HashUTXOSet(dbTarget, nCoinsTarget), hashSerialized);
+    BOOST_CHECK_EQUAL(nCoinsTarget, nCoins);
+}
+
+BOOST_AUTO_TEST_CASE(txoutsnapshot_corrupted)
+{
+    CCoinsViewDB db(1 << 20, true);
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(50, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    CSnapshotMetadata metadata;
+    metadata.hashBlock = db.GetBestBlock();
+    fs::path path = pathTemp / "utxo.dat";
+    uint64_t nCoins;
+    uint256 hashSerialized;
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor());
+    BOOST_CHECK(DumpUTXOSnapshot(pcursor.get(), metadata, path, nCoins, hashSerialized));
+    BOOST_CHECK_EQUAL(nCoins, 1U);
+
+    // Flip a bit of the coin's script, which is right before the trailer
+    uintmax_t nSize = fs::file_size(path);
+    FILE* file = fsbridge::fopen(path, "rb+");
+    BOOST_CHECK(file);
+    fseek(file, nSize - 32 - 8 - 32 - 1, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, nSize - 32 - 8 - 32 - 1, SEEK_SET);
+    fputc(ch ^ 1, file);
+    fclose(file);
+
+    CSnapshotReader reader(path);
+    uint256 hash;
+    std::map<uint32_t, Coin> outputs;
+    BOOST_CHECK(reader.ReadNext(hash, outputs));
+    BOOST_CHECK(!reader.ReadNext(hash, outputs));
+    BOOST_CHECK_THROW(reader.Finish(), std::ios_base::failure);
+
+    // Not a snapshot
+    FILE* fileOther = fsbridge::fopen(pathTemp / "other.dat", "wb");
+    fputs("not a snapshot", fileOther);
+    fclose(fileOther);
+    BOOST_CHECK_THROW(CSnapshotReader(pathTemp / "other.dat"), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
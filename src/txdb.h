@@ -7,6 +7,7 @@
 #define BITCOIN_TXDB_H
 
 #include <coins.h>
+#include <coinstats.h>
 #include <dbwrapper.h>
 #include <chain.h>
 
@@ -37,6 +38,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! LevelDB max_open_files of the block tree DB if -txindex
+static const int DEFAULT_TXINDEX_DB_MAX_OPEN_FILES = 256;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -63,6 +66,11 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** LevelDB options of the coin database, -dboption=chainstate:... applied */
+CDBOptions GetCoinsDBOptions(size_t nCacheSize);
+/** LevelDB options of the block tree database, tuned for -txindex and -dboption=blockindex:... applied */
+CDBOptions GetBlockTreeDBOptions(size_t nCacheSize);
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
@@ -75,12 +83,28 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Cursor over the coins of transactions with a txid of at least hashStart
+    CCoinsViewCursor *Cursor(const uint256 &hashStart) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Erase all coins and mark the database as moving to hashBlock, before loading a UTXO snapshot
+    bool StartBulkLoad(const uint256 &hashBlock);
+    //! Write coins straight to the database, bypassing the coins cache
+    bool BulkWrite(const std::vector<std::pair<COutPoint, Coin>> &vCoins);
+
+    //! Stats to store with the coins, once they're written at the stats' block
+    void SetTrackedStats(const CTrackedCoinsStats &stats) { trackedStats = stats; }
+    bool ReadTrackedStats(CTrackedCoinsStats &stats) const;
+
+    const CDBWrapper& GetDB() const { return db; }
+
+private:
+    CTrackedCoinsStats trackedStats;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
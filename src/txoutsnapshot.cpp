@@ -0,0 +1,136 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txoutsnapshot.h>
+
+#include <clientversion.h>
+#include <util.h>
+#include <version.h>
+
+#include <boost/thread.hpp>
+
+static void WriteTxOutputs(CAutoFile& file, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    file << hash;
+    WriteCompactSize(file, outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+    HashTxOutputs(ss, hash, outputs);
+}
+
+bool DumpUTXOSnapshot(CCoinsViewCursor* pcursor, const CSnapshotMetadata& metadata, const fs::path& path, uint64_t& nCoins, uint256& hashSerialized)
+{
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+    nCoins = 0;
+
+    try {
+        FILE* filestr = fsbridge::fopen(pathTmp, "wb");
+        if (!filestr) {
+            return error("%s: unable to open %s", __func__, pathTmp.string());
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+
+        file << metadata;
+        ss << metadata.hashBlock;
+
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                throw std::runtime_error("unable to read value");
+            }
+            if (!outputs.empty() && key.hash != prevkey) {
+                WriteTxOutputs(file, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            nCoins++;
+            pcursor->Next();
+        }
+        if (!outputs.empty()) {
+            WriteTxOutputs(file, ss, prevkey, outputs);
+        }
+
+        // A null hash ends the list of transactions
+        hashSerialized = ss.GetHash();
+        file << uint256() << nCoins << hashSerialized;
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        fs::remove(pathTmp);
+        return error("%s: %s", __func__, e.what());
+    }
+
+    if (!RenameOver(pathTmp, path)) {
+        return error("%s: unable to rename %s to %s", __func__, pathTmp.string(), path.string());
+    }
+    return true;
+}
+
+static FILE* OpenSnapshotFile(const fs::path& path)
+{
+    FILE* filestr = fsbridge::fopen(path, "rb");
+    if (!filestr)
+        throw std::ios_base::failure(strprintf("Unable to open %s", path.string()));
+    return filestr;
+}
+
+CSnapshotReader::CSnapshotReader(const fs::path& path) :
+    file(OpenSnapshotFile(path), SER_DISK, CLIENT_VERSION),
+    ss(SER_GETHASH, PROTOCOL_VERSION),
+    nCoins(0)
+{
+    file >> metadata;
+    ss << metadata.hashBlock;
+}
+
+bool CSnapshotReader::ReadNext(uint256& hash, std::map<uint32_t, Coin>& outputs)
+{
+    file >> hash;
+    if (hash.IsNull())
+        return false;
+    // Transactions are stored in database order, which rules out duplicates
+    if (!hashPrev.IsNull() && !(hashPrev < hash))
+        throw std::ios_base::failure("UTXO snapshot transactions out of order");
+    hashPrev = hash;
+
+    outputs.clear();
+    uint64_t nOutputs = ReadCompactSize(file);
+    if (nOutputs == 0)
+        throw std::ios_base::failure("UTXO snapshot transaction without outputs");
+    for (uint64_t i = 0; i < nOutputs; i++) {
+        uint32_t n;
+        Coin coin;
+        file >> VARINT(n) >> coin;
+        if (coin.IsSpent())
+            throw std::ios_base::failure("UTXO snapshot contains a spent output");
+        if (!outputs.empty() && outputs.rbegin()->first >= n)
+            throw std::ios_base::failure("UTXO snapshot outputs out of order");
+        outputs.emplace_hint(outputs.end(), n, std::move(coin));
+    }
+    HashTxOutputs(ss, hash, outputs);
+    nCoins += nOutputs;
+    return true;
+}
+
+uint256 CSnapshotReader::Finish()
+{
+    uint64_t nCoinsExpected;
+    uint256 hashExpected;
+    file >> nCoinsExpected >> hashExpected;
+    if (nCoinsExpected != nCoins)
+        throw std::ios_base::failure(strprintf("UTXO snapshot holds %u coins instead of %u", nCoins, nCoinsExpected));
+    uint256 hashSerialized = ss.GetHash();
+    if (hashSerialized != hashExpected)
+        throw std::ios_base::failure(strprintf("UTXO snapshot hash %s doesn't match its contents (%s)", hashExpected.GetHex(), hashSerialized.GetHex()));
+    return hashSerialized;
+}
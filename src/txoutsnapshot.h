@@ -0,0 +1,124 @@
+// Copyright (c) 2018 PM-Tech
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXOUTSNAPSHOT_H
+#define BITCOIN_TXOUTSNAPSHOT_H
+
+#include <coins.h>
+#include <fs.h>
+#include <hash.h>
+#include <serialize.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <uint256.h>
+
+#include <assert.h>
+#include <ios>
+#include <map>
+#include <string>
+#include <string.h>
+
+/** First bytes of a UTXO snapshot file */
+static const char UTXO_SNAPSHOT_MAGIC[] = {'u', 't', 'x', 'o', '\xff'};
+/** Current version of the UTXO snapshot file format */
+static const uint32_t UTXO_SNAPSHOT_VERSION = 1;
+/** Number of coins read from a snapshot before they are written to the coins database */
+static const size_t UTXO_SNAPSHOT_LOAD_BATCH = 100000;
+
+/**
+ * Serialize the unspent outputs of one transaction into the UTXO set hash.
+ * This is the serialization committed to by gettxoutsetinfo's hash_serialized_2,
+ * which starts with the hash of the block the UTXO set is at. Stream is a CHashWriter,
+ * or a buffer whose contents are hashed later.
+ */
+template <typename Stream>
+void HashTxOutputs(Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue);
+    }
+    ss << VARINT(0);
+}
+
+/** Header of a UTXO snapshot file, describing the block the UTXO set is at */
+class CSnapshotMetadata
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+    //! number of transactions in the chain up to and including hashBlock
+    uint64_t nChainTx;
+
+    CSnapshotMetadata() : nHeight(0), nChainTx(0) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << FLATDATA(UTXO_SNAPSHOT_MAGIC) << UTXO_SNAPSHOT_VERSION;
+        s << hashBlock << nHeight << nChainTx;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char magic[sizeof(UTXO_SNAPSHOT_MAGIC)];
+        uint32_t nVersion;
+        s >> FLATDATA(magic) >> nVersion;
+        if (memcmp(magic, UTXO_SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+            throw std::ios_base::failure("Not a UTXO snapshot file");
+        if (nVersion != UTXO_SNAPSHOT_VERSION)
+            throw std::ios_base::failure(strprintf("Unsupported UTXO snapshot version %u", nVersion));
+        s >> hashBlock >> nHeight >> nChainTx;
+    }
+};
+
+/**
+ * Write the coins returned by pcursor to a snapshot file.
+ *
+ * The file holds the metadata, then the unspent outputs grouped by transaction in
+ * database order, and ends with the number of coins and the UTXO set hash, so that
+ * the hash can be checked against a trusted node's gettxoutsetinfo before loading.
+ * The file is written next to path and only renamed to it once complete.
+ */
+bool DumpUTXOSnapshot(CCoinsViewCursor* pcursor, const CSnapshotMetadata& metadata, const fs::path& path, uint64_t& nCoins, uint256& hashSerialized);
+
+/**
+ * Reads a snapshot file written by DumpUTXOSnapshot one transaction at a time,
+ * hashing the coins as they are read. Read errors throw std::ios_base::failure.
+ */
+class CSnapshotReader
+{
+private:
+    CAutoFile file;
+    CSnapshotMetadata metadata;
+    CHashWriter ss;
+    uint256 hashPrev;
+    uint64_t nCoins;
+
+public:
+    //! Open the file and read the metadata
+    explicit CSnapshotReader(const fs::path& path);
+
+    const CSnapshotMetadata& GetMetadata() const { return metadata; }
+    uint64_t GetCoinsRead() const { return nCoins; }
+
+    /**
+     * Read the outputs of the next transaction.
+     * @return false once all transactions have been read
+     */
+    bool ReadNext(uint256& hash, std::map<uint32_t, Coin>& outputs);
+
+    /**
+     * Read the trailer once ReadNext returned false, and check it against the coins read.
+     * @return the hash of the coins read
+     */
+    uint256 Finish();
+};
+
+#endif // BITCOIN_TXOUTSNAPSHOT_H
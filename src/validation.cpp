@@ -8,10 +8,14 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfileparser.h>
+#include <blockfilewriter.h>
+#include <blockprefetch.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <coinstats.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
@@ -33,6 +37,7 @@
 #include <tinyformat.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txoutsnapshot.h>
 #include <ui_interface.h>
 #include <undo.h>
 #include <util.h>
@@ -168,9 +173,9 @@ public:
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CBlockUndo* pblockundo = nullptr);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, CBlockUndo* pblockundo = nullptr);
 
     // Block disconnection on our pcoinsTip:
     bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
@@ -183,6 +188,7 @@ public:
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
+    bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, uint64_t& nCoins, std::string& strError);
 
     void PruneBlockIndexCandidates();
 
@@ -200,6 +206,7 @@ private:
     void InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state);
     CBlockIndex* FindMostWorkChain();
     bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+    void LinkBlockTransactions(CBlockIndex *pindexNew);
 
 
     bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params);
@@ -219,6 +226,7 @@ std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
 bool fHavePruned = false;
+bool fHaveSnapshot = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
@@ -296,6 +304,12 @@ std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
+/** Size of the header (message start and size) preceding blocks and undo data in their files */
+static const unsigned int BLOCKFILE_RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
+/** Writes blocks and undo data to their files; records not written yet are read back from it */
+static CBlockFileWriter blockfilewriter;
+
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
@@ -308,7 +322,6 @@ static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
-static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -1073,16 +1086,28 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                std::vector<unsigned char> vchPending;
+                if (blockfilewriter.GetPending(CBlockFileWriter::BLOCK_FILE, postx, vchPending)) {
+                    try {
+                        CDataStream ss(vchPending, SER_DISK, CLIENT_VERSION);
+                        ss >> header;
+                        ss.ignore(postx.nTxOffset);
+                        ss >> txOut;
+                    } catch (const std::exception& e) {
+                        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                    }
+                } else {
+                    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                    if (file.IsNull())
+                        return error("%s: OpenBlockFile failed", __func__);
+                    try {
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    } catch (const std::exception& e) {
+                        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                    }
                 }
                 hashBlock = header.GetHash();
                 if (txOut->GetHash() != hash)
@@ -1128,37 +1153,35 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 
 static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
-
-    return true;
+    // Serialize the block with its index header, the writer puts it at pos
+    std::vector<unsigned char> vchRecord;
+    CVectorWriter stream(SER_DISK, CLIENT_VERSION, vchRecord, 0);
+    unsigned int nSize = GetSerializeSize(stream, block);
+    vchRecord.reserve(BLOCKFILE_RECORD_HEADER_SIZE + nSize);
+    stream << FLATDATA(messageStart) << nSize << block;
+
+    CDiskBlockPos posRecord = pos;
+    pos.nPos += BLOCKFILE_RECORD_HEADER_SIZE;
+    return blockfilewriter.Write(CBlockFileWriter::BLOCK_FILE, posRecord, BLOCKFILE_RECORD_HEADER_SIZE, std::move(vchRecord));
 }
 
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
+    // Read block, from memory if it's still queued for writing
     try {
-        filein >> block;
+        std::vector<unsigned char> vchPending;
+        if (blockfilewriter.GetPending(CBlockFileWriter::BLOCK_FILE, pos, vchPending)) {
+            CDataStream ss(vchPending, SER_DISK, CLIENT_VERSION);
+            ss >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1187,6 +1210,79 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    if (blockfilewriter.GetPending(CBlockFileWriter::BLOCK_FILE, pos, block))
+        return true;
+
+    // The block is preceded by the message start and its size, see WriteBlockToDisk()
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < BLOCKFILE_RECORD_HEADER_SIZE)
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+    hpos.nPos -= BLOCKFILE_RECORD_HEADER_SIZE;
+
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+
+        filein >> FLATDATA(blk_start) >> blk_size;
+
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                    HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                    HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+
+        if (blk_size > MAX_SIZE)
+            return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
+                    blk_size, MAX_SIZE);
+
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    }
+    catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    if (!ReadRawBlockFromDisk(block, blockPos, message_start))
+        return false;
+
+    // Only the header is checked, it's cheap compared to deserializing the whole block
+    CBlockHeader header;
+    try {
+        size_t nHeaderSize = std::min(block.size(), ::GetSerializeSize(header, SER_DISK, CLIENT_VERSION));
+        CDataStream ssHeader((const char*)block.data(), (const char*)block.data() + nHeaderSize, SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), blockPos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), blockPos.ToString());
+    return true;
+}
+
+bool IsRawBlockSerialization(const CBlockIndex* pindex, int nSerializeFlags, const Consensus::Params& params)
+{
+    // Blocks are stored with witnesses, which they can only have once segwit is active
+    return !(nSerializeFlags & SERIALIZE_TRANSACTION_NO_WITNESS) || !IsWitnessEnabled(pindex->pprev, params);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams, bool fSuperblockPartOnly)
 {
     int halvings = (nHeight - 1) / consensusParams.nSubsidyHalvingInterval;
@@ -1517,50 +1613,33 @@ namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    // Serialize the undo data with its index header, the writer puts it at pos
+    std::vector<unsigned char> vchRecord;
+    CVectorWriter stream(SER_DISK, CLIENT_VERSION, vchRecord, 0);
+    unsigned int nSize = GetSerializeSize(stream, blockundo);
+    vchRecord.reserve(BLOCKFILE_RECORD_HEADER_SIZE + nSize + sizeof(uint256));
+    stream << FLATDATA(messageStart) << nSize << blockundo;
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
+    stream << hasher.GetHash();
 
-    return true;
+    CDiskBlockPos posRecord = pos;
+    pos.nPos += BLOCKFILE_RECORD_HEADER_SIZE;
+    return blockfilewriter.Write(CBlockFileWriter::UNDO_FILE, posRecord, BLOCKFILE_RECORD_HEADER_SIZE, std::move(vchRecord));
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+template <typename Stream>
+static bool ReadUndo(Stream& stream, CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
-
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&stream); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
         verifier >> blockundo;
-        filein >> hashChecksum;
+        stream >> hashChecksum;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
@@ -1573,6 +1652,28 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    // Undo data still queued for writing is read from memory
+    std::vector<unsigned char> vchPending;
+    if (blockfilewriter.GetPending(CBlockFileWriter::UNDO_FILE, pos, vchPending)) {
+        CDataStream ss(vchPending, SER_DISK, CLIENT_VERSION);
+        return ReadUndo(ss, blockundo, pindex);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    return ReadUndo(filein, blockundo, pindex);
+}
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1628,8 +1729,9 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  The block's undo data is copied to pblockundo if given.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CBlockUndo* pblockundo)
 {
     bool fClean = true;
 
@@ -1643,6 +1745,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         error("DisconnectBlock(): block and undo data inconsistent");
         return DISCONNECT_FAILED;
     }
+    if (pblockundo)
+        *pblockundo = blockUndo;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -1686,27 +1790,21 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+/**
+ * Make all block and undo data written so far durable. With fFinalize, the last
+ * block file is only truncated and committed once its records are written instead,
+ * without waiting for it.
+ */
+static bool FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
-    CDiskBlockPos posOld(nLastBlockFile, 0);
-
-    FILE *fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
-
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
+    if (fFinalize) {
+        blockfilewriter.Finalize(CBlockFileWriter::BLOCK_FILE, nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize);
+        blockfilewriter.Finalize(CBlockFileWriter::UNDO_FILE, nLastBlockFile, vinfoBlockFile[nLastBlockFile].nUndoSize);
+        return true;
     }
+    return blockfilewriter.Flush();
 }
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
@@ -1757,6 +1855,32 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CBlockPrefetcher blockprefetcher;
+
+void StartBlockPrefetch(int nDepth, const CChainParams& chainparams)
+{
+    if (nDepth > 0)
+        blockprefetcher.Start(std::min(nDepth, BLOCK_PREFETCH_THREADS), std::min(nDepth, MAX_BLOCK_PREFETCH), chainparams.GetConsensus());
+}
+
+void StopBlockPrefetch()
+{
+    blockprefetcher.Interrupt();
+    blockprefetcher.Stop();
+}
+
+void StartBlockFileWriter(size_t nMaxQueuedBytes)
+{
+    blockfilewriter.Start(nMaxQueuedBytes, [](const std::string& strMessage) {
+        AbortNode(strMessage, _("Error: Failed to write block data, see debug.log for details"));
+    });
+}
+
+void StopBlockFileWriter()
+{
+    blockfilewriter.Stop();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1865,7 +1989,7 @@ static int64_t nBlocksTotal = 0;
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, CBlockUndo* pblockundo)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -2087,6 +2211,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
+    if (pblockundo)
+        *pblockundo = std::move(blockundo);
 
     if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
@@ -2173,7 +2299,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
-            FlushBlockFile();
+            if (!FlushBlockFile())
+                return AbortNode(state, "Failed to write block and undo data");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2206,9 +2333,19 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Flush the chainstate (which may refer to block index entries). The unspent
+            // coins stay cached, they're written but not dropped.
+            CTrackedCoinsStats coinstats;
+            if (g_coinstats_tracker.Get(coinstats))
+                pcoinsdbview->SetTrackedStats(coinstats);
+            if (!pcoinsTip->Sync())
                 return AbortNode(state, "Failed to write to coin database");
+            // When the cache is too large, make room by dropping (now unmodified) coins
+            // down to three quarters of the limit, instead of starting over from an empty cache.
+            if (fCacheLarge || fCacheCritical) {
+                pcoinsTip->Trim((3 * nTotalSpace) / 4);
+                LogPrint(BCLog::COINDB, "Trimmed coins cache from %.1fMiB to %.1fMiB\n", cacheSize * (1.0 / (1 << 20)), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)));
+            }
             nLastFlush = nNow;
         }
     }
@@ -2322,10 +2459,12 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     {
         CCoinsViewCache view(pcoinsTip.get());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        CBlockUndo blockundo;
+        if (DisconnectBlock(block, pindexDelete, view, &blockundo) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        g_coinstats_tracker.BlockDisconnected(block, pindexDelete, blockundo);
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2452,7 +2591,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        CBlockUndo blockundo;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, &blockundo);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2463,6 +2603,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        g_coinstats_tracker.BlockConnected(blockConnecting, pindexNew, blockundo);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -2574,6 +2715,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         if (!DisconnectTip(state, chainparams, &disconnectpool)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
+            blockprefetcher.Cancel();
             UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
@@ -2597,13 +2739,28 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         nHeight = nTargetHeight;
 
+        // Read the blocks ahead while the ones before them are connected
+        if (vpindexToConnect.size() > 1) {
+            std::vector<const CBlockIndex*> vpindexPrefetch;
+            for (const CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+                if (pindexConnect != pindexMostWork || !pblock)
+                    vpindexPrefetch.push_back(pindexConnect);
+            }
+            blockprefetcher.Prefetch(vpindexPrefetch, pcoinsdbview.get());
+        }
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+            std::shared_ptr<const CBlock> pblockConnect = pindexConnect == pindexMostWork ? pblock : nullptr;
+            if (!pblockConnect)
+                pblockConnect = blockprefetcher.Get(pindexConnect);
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect, connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
                         InvalidChainFound(vpindexToConnect.back());
+                    // The blocks after it won't be connected
+                    blockprefetcher.Cancel();
                     state = CValidationState();
                     fInvalidFound = true;
                     fContinue = false;
@@ -2612,6 +2769,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
                     // A system error occurred (disk space, database error, ...).
                     // Make the mempool consistent with the current tip, just in case
                     // any observers try to use it before shutdown.
+                    blockprefetcher.Cancel();
                     UpdateMempoolForReorg(disconnectpool, false);
                     return false;
                 }
@@ -2619,6 +2777,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
                 PruneBlockIndexCandidates();
                 if (!pindexOldTip || chainActive.Tip()->nChainWork > pindexOldTip->nChainWork) {
                     // We're in a better position than we were. Return temporarily to release the lock.
+                    // The blocks read ahead stay queued, the next step connects them.
                     fContinue = false;
                     break;
                 }
@@ -2731,7 +2890,10 @@ bool CChainState::ActivateBestChain(CValidationState &state, const CChainParams&
                     GetMainSignals().BlockConnected(trace.pblock, trace.pindex, trace.conflictedTxs);
                 }
             } while (!chainActive.Tip() || (starting_tip && CBlockIndexWorkComparator()(chainActive.Tip(), starting_tip)));
-            if (!blocks_connected) return true;
+            if (!blocks_connected) {
+                blockprefetcher.Cancel();
+                return true;
+            }
 
             const CBlockIndex* pindexFork = chainActive.FindFork(starting_tip);
             bool fInitialDownload = IsInitialBlockDownload();
@@ -2757,6 +2919,8 @@ bool CChainState::ActivateBestChain(CValidationState &state, const CChainParams&
         if (ShutdownRequested())
             break;
     } while (pindexNewTip != pindexMostWork);
+    // Nothing read ahead is needed anymore, e.g. when shutting down
+    blockprefetcher.Cancel();
     CheckBlockIndex(chainparams.GetConsensus());
 
     // Write changes periodically to disk, after relay.
@@ -2955,38 +3119,43 @@ bool CChainState::ReceivedBlockTransactions(const CBlock &block, CValidationStat
 
     if (pindexNew->pprev == nullptr || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
-        std::deque<CBlockIndex*> queue;
-        queue.push_back(pindexNew);
-
-        // Recursively process any descendant blocks that now may be eligible to be connected.
-        while (!queue.empty()) {
-            CBlockIndex *pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-            {
-                LOCK(cs_nBlockSequenceId);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (chainActive.Tip() == nullptr || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
-            while (range.first != range.second) {
-                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
-                queue.push_back(it->second);
-                range.first++;
-                mapBlocksUnlinked.erase(it);
-            }
-        }
+        LinkBlockTransactions(pindexNew);
     } else {
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             mapBlocksUnlinked.insert(std::make_pair(pindexNew->pprev, pindexNew));
         }
     }
-
     return true;
 }
 
+/** Set nChainTx of a block whose parents all have it, and of the descendants which were waiting for it. */
+void CChainState::LinkBlockTransactions(CBlockIndex *pindexNew)
+{
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexNew);
+
+    // Recursively process any descendant blocks that now may be eligible to be connected.
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (chainActive.Tip() == nullptr || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+}
+
 static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false)
 {
     LOCK(cs_LastBlockFile);
@@ -3010,8 +3179,8 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
     if ((int)nFile != nLastBlockFile) {
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
+            FlushBlockFile(true);
         }
-        FlushBlockFile(!fKnown);
         nLastBlockFile = nFile;
     }
 
@@ -3028,12 +3197,8 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
             if (fPruneMode)
                 fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
-                FILE *file = OpenBlockFile(pos);
-                if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
-                    fclose(file);
-                }
+                LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
+                blockfilewriter.Allocate(CBlockFileWriter::BLOCK_FILE, pos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
             }
             else
                 return error("out of disk space");
@@ -3061,12 +3226,8 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
         if (fPruneMode)
             fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
-            FILE *file = OpenUndoFile(pos);
-            if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
-                fclose(file);
-            }
+            LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
+            blockfilewriter.Allocate(CBlockFileWriter::UNDO_FILE, pos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
         }
         else
             return state.Error("out of disk space");
@@ -3779,7 +3940,7 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) {
 }
 
 /** Open an undo file (rev?????.dat) */
-static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
+FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
@@ -3903,6 +4064,11 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether the chainstate was loaded from a UTXO snapshot
+    pblocktree->ReadFlag("utxosnapshot", fHaveSnapshot);
+    if (fHaveSnapshot)
+        LogPrintf("LoadBlockIndexDB(): Chainstate was loaded from a UTXO snapshot\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3984,8 +4150,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
+        if ((fPruneMode || fHaveSnapshot) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning or loaded from a snapshot, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
@@ -4156,7 +4322,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
     CValidationState state;
     CBlockIndex* pindex = chainActive.Tip();
     while (chainActive.Height() >= nHeight) {
-        if (fPruneMode && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
+        if ((fPruneMode || fHaveSnapshot) && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, don't try rewinding past the HAVE_DATA point;
             // since older blocks can't be served anyway, there's
             // no need to walk further, and trying to DisconnectTip()
@@ -4273,6 +4439,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fHaveSnapshot = false;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -4334,6 +4501,179 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+bool CChainState::LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, uint64_t& nCoins, std::string& strError)
+{
+    // The transaction index would miss every transaction before the snapshot base. Governance
+    // looks up the collateral transactions of its objects there, which is why -masternode
+    // requires -txindex, so a snapshot can't bootstrap a masternode.
+    if (fTxIndex) {
+        strError = "A UTXO snapshot can't be loaded with -txindex, the transaction index would be incomplete";
+        return false;
+    }
+
+    // Check the whole snapshot before touching the chainstate, without holding cs_main
+    CSnapshotMetadata metadata;
+    uint64_t nCoinsTotal = 0;
+    try {
+        CSnapshotReader reader(path);
+        metadata = reader.GetMetadata();
+        uint256 hash;
+        std::map<uint32_t, Coin> outputs;
+        while (reader.ReadNext(hash, outputs)) {
+            if (ShutdownRequested()) {
+                strError = "Shutdown requested";
+                return false;
+            }
+        }
+        uint256 hashSerialized = reader.Finish();
+        if (hashSerialized != hashExpected) {
+            strError = strprintf("UTXO snapshot hash %s doesn't match the expected %s", hashSerialized.GetHex(), hashExpected.GetHex());
+            return false;
+        }
+        nCoinsTotal = reader.GetCoinsRead();
+    } catch (const std::exception& e) {
+        strError = e.what();
+        return false;
+    }
+
+    LOCK(cs_main);
+
+    BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+    if (mi == mapBlockIndex.end()) {
+        strError = strprintf("The snapshot base block %s isn't known yet, wait for the headers to be synced", metadata.hashBlock.GetHex());
+        return false;
+    }
+    CBlockIndex* pindexBase = mi->second;
+    if (pindexBase->nStatus & BLOCK_FAILED_MASK) {
+        strError = "The snapshot base block is invalid";
+        return false;
+    }
+    if (pindexBase->nHeight != metadata.nHeight || metadata.nChainTx <= (uint64_t)pindexBase->nHeight) {
+        strError = "The snapshot metadata doesn't match its base block";
+        return false;
+    }
+    if (fHaveSnapshot) {
+        strError = "A UTXO snapshot was already loaded";
+        return false;
+    }
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    if (pindexBase == pindexOldTip || pindexBase->GetAncestor(pindexOldTip->nHeight) != pindexOldTip) {
+        strError = "The active chain is already at or past the snapshot base block";
+        return false;
+    }
+
+    // Start from an empty coins cache, the coins database is about to be replaced
+    CValidationState state;
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS)) {
+        strError = FormatStateMessage(state);
+        return false;
+    }
+    pcoinsTip->Trim(0);
+    assert(pcoinsTip->GetCacheSize() == 0);
+    blockprefetcher.Cancel();
+
+    if (!pcoinsdbview->StartBulkLoad(metadata.hashBlock)) {
+        strError = "Failed to write to coin database";
+        return AbortNode(strError);
+    }
+    try {
+        CSnapshotReader reader(path);
+        std::vector<std::pair<COutPoint, Coin>> vCoins;
+        uint256 hash;
+        std::map<uint32_t, Coin> outputs;
+        int nProgressLogged = 0;
+        bool fMore;
+        do {
+            fMore = reader.ReadNext(hash, outputs);
+            for (auto& output : outputs) {
+                vCoins.emplace_back(COutPoint(hash, output.first), std::move(output.second));
+            }
+            outputs.clear();
+            if (vCoins.size() >= UTXO_SNAPSHOT_LOAD_BATCH || (!fMore && !vCoins.empty())) {
+                if (!pcoinsdbview->BulkWrite(vCoins))
+                    throw std::runtime_error("Failed to write to coin database");
+                vCoins.clear();
+
+                // This runs under cs_main, let the node operator know it's still making progress
+                int nProgress = nCoinsTotal ? (int)(reader.GetCoinsRead() * 100 / nCoinsTotal) : 100;
+                if (nProgress >= nProgressLogged + 10 || !fMore) {
+                    LogPrintf("%s: loaded %u of %u coins (%d%%)\n", __func__, reader.GetCoinsRead(), nCoinsTotal, nProgress);
+                    nProgressLogged = nProgress;
+                }
+                // The coins database is only usable again once the load completes
+                if (fMore && ShutdownRequested())
+                    throw std::runtime_error("Shutdown requested");
+            }
+        } while (fMore);
+        if (reader.Finish() != hashExpected)
+            throw std::runtime_error("UTXO snapshot changed while it was loaded");
+        nCoins = reader.GetCoinsRead();
+    } catch (const std::exception& e) {
+        // The previous coins are gone, the coins database can't be used anymore
+        strError = e.what();
+        return AbortNode(strprintf("Failed to load UTXO snapshot: %s", strError), _("Error loading the UTXO snapshot, you need to rebuild the database using -reindex-chainstate"));
+    }
+
+    // Link the block index up to the snapshot base the way it would be after pruning: the
+    // blocks we don't have are treated as validated, with one transaction each, and the
+    // remaining transactions are counted in the base block.
+    std::vector<CBlockIndex*> vToLink;
+    for (CBlockIndex* pindex = pindexBase; pindex != pindexOldTip; pindex = pindex->pprev) {
+        vToLink.push_back(pindex);
+    }
+    chainActive.SetTip(pindexBase);
+    for (CBlockIndex* pindex : reverse_iterate(vToLink)) {
+        if (pindex->nTx == 0) {
+            pindex->nTx = pindex != pindexBase ? 1 : std::max<int64_t>(1, (int64_t)metadata.nChainTx - pindex->pprev->nChainTx);
+        }
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        for (std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first; it != range.second; ++it) {
+            if (it->second == pindex) {
+                mapBlocksUnlinked.erase(it);
+                break;
+            }
+        }
+        if (pindex->nChainTx == 0)
+            LinkBlockTransactions(pindex);
+    }
+    PruneBlockIndexCandidates();
+
+    fHaveSnapshot = true;
+    pblocktree->WriteFlag("utxosnapshot", true);
+    pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+    // The tracked coin statistics are rebuilt by the next walk of the UTXO set
+    g_coinstats_tracker.Invalidate();
+    pcoinsdbview->SetTrackedStats(CTrackedCoinsStats());
+    mempool.clear();
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS)) {
+        strError = FormatStateMessage(state);
+        return false;
+    }
+    CheckBlockIndex(chainparams.GetConsensus());
+
+    LogPrintf("%s: loaded %u coins, new best=%s height=%d\n", __func__, nCoins, pindexBase->GetBlockHash().ToString(), pindexBase->nHeight);
+    bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(pindexBase, pindexOldTip, fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindexBase);
+    return true;
+}
+
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, uint64_t& nCoins, std::string& strError)
+{
+    if (!g_chainstate.LoadUTXOSnapshot(chainparams, path, hashExpected, nCoins, strError))
+        return false;
+
+    // Connect the blocks following the snapshot base which were already received
+    CValidationState state;
+    if (!ActivateBestChain(state, chainparams)) {
+        strError = FormatStateMessage(state);
+        return false;
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4342,46 +4682,21 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // This takes over fileIn and calls fclose() on it when done. Blocks are deserialized,
+        // hashed and checked by the parser's workers, they are accepted here in file order.
+        CBlockFileParser parser(chainparams, fileIn, std::max(0, std::min(GetNumCores() - 1, MAX_BLOCK_PARSE_THREADS)));
+        CBlockFileParser::CParsedBlock parsed;
+        while (parser.Next(parsed)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    dbp->nPos = parsed.nPos;
+                std::shared_ptr<CBlock> pblock = std::move(parsed.pblock);
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
+                const uint256& hash = parsed.hash;
                 if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
@@ -4510,8 +4825,9 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         }
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId <= 0);  // nSequenceId can't be set positive for blocks that aren't linked (negative is used for preciousblock)
         // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
-        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred
+        // and the chainstate wasn't loaded from a snapshot.
+        if (!fHavePruned && !fHaveSnapshot) {
             // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
             assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
             assert(pindexFirstMissing == pindexFirstNeverProcessed);
@@ -4570,7 +4886,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (pindexFirstMissing == nullptr) assert(!foundInUnlinked); // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
         if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == nullptr && pindexFirstMissing != nullptr) {
             // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
-            assert(fHavePruned); // We must have pruned.
+            assert(fHavePruned || fHaveSnapshot); // We must have pruned, or skipped blocks with a snapshot.
             // This block may have entered mapBlocksUnlinked if:
             //  - it has a descendant that at some point had more work than the
             //    tip, and
@@ -198,6 +198,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
+/** True if the chainstate was loaded from a UTXO snapshot, so blocks before it are missing. */
+extern bool fHaveSnapshot;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
@@ -259,6 +261,8 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationS
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** Open an undo file (rev?????.dat) */
+FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
@@ -270,10 +274,24 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
+/**
+ * Replace the chainstate with the UTXO snapshot at path, whose hash_serialized_2 must be
+ * hashExpected, and make its base block the tip. The active chain must be an ancestor of the
+ * base block, which must be in the block index. Blocks up to the base are not downloaded.
+ */
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, uint64_t& nCoins, std::string& strError);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Start reading up to nDepth blocks ahead while connecting several blocks in a row (0 = disabled) */
+void StartBlockPrefetch(int nDepth, const CChainParams& chainparams);
+/** Stop reading blocks ahead */
+void StopBlockPrefetch();
+/** Write blocks and undo data on a separate thread, queueing up to nMaxQueuedBytes (0 = write them right away) */
+void StartBlockFileWriter(size_t nMaxQueuedBytes);
+/** Write out the queued blocks and undo data and stop the writer thread */
+void StopBlockFileWriter();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -403,6 +421,11 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized block as it is stored, i.e. including witnesses, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Whether the stored block is the same as its serialization with nSerializeFlags, so it can be passed on as read by ReadRawBlockFromDisk */
+bool IsRawBlockSerialization(const CBlockIndex* pindex, int nSerializeFlags, const Consensus::Params& params);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -10,9 +10,11 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <privatesend.h>
 #include <rpc/server.h>
 #include <test/test_chaincoin.h>
 #include <validation.h>
+#include <validationinterface.h>
 #include <wallet/coincontrol.h>
 #include <wallet/test/wallet_test_fixture.h>
 
@@ -699,4 +701,211 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+//! Compare the wallet's UTXO index and its denominated buckets to a full scan of mapWallet
+static void CheckWalletUTXOIndex(const CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    std::set<COutPoint> setExpected;
+    std::map<CAmount, std::set<COutPoint> > mapExpectedDenominated;
+    for (const auto& entry : wallet.mapWallet) {
+        for (unsigned int i = 0; i < entry.second.tx->vout.size(); i++) {
+            const CTxOut& txout = entry.second.tx->vout[i];
+            if (!wallet.IsMine(txout) || wallet.IsSpent(entry.first, i)) continue;
+            setExpected.insert(COutPoint(entry.first, i));
+            if (CPrivateSend::IsDenominatedAmount(txout.nValue)) {
+                mapExpectedDenominated[txout.nValue].insert(COutPoint(entry.first, i));
+            }
+        }
+    }
+    std::map<CAmount, std::set<COutPoint> > mapDenominated = wallet.GetDenominatedUTXO();
+    for (auto it = mapDenominated.begin(); it != mapDenominated.end();) {
+        it = it->second.empty() ? mapDenominated.erase(it) : std::next(it);
+    }
+    BOOST_CHECK(wallet.GetWalletUTXO() == setExpected);
+    BOOST_CHECK(mapDenominated == mapExpectedDenominated);
+}
+
+static bool HaveWalletUTXO(const CWallet& wallet, const COutPoint& outpoint)
+{
+    LOCK(wallet.cs_wallet);
+    return wallet.GetWalletUTXO().count(outpoint) > 0;
+}
+
+class WalletUTXOTestingSetup : public ListCoinsTestingSetup
+{
+public:
+    WalletUTXOTestingSetup()
+    {
+        CPrivateSend::InitStandardDenominations();
+        RegisterValidationInterface(wallet.get());
+    }
+
+    ~WalletUTXOTestingSetup()
+    {
+        UnregisterValidationInterface(wallet.get());
+    }
+
+    CWalletTx& CreateAndCommit(const std::vector<CRecipient>& vecSend, const std::vector<COutPoint>& vInputs)
+    {
+        CWalletTx wtx;
+        CReserveKey reservekey(wallet.get());
+        CAmount fee;
+        int changePos = -1;
+        std::string error;
+        CCoinControl coin_control;
+        for (const auto& outpoint : vInputs) {
+            coin_control.Select(outpoint);
+        }
+        BOOST_CHECK(wallet->CreateTransaction(vecSend, wtx, reservekey, fee, changePos, error, coin_control));
+        CValidationState state;
+        BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+        LOCK(wallet->cs_wallet);
+        return wallet->mapWallet.at(wtx.GetHash());
+    }
+
+    void MineBlock(const std::vector<CMutableTransaction>& txns, const CScript& scriptCoinbase = CScript() << OP_TRUE)
+    {
+        CreateAndProcessBlock(txns, scriptCoinbase);
+        SyncWithValidationInterfaceQueue();
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(wallet_utxo_index, WalletUTXOTestingSetup)
+{
+    const CAmount nDenom = CPrivateSend::GetStandardDenominations()[1];
+    CScript scriptMine = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CScript scriptOther = GetScriptForRawPubKey({});
+    CheckWalletUTXOIndex(*wallet);
+
+    // Receive denominated outputs
+    std::vector<CRecipient> vecSend(4, CRecipient{scriptMine, nDenom, false});
+    vecSend.push_back(CRecipient{scriptMine, CPrivateSend::GetSmallestDenomination(), false});
+    CWalletTx& wtxFund = CreateAndCommit(vecSend, {});
+    MineBlock({CMutableTransaction(*wtxFund.tx)});
+    std::vector<COutPoint> vDenoms;
+    for (unsigned int i = 0; i < wtxFund.tx->vout.size(); i++) {
+        if (wtxFund.tx->vout[i].nValue == nDenom) vDenoms.emplace_back(wtxFund.GetHash(), i);
+    }
+    BOOST_REQUIRE_EQUAL(vDenoms.size(), 4U);
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK_EQUAL(wallet->GetDenominatedUTXO()[nDenom].size(), 4U);
+    }
+    CheckWalletUTXOIndex(*wallet);
+
+    // Spend one of them, then abandon the spend
+    CWalletTx& wtxSpend = CreateAndCommit({CRecipient{scriptOther, nDenom / 2, false}}, {vDenoms[0]});
+    BOOST_CHECK(!HaveWalletUTXO(*wallet, vDenoms[0]));
+    CheckWalletUTXOIndex(*wallet);
+    {
+        LOCK2(cs_main, mempool.cs);
+        mempool.removeRecursive(*wtxSpend.tx);
+    }
+    wallet->TransactionRemovedFromMempool(wtxSpend.tx);
+    BOOST_CHECK(wallet->AbandonTransaction(wtxSpend.GetHash()));
+    BOOST_CHECK(HaveWalletUTXO(*wallet, vDenoms[0]));
+    CheckWalletUTXOIndex(*wallet);
+
+    // A spend of two outputs is conflicted by a block spending one of them, the other one comes back
+    CWalletTx& wtxConflicted = CreateAndCommit({CRecipient{scriptOther, nDenom, false}}, {vDenoms[1], vDenoms[2]});
+    BOOST_CHECK(!HaveWalletUTXO(*wallet, vDenoms[1]));
+    BOOST_CHECK(!HaveWalletUTXO(*wallet, vDenoms[2]));
+    CMutableTransaction txConflicting;
+    txConflicting.vin.emplace_back(vDenoms[1]);
+    txConflicting.vout.emplace_back(nDenom / 2, scriptOther);
+    BOOST_CHECK(wallet->SignTransaction(txConflicting));
+    MineBlock({txConflicting});
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        BOOST_CHECK(wtxConflicted.GetDepthInMainChain() < 0);
+    }
+    BOOST_CHECK(!HaveWalletUTXO(*wallet, vDenoms[1]));
+    BOOST_CHECK(HaveWalletUTXO(*wallet, vDenoms[2]));
+    CheckWalletUTXOIndex(*wallet);
+
+    // Reorg the conflicting block away, the conflicted spend spends both outputs again
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    SyncWithValidationInterfaceQueue();
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        BOOST_CHECK_EQUAL(wtxConflicted.GetDepthInMainChain(), 0);
+    }
+    BOOST_CHECK(!HaveWalletUTXO(*wallet, vDenoms[2]));
+    CheckWalletUTXOIndex(*wallet);
+
+    // Mined again in a competing block
+    MineBlock({txConflicting}, CScript() << OP_FALSE);
+    BOOST_CHECK(HaveWalletUTXO(*wallet, vDenoms[2]));
+    CheckWalletUTXOIndex(*wallet);
+
+    // Loading the wallet builds the same index
+    std::unique_ptr<CWallet> walletReloaded(new CWallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_test.dat"))));
+    bool firstRun;
+    walletReloaded->LoadWallet(firstRun);
+    CheckWalletUTXOIndex(*walletReloaded);
+    {
+        LOCK2(wallet->cs_wallet, walletReloaded->cs_wallet);
+        BOOST_CHECK(walletReloaded->GetWalletUTXO() == wallet->GetWalletUTXO());
+    }
+}
+
+static CWalletTx& AddRoundsTx(CWallet& wallet, const std::vector<COutPoint>& vInputs, const std::vector<CAmount>& vAmounts, const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    for (const auto& outpoint : vInputs) {
+        tx.vin.emplace_back(outpoint);
+    }
+    for (CAmount nAmount : vAmounts) {
+        tx.vout.emplace_back(nAmount, scriptPubKey);
+    }
+    CWalletTx wtx(&wallet, MakeTransactionRef(tx));
+    BOOST_CHECK(wallet.AddToWallet(wtx));
+    return wallet.mapWallet.at(wtx.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(privatesend_rounds_cache)
+{
+    CPrivateSend::InitStandardDenominations();
+    const CAmount nDenom = CPrivateSend::GetStandardDenominations()[1];
+
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(wallet, key);
+    CScript scriptMine = GetScriptForRawPubKey(key.GetPubKey());
+
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    // A funding transaction with a change output and two mixing rounds on top of it,
+    // the mixing transactions arrive before the funding one
+    CMutableTransaction txFund;
+    txFund.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    txFund.vout.emplace_back(nDenom, scriptMine);
+    txFund.vout.emplace_back(5 * COIN, scriptMine);
+    const uint256 hashFund = txFund.GetHash();
+    CWalletTx& wtxRound1 = AddRoundsTx(wallet, {COutPoint(hashFund, 0)}, {nDenom}, scriptMine);
+    CWalletTx& wtxRound2 = AddRoundsTx(wallet, {COutPoint(wtxRound1.GetHash(), 0)}, {nDenom}, scriptMine);
+
+    // Without the funding transaction the first round looks like the start of the chain
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(wtxRound1.GetHash(), 0), 0), 0);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(wtxRound2.GetHash(), 0), 0), 1);
+    // Cached, asking again gives the same
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(wtxRound2.GetHash(), 0), 0), 1);
+
+    // The funding transaction arrives, the cached rounds on top of it are recalculated
+    CWalletTx wtxFund(&wallet, MakeTransactionRef(txFund));
+    BOOST_CHECK(wallet.AddToWallet(wtxFund));
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashFund, 0), 0), 0);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(hashFund, 1), 0), -2);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(wtxRound1.GetHash(), 0), 0), 1);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(wtxRound2.GetHash(), 0), 0), 2);
+
+    // Outputs of transactions we don't have
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(InsecureRand256(), 0), 0), -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -656,7 +656,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
-    setWalletUTXO.erase(outpoint);
+    RemoveFromWalletUTXO(outpoint);
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1003,9 +1003,14 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         AddToSpends(hash);
         for(size_t i = 0; i < wtx.tx->vout.size(); ++i) {
             if (IsMine(wtx.tx->vout[i]) && !IsSpent(hash, i)) {
-                setWalletUTXO.insert(COutPoint(hash, i));
+                AddToWalletUTXO(COutPoint(hash, i), wtx.tx->vout[i].nValue);
             }
         }
+        // we learned about an ancestor of transactions we have already (e.g. during rescan),
+        // cached rounds of their outputs could be too low now
+        if (!mapOutpointRoundsCache.empty() && mapTxSpends.lower_bound(COutPoint(hash, 0)) != mapTxSpends.lower_bound(COutPoint(hash, std::numeric_limits<uint32_t>::max()))) {
+            mapOutpointRoundsCache.clear();
+        }
     }
 
     bool fUpdated = false;
@@ -1052,6 +1057,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         if (!walletdb.WriteTx(wtx))
             return false;
 
+    if (fUpdated)
+        SyncWalletUTXOSpentBy(wtx);
+
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
@@ -1227,6 +1235,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
                     it->second.MarkDirty();
                 }
             }
+            SyncWalletUTXOSpentBy(wtx);
         }
     }
 
@@ -1293,6 +1302,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
                     it->second.MarkDirty();
                 }
             }
+            SyncWalletUTXOSpentBy(wtx);
         }
     }
 
@@ -1366,6 +1376,16 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx);
     }
+
+    // Transactions conflicted by this block (and their descendants, MarkConflicted records the
+    // same block for them) aren't conflicted anymore, they spend their inputs again
+    const uint256 hashBlock = pblock->GetHash();
+    for (const auto& entry : mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        if (wtx.nIndex == -1 && wtx.hashBlock == hashBlock) {
+            SyncWalletUTXOSpentBy(wtx);
+        }
+    }
 }
 
 
@@ -1428,10 +1448,45 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
     return 0;
 }
 
+void CWallet::AddToWalletUTXO(const COutPoint& outpoint, CAmount nValue)
+{
+    AssertLockHeld(cs_wallet);
+    setWalletUTXO.insert(outpoint);
+    if (CPrivateSend::IsDenominatedAmount(nValue)) {
+        mapDenominatedUTXO[nValue].insert(outpoint);
+    }
+}
+
+void CWallet::RemoveFromWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    if (!setWalletUTXO.erase(outpoint)) return;
+    // only a handful of denominations, no need to look up the amount
+    for (auto& denompair : mapDenominatedUTXO) {
+        if (denompair.second.erase(outpoint)) break;
+    }
+}
+
+void CWallet::SyncWalletUTXOSpentBy(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    for (const CTxIn& txin : wtx.tx->vin) {
+        auto it = mapWallet.find(txin.prevout.hash);
+        if (it == mapWallet.end() || txin.prevout.n >= it->second.tx->vout.size()) continue;
+        const CTxOut& txout = it->second.tx->vout[txin.prevout.n];
+        if (!IsMine(txout)) continue;
+        if (IsSpent(txin.prevout.hash, txin.prevout.n)) {
+            RemoveFromWalletUTXO(txin.prevout);
+        } else {
+            AddToWalletUTXO(txin.prevout, txout.nValue);
+        }
+    }
+}
+
 // Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input)
 int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
+    AssertLockHeld(cs_wallet);
 
     if(nRounds >= MAX_PRIVATESEND_ROUNDS) {
         // there can only be MAX_PRIVATESEND_ROUNDS rounds max
@@ -1444,17 +1499,12 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
     const CWalletTx* wtx = GetWalletTx(hash);
     if(wtx != nullptr)
     {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        if (mdwi == mDenomWtxes.end()) {
-            // not known yet, let's add it
-            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx->tx);
-        } else if(mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            // found and it's not an initial value, just return it
-            return mDenomWtxes[hash].vout[nout].nRounds;
+        auto itCached = mapOutpointRoundsCache.find(outpoint);
+        if (itCached != mapOutpointRoundsCache.end()) {
+            // found, just return it
+            return itCached->second;
         }
 
-
         // bounds check
         if (nout >= wtx->tx->vout.size()) {
             // should never actually hit this
@@ -1462,17 +1512,19 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
             return -4;
         }
 
+        int& nRoundsRet = mapOutpointRoundsCache[outpoint];
+
         if (CPrivateSend::IsCollateralAmount(wtx->tx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRoundsRet = -3;
+            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRoundsRet);
+            return nRoundsRet;
         }
 
         //make sure the final output is non-denominate
         if (!CPrivateSend::IsDenominatedAmount(wtx->tx->vout[nout].nValue)) { //NOT DENOM
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRoundsRet = -2;
+            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRoundsRet);
+            return nRoundsRet;
         }
 
         bool fAllDenoms = true;
@@ -1482,9 +1534,9 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
 
         // this one is denominated but there is another non-denominated output found in the same tx
         if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRoundsRet = 0;
+            LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRoundsRet);
+            return nRoundsRet;
         }
 
         int nShortest = -10; // an initial value, should be no way to get this by calculations
@@ -1500,11 +1552,12 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
+        // std::map references stay valid while other entries are inserted by the recursion above
+        nRoundsRet = fDenomFound
                 ? (nShortest >= MAX_PRIVATESEND_ROUNDS - 1 ? MAX_PRIVATESEND_ROUNDS : nShortest + 1) // good, we a +1 to the shortest one but only MAX_PRIVATESEND_ROUNDS rounds max allowed
                 : 0;            // too bad, we are the fist one in that chain
-        LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        LogPrint(BCLog::PRIVSEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRoundsRet);
+        return nRoundsRet;
     }
 
     return nRounds - 1;
@@ -2378,14 +2431,15 @@ CAmount CWallet::GetAnonymizedBalance() const
 
     LOCK2(cs_main, cs_wallet);
 
+    // only transactions with denominated outputs can have anonymized credit
     std::set<uint256> setWalletTxesCounted;
-    for (const auto& outpoint : setWalletUTXO) {
+    for (const auto& denompair : mapDenominatedUTXO) {
+        for (const auto& outpoint : denompair.second) {
 
-        if (setWalletTxesCounted.find(outpoint.hash) != setWalletTxesCounted.end()) continue;
-        setWalletTxesCounted.insert(outpoint.hash);
+            if (!setWalletTxesCounted.insert(outpoint.hash).second) continue;
 
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash); it != mapWallet.end() && it->first == outpoint.hash; ++it) {
-            if (it->second.IsTrusted())
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
+            if (it != mapWallet.end() && it->second.IsTrusted())
                 nTotal += it->second.GetAnonymizedCredit();
         }
     }
@@ -2403,11 +2457,11 @@ float CWallet::GetAverageAnonymizedRounds() const
     int nCount = 0;
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& outpoint : setWalletUTXO) {
-        if(!IsDenominated(outpoint)) continue;
-
-        nTotal += GetOutpointPrivateSendRounds(outpoint);
-        nCount++;
+    for (const auto& denompair : mapDenominatedUTXO) {
+        for (const auto& outpoint : denompair.second) {
+            nTotal += GetOutpointPrivateSendRounds(outpoint);
+            nCount++;
+        }
     }
 
     if(nCount == 0) return 0;
@@ -2424,14 +2478,15 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
     CAmount nTotal = 0;
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& outpoint : setWalletUTXO) {
-        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
-        if (it == mapWallet.end()) continue;
-        if (!IsDenominated(outpoint)) continue;
-        if (it->second.GetDepthInMainChain() < 0) continue;
+    for (const auto& denompair : mapDenominatedUTXO) {
+        for (const auto& outpoint : denompair.second) {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
+            if (it == mapWallet.end()) continue;
+            if (it->second.GetDepthInMainChain() < 0) continue;
 
-        int nRounds = GetOutpointPrivateSendRounds(outpoint);
-        nTotal += it->second.tx->vout[outpoint.n].nValue * nRounds / privateSendClient.nPrivateSendRounds;
+            int nRounds = GetOutpointPrivateSendRounds(outpoint);
+            nTotal += denompair.first * nRounds / privateSendClient.nPrivateSendRounds;
+        }
     }
 
     return nTotal;
@@ -2620,8 +2675,29 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
 
         CAmount nTotal = 0;
 
-        for (const auto& entry : mapWallet)
+        // denominated outputs are indexed, look only at the transactions having some of them then
+        std::vector<std::map<uint256, CWalletTx>::const_iterator> vWalletEntries;
+        if (nCoinType == ONLY_DENOMINATED) {
+            std::set<uint256> setDenomTxids;
+            for (const auto& denompair : mapDenominatedUTXO) {
+                for (const auto& outpoint : denompair.second) {
+                    setDenomTxids.insert(outpoint.hash);
+                }
+            }
+            for (const auto& txid : setDenomTxids) {
+                auto it = mapWallet.find(txid);
+                if (it != mapWallet.end()) vWalletEntries.push_back(it);
+            }
+        } else {
+            vWalletEntries.reserve(mapWallet.size());
+            for (auto it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+                vWalletEntries.push_back(it);
+            }
+        }
+
+        for (const auto& itEntry : vWalletEntries)
         {
+            const auto& entry = *itEntry;
             const uint256& wtxid = entry.first;
             const CWalletTx* pcoin = &entry.second;
 
@@ -4098,7 +4174,7 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     for (auto& pair : mapWallet) {
         for(unsigned int i = 0; i < pair.second.tx->vout.size(); ++i) {
             if (IsMine(pair.second.tx->vout[i]) && !IsSpent(pair.first, i)) {
-                setWalletUTXO.insert(COutPoint(pair.first, i));
+                AddToWalletUTXO(COutPoint(pair.first, i), pair.second.tx->vout[i].nValue);
             }
         }
     }
@@ -4120,6 +4196,7 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
     for (uint256 hash : vHashOut)
         mapWallet.erase(hash);
+    mapOutpointRoundsCache.clear();
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
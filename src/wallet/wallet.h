@@ -752,6 +752,15 @@ private:
     void AddToSpends(const uint256& wtxid);
 
     std::set<COutPoint> setWalletUTXO;
+    // denominated outpoints of setWalletUTXO bucketed by denomination
+    std::map<CAmount, std::set<COutPoint> > mapDenominatedUTXO;
+    // PrivateSend rounds of outpoints we calculated already, only depends on the ancestors of an outpoint
+    mutable std::map<COutPoint, int> mapOutpointRoundsCache;
+
+    void AddToWalletUTXO(const COutPoint& outpoint, CAmount nValue);
+    void RemoveFromWalletUTXO(const COutPoint& outpoint);
+    // put the outputs spent by wtx back into setWalletUTXO or take them out, after wtx was abandoned, conflicted or confirmed again
+    void SyncWalletUTXOSpentBy(const CWalletTx& wtx);
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -943,6 +952,10 @@ public:
 
     bool IsDenominated(const COutPoint& outpoint) const;
 
+    // the indexed unspent outputs of the wallet, for checking the index against mapWallet
+    std::set<COutPoint> GetWalletUTXO() const { AssertLockHeld(cs_wallet); return setWalletUTXO; }
+    std::map<CAmount, std::set<COutPoint> > GetDenominatedUTXO() const { AssertLockHeld(cs_wallet); return mapDenominatedUTXO; }
+
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
     bool IsLockedCoin(uint256 hash, unsigned int n) const;
@@ -21,3 +21,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
     return true;
 }
 
+bool CZMQAbstractNotifier::NotifyMessageStats(const std::map<std::string, CNetMsgCmdStats>& /*mapStats*/)
+{
+    return true;
+}
+
@@ -7,7 +7,10 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <map>
+
 class CBlockIndex;
+struct CNetMsgCmdStats;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -34,6 +37,7 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyMessageStats(const std::map<std::string, CNetMsgCmdStats>& mapStats);
 
 protected:
     void *psocket;
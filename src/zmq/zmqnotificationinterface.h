@@ -10,6 +10,9 @@
 #include <map>
 #include <list>
 
+/** Interval in seconds of the msgstats notification */
+static const int64_t ZMQ_MSGSTATS_INTERVAL = 60;
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
@@ -20,6 +23,9 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    /** Publish the statistics of received messages, called every ZMQ_MSGSTATS_INTERVAL seconds */
+    void NotifyMessageStats();
+
 protected:
     bool Initialize();
     void Shutdown();
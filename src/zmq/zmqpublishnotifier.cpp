@@ -4,6 +4,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <netmsgstats.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
@@ -16,6 +17,7 @@ static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
+static const char *MSG_MSGSTATS   = "msgstats";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -196,3 +198,10 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
 
+bool CZMQPublishMessageStatsNotifier::NotifyMessageStats(const std::map<std::string, CNetMsgCmdStats>& mapStats)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish msgstats of %u message types\n", mapStats.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mapStats;
+    return SendMessage(MSG_MSGSTATS, &(*ss.begin()), ss.size());
+}
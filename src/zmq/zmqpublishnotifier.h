@@ -52,4 +52,10 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishMessageStatsNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMessageStats(const std::map<std::string, CNetMsgCmdStats>& mapStats) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H